@@ -7,174 +7,482 @@
 # License: MIT
 #
 # ## ###############################################
-import socket
+import asyncio
 import json
 import threading
 import time
+import itertools
 from datetime import datetime, timezone
+from telemetryCodec import (
+    FrameError,
+    samplesToSensorsJSON,
+    decodeSummaryFrame,
+    FRAME_SUMMARY
+)
+from latency import (
+    recordLatency,
+    CLICK_TO_SEND,
+    SEND_TO_ACK,
+    DEVICE_APPLY,
+    CLICK_TO_ACK
+)
+from udpTelemetry import startUDPTelemetryServer
+from streamFramer import StreamFramer, FRAME_COMPACT
+from seriesStore import startSeriesWriter
+from rollupStore import startRollupWorker
+from deviceLogs import storeDeviceLogs
+from deviceSessions import (
+    DeviceSession,
+    registerSession,
+    renameSession,
+    unregisterSession,
+    findSession
+)
 from graphics import (
     storeData,
-    resetMeasurements,
-    periodicGraphsUpdate,
+    storeJournalRecords,
+    commitJournalSegment,
+    storeSummary,
+    startTextWriter,
     createDataDirectories,
     writeToLOG
 )
 
-client_connection = None
-client_address = None
+DATA_PORT = 42069
+# Conexiones que el kernel encola mientras el lazo de eventos las acepta
+LISTEN_BACKLOG = 512
+READ_CHUNK = 4096
+# Sin nada del dispositivo en este tiempo la conexion se da por muerta (el silencio maximo por
+# defecto del reporte por excepcion es 60 s)
+READ_TIMEOUT_S = 120
+SEND_TIMEOUT_S = 2
 IRRIGATION_TIME_S = 20
+ACK_TIMEOUT_S = 3
+# Canales de reporte por excepcion en el dispositivo
+REPORT_CHANNELS = {"LM135": 0, "AM2302T": 1, "AM2302H": 2}
+TELEMETRY_STREAMS = {"raw": 1, "summary": 2, "both": 3}
+MAX_COMMAND_RETRIES = 3
+# Operaciones por lote que acepta el dispositivo (COMMAND_BATCH_MAX_OPS)
+MAX_BATCH_OPERATIONS = 8
+# Modos que se aplican en un solo lote: (funcion, argumento[, canal]) con los argumentos que recibe el dispositivo
+PRESETS = {
+    "dia": [("setDesiredTemperature", 25), ("setFanAuto", 1)],
+    "noche": [("setDesiredTemperature", 18), ("setFanAuto", 1), ("setIrrigation", 0)],
+    "ventilacion": [("setDesiredTemperature", 20), ("setFanPower", 1.0), ("setIrrigation", 0)],
+}
+
+# Comandos enviados que aun no han sido confirmados por el dispositivo
+commandIds = itertools.count(1)
+pendingCommands = {}
+pendingLock = threading.Lock()
+# Ultimo estado confirmado por cada dispositivo para cada funcion, sobrevive a las reconexiones
+deviceState = {}
+
+
+class TCPDeviceSession(DeviceSession):
+    """Dispositivo conectado por TCP, los comandos se escriben desde cualquier hilo a traves del lazo de eventos"""
+    transport = "tcp"
+
+    def __init__(self, reader, writer, loop):
+        address = writer.get_extra_info('peername')
+        # Id provisional hasta que el dispositivo se anuncia con hello
+        super().__init__(f"{address[0]}:{address[1]}" if address else "tcp", address)
+        self.reader = reader
+        self.writer = writer
+        self.loop = loop
+        self.framer = StreamFramer()
+
+    async def _write(self, data):
+        self.writer.write(data)
+        await self.writer.drain()
+        return True
 
+    def sendCommand(self, funcDict):
+        if self.closed:
+            return False
+        data = (json.dumps(funcDict) + "\n").encode()
+        try:
+            running = asyncio.get_running_loop()
+        except RuntimeError:
+            running = None
+        if running is self.loop:
+            # Desde el propio lazo (p. ej. al confirmar un segmento del journal) no se puede esperar
+            self.writer.write(data)
+            return True
+        try:
+            return asyncio.run_coroutine_threadsafe(self._write(data), self.loop).result(SEND_TIMEOUT_S)
+        except Exception as e:
+            print(f"[Servidor de datos]: Error enviando a {self.deviceId}: {e}")
+            return False
 
-def waitClientConnection(server_socket):
-    global client_connection, client_address
-    client_connection, client_address = server_socket.accept()
-    print('[Servidor de datos]: Conexión desde', client_address)
+    def close(self):
+        super().close()
+        self.loop.call_soon_threadsafe(self.writer.close)
 
+    def summary(self):
+        return dict(super().summary(), framing=self.framer.stats())
 
-def receiveMeasurementsFromClient():
-    """Maneja la recepcion de datos con el cliente."""
-    global client_connection, client_address
-    if not client_connection or not client_address:
-        print("[Servidor de datos]: No hay cliente, imposible recabar datos")
-        return
 
-    threading.Thread(target=periodicGraphsUpdate, daemon=True).start()
-    resetMeasurements()
+def clientAvailable(device=None):
+    """Indica si hay un dispositivo (el indicado o el ultimo conectado) al cual enviar comandos"""
+    return findSession(device) is not None
 
-    while True:
-        try:
-            data = client_connection.recv(1024)
-            if not data:
-                print(f"[Servidor de datos]: Cliente {client_address} se desconectó.")
-                break
 
-            receivedJSON = json.loads(data.decode())
-            storeData(receivedJSON)
+def consumeStream(session, data):
+    """Procesa los bytes recibidos de un dispositivo: el framer de la sesion separa las lineas JSON
+    y las tramas compactas y las que no se pueden decodificar se cuentan como rechazadas"""
+    frames = session.framer.feed(data)
+    for kind, frame in frames:
+        if kind == FRAME_COMPACT:
+            decoded = storeCompactFrame(session, frame)
+        else:
+            decoded = processJSONMessage(frame, session)
+        if not decoded:
+            session.framer.reject()
+    session.touch(len(data), len(frames))
 
-        except (ConnectionResetError, BrokenPipeError):
-            print(f"[Servidor de datos]: Conexión perdida abruptamente con {client_address}")
-            break
-        except socket.timeout:
-            print(f"[Servidor de datos]: Timeout con {client_address}")
-            break
-        except json.JSONDecodeError as e:
-            print(f"[Servidor de datos]: Error decodificando JSON: {e}")
-        except Exception as e:
-            print(f"[Servidor de datos]: Error inesperado: {e}")
-            break
 
+async def handleDevice(reader, writer):
+    """Atiende la conexion de un dispositivo hasta que se cierra o expira"""
+    session = TCPDeviceSession(reader, writer, asyncio.get_running_loop())
+    registerSession(session)
+    print(f"[Servidor de datos]: Conexión desde {session.address}")
     try:
-        client_connection.close()
-        resetMeasurements()
-        print(f"[Servidor de datos]: Conexión cerrada con {client_address}")
-    except:
-        pass
-
-
-def handleClientConnection(server_socket):
-    """Maneja la conexión del cliente y reconexiones automáticas."""
-    global client_connection, client_address
-    while True:
+        while not session.closed:
+            data = await asyncio.wait_for(reader.read(READ_CHUNK), READ_TIMEOUT_S)
+            if not data:
+                print(f"[Servidor de datos]: Cliente {session.deviceId} se desconectó.")
+                break
+            consumeStream(session, data)
+    except asyncio.TimeoutError:
+        print(f"[Servidor de datos]: Timeout con {session.deviceId}")
+    except (ConnectionResetError, BrokenPipeError):
+        print(f"[Servidor de datos]: Conexión perdida abruptamente con {session.deviceId}")
+    except Exception as e:
+        print(f"[Servidor de datos]: Error inesperado con {session.deviceId}: {e}")
+    finally:
+        unregisterSession(session)
+        session.closed = True
+        writer.close()
         try:
-            waitClientConnection(server_socket)
-            client_connection.settimeout(10)
-
-            client_thread = threading.Thread(
-                target=receiveMeasurementsFromClient,
-                daemon=True,
-            )
-            client_thread.start()
-
-            # Esperar a que el hilo termine (cuando el cliente se desconecte)
-            client_thread.join()
-            client_connection = None
-            client_address = None
-            print("[Servidor de datos]: Cliente desconectado. Esperando nueva conexión...")
-
-        except Exception as e:
-            print(f"[Servidor de datos]: Error en la conexión con el cliente: {e}")
-            time.sleep(1)  # Pequeña pausa antes de reintentar
+            await writer.wait_closed()
+        except Exception:
+            pass
+        framing = session.framer.stats()
+        print(f"[Servidor de datos]: Conexión cerrada con {session.deviceId} ({framing['lines']} líneas, "
+              f"{framing['compactFrames']} tramas compactas, {framing['resyncs']} resincronizaciones, "
+              f"{framing['discardedBytes']} bytes descartados, {framing['rejected']} rechazadas)")
+
+
+def processJSONMessage(line, session):
+    """Despacha un mensaje JSON del dispositivo de session segun su tipo.
+    Regresa False si la linea no es JSON valido"""
+    try:
+        receivedJSON = json.loads(line.decode())
+    except (json.JSONDecodeError, UnicodeDecodeError) as e:
+        print(f"[Servidor de datos]: Error decodificando JSON de {session.deviceId}: {e}")
+        return False
+    if 'hello' in receivedJSON:
+        print(f"[Servidor de datos]: {session.deviceId} es {receivedJSON['hello']}")
+        renameSession(session, str(receivedJSON['hello']))
+        # Estado con que arranco el dispositivo (restaurado de NVS), vale hasta el siguiente ack
+        if isinstance(receivedJSON.get('state'), dict):
+            deviceState.setdefault(session.deviceId, {}).update(receivedJSON['state'])
+    elif 'ack' in receivedJSON:
+        handleAck(receivedJSON)
+    elif 'journal' in receivedJSON:
+        storeJournalRecords(receivedJSON, session.deviceId)
+    elif 'journalEnd' in receivedJSON:
+        acknowledgeJournalSegment(receivedJSON, session.deviceId)
+    elif 'summary' in receivedJSON:
+        storeSummary(receivedJSON['summary'], session.deviceId)
+    elif 'logs' in receivedJSON:
+        storeDeviceLogs(receivedJSON)
+    else:
+        storeData(receivedJSON, device=session.deviceId)
+    return True
+
+
+def storeCompactFrame(session, payload):
+    """Decodifica una trama compacta; la ultima muestra corresponde al momento de recepcion menos la
+    antiguedad que indica la trama (un lote incompleto puede esperar hasta el silencio maximo).
+    Regresa False si la trama es invalida"""
+    if payload and payload[0] == FRAME_SUMMARY:
+        # Los resumenes no dependen de la cadena de deltas
+        try:
+            storeSummary(decodeSummaryFrame(payload), session.deviceId)
+        except (FrameError, IndexError) as e:
+            print(f"[Servidor de datos]: Trama de resumen inválida de {session.deviceId}: {e}")
+            return False
+        return True
+    try:
+        age, samples = session.decoder.decodeFrame(payload)
+    except (FrameError, IndexError) as e:
+        print(f"[Servidor de datos]: Trama compacta inválida de {session.deviceId}: {e}")
+        return False
+    sampleTime = time.time() - age
+    times = []
+    for dt, _ in reversed(samples):
+        times.append(sampleTime)
+        sampleTime -= dt
+    for (_, values), t in zip(samples, reversed(times)):
+        storeData(samplesToSensorsJSON(values), t, session.deviceId)
+    return True
 
 
-def setFanPower(power):
+def setFanPower(power, clickTime=None, device=None):
     """Configura la potencia del ventilador
     Power se divide pra dejarlo en rango [0, 1]"""
-    if sendFunctionToClient("setFanPower", power/100.0):
+    if sendFunctionToClient("setFanPower", power/100.0, clickTime, device=device):
         writeToLOG(f"Potencia de ventilador modificada al: {power}%")
 
 
-def setDesiredTemperature(temperature):
+def setFanAuto(clickTime=None, device=None):
+    """Regresa el ventilador al control automatico de enfriamiento del dispositivo"""
+    if sendFunctionToClient("setFanAuto", 1, clickTime, device=device):
+        writeToLOG("Ventilador en modo automático")
+
+
+def setDesiredTemperature(temperature, clickTime=None, device=None):
     """Configura la temperatura deseada del sistema"""
-    if sendFunctionToClient("setDesiredTemperature", temperature):
+    if sendFunctionToClient("setDesiredTemperature", temperature, clickTime, device=device):
         writeToLOG(f"Temperatura deseada modificada a: {temperature}°C")
 
 
-def toggleIrrigation():
-    """Envia la funcion para cambiar el estado del iriigador"""
-    if sendFunctionToClient("toggleIrrigation", ""):
-        writeToLOG(f"Se modifica el estado de la bomba de irrigación")
+def setIrrigation(state, clickTime=None, device=None):
+    """Envia el estado deseado (encendido/apagado) de la bomba de irrigación"""
+    if sendFunctionToClient("setIrrigation", 1 if state else 0, clickTime, device=device):
+        writeToLOG(f"Bomba de irrigación: {'encendida' if state else 'apagada'}")
+
+
+def toggleIrrigation(clickTime=None, device=None):
+    """Cambia el estado del irrigador a partir del ultimo estado confirmado,
+    el dispositivo solo recibe estados absolutos para que los reintentos sean seguros"""
+    session = findSession(device)
+    if session is None:
+        print("[Servidor de datos]: No hay cliente conectado, no se puede enviar setIrrigation")
+        return
+    state = deviceState.get(session.deviceId, {})
+    if "setIrrigation" not in state:
+        # Firmware sin estado en hello y sin comandos confirmados, se supone apagado
+        print(f"[Servidor de datos]: Estado de irrigación de {session.deviceId} desconocido, se supone apagado")
+    setIrrigation(not state.get("setIrrigation", 0), clickTime, session.deviceId)
+
+
+def setReportPolicy(channel, deadband, maxSilence, clickTime=None, device=None):
+    """Configura la banda muerta y el silencio maximo (s) con que el dispositivo reporta un canal"""
+    if channel not in REPORT_CHANNELS:
+        print(f"[Servidor de datos]: Canal desconocido: {channel}")
+        return
+    channelId = REPORT_CHANNELS[channel]
+    if sendBatchToClient([("setReportDeadband", deadband, channelId),
+                          ("setReportMaxSilence", maxSilence, channelId)], clickTime, device):
+        writeToLOG(f"Reporte de {channel}: banda muerta {deadband}, silencio máximo {maxSilence} s")
+
+
+def setTelemetryStream(stream, window=None, clickTime=None, device=None):
+    """Selecciona si el dispositivo envia muestras crudas, resumenes por ventana o ambos.
+    window es la duracion de la ventana de agregacion en segundos (opcional)"""
+    if stream not in TELEMETRY_STREAMS:
+        print(f"[Servidor de datos]: Flujo desconocido: {stream}")
+        return
+    operations = [("setAggregationWindow", window)] if window else []
+    operations.append(("setTelemetryStream", TELEMETRY_STREAMS[stream]))
+    if sendBatchToClient(operations, clickTime, device):
+        writeToLOG(f"Flujo de telemetria: {stream}" + (f", ventana de {window} s" if window else ""))
+
+
+def applyPreset(preset, clickTime=None, device=None):
+    """Aplica un modo de PRESETS en un solo lote, el dispositivo nunca queda a medio cambio"""
+    if preset not in PRESETS:
+        print(f"[Servidor de datos]: Modo desconocido: {preset}")
+        return
+    if sendBatchToClient(PRESETS[preset], clickTime, device):
+        writeToLOG(f"Modo {preset} aplicado")
+
 
+def acknowledgeJournalSegment(endJSON, device):
+    """Guarda un segmento del journal terminado y confirma al dispositivo que lo recibio para que lo borre"""
+    segment = endJSON['journalEnd']
+    stored = commitJournalSegment(endJSON, device)
+    print(f"[Servidor de datos]: Segmento {segment} del journal de {device} recibido ({endJSON.get('records', 0)} muestras, "
+          f"{stored} guardadas)")
+    sendFunctionToClient("ackJournalSegment", segment, device=device)
 
-def addNewIrrigationAlarm(alarmHour, alarmMinute):
-    global client_connection, client_address
-    if not client_connection:
+
+def addNewIrrigationAlarm(alarmHour, alarmMinute, device=None):
+    session = findSession(device)
+    if session is None:
         print("No hay cliente, imposible agregar una alarma")
         return
 
     threading.Thread(target=alarmThread,
                      daemon=True,
-                     args=(alarmHour, alarmMinute)).start()
+                     args=(alarmHour, alarmMinute, session.deviceId)).start()
     writeToLOG(f"Se ha programado una alarma para las {alarmHour}:{alarmMinute}")
 
 
-def alarmThread(alarmHour, alarmMinute):
+def alarmThread(alarmHour, alarmMinute, device):
     while True:
         currentTime = datetime.fromtimestamp(time.time()).astimezone()
         if currentTime.hour == alarmHour and currentTime.minute == alarmMinute:
             writeToLOG(f"Se ha lanzado la alarma de las {alarmHour}:{alarmHour}")
-            toggleIrrigation()
+            setIrrigation(True, device=device)
             startTime = time.time()
             while time.time() < startTime + IRRIGATION_TIME_S:
                 time.sleep(1)
-            toggleIrrigation()
+            setIrrigation(False, device=device)
             break
         time.sleep(1)
 
 
-def sendFunctionToClient(Function, Argument):
-    """Envia un JSON con la estructura funcion:argumento al microcontrolador"""
-    global client_connection, client_address
-    if not client_connection:
-        print(f"[Servidor de datos]: No hay cliente conectado, no se puede enviar {Function}")
-        return False
-
+def sendFunctionToClient(Function, Argument, clickTime=None, channel=None, device=None):
+    """Envia un JSON con la estructura id:timestamp:funcion:argumento[:canal] al microcontrolador
+    device (por defecto el ultimo conectado). Regresa el id del comando o None si no se pudo enviar"""
+    return _submitCommand({"function": Function, "argument": Argument, "channel": channel}, clickTime, device)
+
+
+def sendBatchToClient(operations, clickTime=None, device=None):
+    """Envia varias operaciones [(funcion, argumento[, canal]), ...] en un solo mensaje con un id.
+    El dispositivo las aplica todas antes de su siguiente ciclo de control (o ninguna si alguna es
+    invalida) y responde con un solo ack con el resultado de cada una
+    Regresa el id del lote o None si no se pudo enviar"""
+    if not operations or len(operations) > MAX_BATCH_OPERATIONS:
+        print(f"[Servidor de datos]: Lote de {len(operations)} operaciones no permitido")
+        return None
+    batch = [{"function": op[0], "argument": op[1], "channel": op[2] if len(op) > 2 else None}
+             for op in operations]
+    name = "lote(" + ", ".join(op["function"] for op in batch) + ")"
+    return _submitCommand({"function": name, "argument": None, "channel": None, "batch": batch}, clickTime, device)
+
+
+def _operationDict(operation):
+    """Campos de una operacion como los espera el dispositivo, channel solo si aplica"""
+    funcDict = {"function": operation["function"], "argument": operation["argument"]}
+    if operation["channel"] is not None:
+        funcDict["channel"] = operation["channel"]
+    return funcDict
+
+
+def _submitCommand(command, clickTime, device):
+    """Registra el comando como pendiente de confirmacion y lo envia. El dispositivo se fija
+    aqui para que los reintentos vayan al mismo aunque despues se conecte otro"""
+    session = findSession(device)
+    if session is None:
+        print(f"[Servidor de datos]: No hay cliente conectado, no se puede enviar {command['function']}")
+        return None
+
+    commandId = next(commandIds)
+    command.update({
+        "id": commandId,
+        "device": session.deviceId,
+        "clickTime": clickTime if clickTime is not None else time.time(),
+        "retries": 0,
+    })
+    with pendingLock:
+        pendingCommands[commandId] = command
+    if not _sendCommand(command):
+        with pendingLock:
+            pendingCommands.pop(commandId, None)
+        return None
+
+    recordLatency(CLICK_TO_SEND, (command["sendTime"] - command["clickTime"]) * 1000)
+    return commandId
+
+
+def _sendCommand(command):
+    """Entrega el comando a la sesion de su dispositivo (TCP o MQTT),
+    se usa tanto para el primer envio como para reintentos"""
     try:
-        funcDict = {"function": Function, "argument": Argument}
-        funcJSON = json.dumps(funcDict)
-        funcEncod = funcJSON.encode()
-        client_connection.sendall(funcEncod)
-        return True
+        command["sendTime"] = time.time()
+        funcDict = {
+            "id": command["id"],
+            "timestamp": int(command["sendTime"] * 1000),
+        }
+        if "batch" in command:
+            funcDict["batch"] = [_operationDict(op) for op in command["batch"]]
+        else:
+            funcDict.update(_operationDict(command))
+        session = findSession(command["device"])
+        if session is None:
+            return False
+        session.commands += 1
+        return session.sendCommand(funcDict)
 
     except Exception as e:
-        print(f"[Servidor de datos]: Error enviando función {Function}: {e}")
+        print(f"[Servidor de datos]: Error enviando función {command['function']}: {e}")
+        return False
+
+
+def handleAck(ackJSON):
+    """Procesa la confirmacion de un comando y registra sus latencias"""
+    ackTime = time.time()
+    with pendingLock:
+        command = pendingCommands.pop(ackJSON['ack'], None)
+    if command is None:
+        # Ack de un reintento que ya habia sido confirmado
+        return
+
+    state = deviceState.setdefault(command["device"], {})
+    if "batch" in command:
+        # Cada operacion trae su propio resultado, si el lote fue rechazado ninguna se aplico
+        for operation, result in zip(command["batch"], ackJSON.get('batch', [])):
+            if result.get('status') == 'ok':
+                state[operation['function']] = result.get('state')
+            else:
+                print(f"[Servidor de datos]: {operation['function']} del lote {command['id']}: {result.get('status')}")
+
+    status = ackJSON.get('status', 'ok')
+    if status != 'ok':
+        print(f"[Servidor de datos]: El dispositivo rechazó {command['function']}: {status}")
+        writeToLOG(f"Error aplicando {command['function']}: {status}")
+        return
+
+    if "batch" not in command:
+        state[command['function']] = ackJSON.get('state')
+    recordLatency(SEND_TO_ACK, (ackTime - command["sendTime"]) * 1000)
+    recordLatency(DEVICE_APPLY, ackJSON.get('applyTime_us', 0) / 1000)
+    recordLatency(CLICK_TO_ACK, (ackTime - command["clickTime"]) * 1000)
+
+
+def retryUnacknowledgedCommands():
+    """Hilo que reenvia los comandos sin confirmacion, todos los comandos son idempotentes"""
+    while True:
+        time.sleep(1)
+        now = time.time()
+        with pendingLock:
+            expired = [c for c in pendingCommands.values() if now - c["sendTime"] > ACK_TIMEOUT_S]
+        for command in expired:
+            if command["retries"] >= MAX_COMMAND_RETRIES or not clientAvailable(command["device"]):
+                with pendingLock:
+                    pendingCommands.pop(command["id"], None)
+                print(f"[Servidor de datos]: Sin confirmación de {command['device']} para {command['function']} (id {command['id']})")
+                writeToLOG(f"Sin confirmación de {command['device']} para {command['function']}")
+                continue
+            command["retries"] += 1
+            print(f"[Servidor de datos]: Reintentando {command['function']} (id {command['id']})")
+            _sendCommand(command)
+
+
+async def _serveDevices():
+    server = await asyncio.start_server(handleDevice, '0.0.0.0', DATA_PORT,
+                                        backlog=LISTEN_BACKLOG, reuse_address=True)
+    print(f"[Servidor de datos]: Escuchando en el puerto {DATA_PORT}...")
+    async with server:
+        await server.serve_forever()
 
 
 def startDataServer():
-    """Inicia el servidor TCP y espera conexiones entrantes."""
+    """Inicia el servidor TCP: un lazo de eventos en su propio hilo atiende a todos los dispositivos"""
     createDataDirectories()
     print("[Servidor de datos]: Iniciando...")
-    server_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-    server_socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
-    server_socket.bind(('0.0.0.0', 42069))
-    server_socket.listen(1)
-    print("[Servidor de datos]: Escuchando en el puerto 42069...")
-
-    connection_handler = threading.Thread(
-        target=handleClientConnection,
-        daemon=True,
-        args=(server_socket,)
-    )
-    connection_handler.start()
+    threading.Thread(target=asyncio.run, args=(_serveDevices(),), daemon=True).start()
+    threading.Thread(target=retryUnacknowledgedCommands, daemon=True).start()
+    startTextWriter()
+    startSeriesWriter()
+    startRollupWorker()
+    # La telemetria puede llegar por UDP, los comandos siguen por la conexion TCP
+    startUDPTelemetryServer()
 
 
 if __name__ == "__main__":
@@ -0,0 +1,103 @@
+# ## ###############################################
+#
+# deviceLogs.py
+# Indice por dispositivo de las lineas de log que envia el ESP32
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import os
+import re
+import threading
+import time
+from collections import deque, Counter
+from datetime import datetime
+from graphics import appendText
+
+DEVICE_LOGS_PATH_DIR = "Status/logs/"
+# Lineas recientes que se conservan en memoria por dispositivo para consultarlas desde la web
+INDEXED_LINES = 2000
+UNKNOWN_DEVICE = "desconocido"
+
+
+class DeviceLogIndex:
+    """Lineas recientes de un dispositivo con conteos por nivel y por tag"""
+
+    def __init__(self):
+        self.lines = deque(maxlen=INDEXED_LINES)
+        self.levels = Counter()
+        self.tags = Counter()
+        self.dropped = 0
+        self.suppressed = 0
+        self.lastSeen = None
+
+    def summary(self):
+        return {
+            "lines": sum(self.levels.values()),
+            "levels": dict(self.levels),
+            "tags": dict(self.tags),
+            "dropped": self.dropped,
+            "suppressed": self.suppressed,
+            "lastSeen": self.lastSeen,
+        }
+
+
+indexes = {}
+indexLock = threading.Lock()
+
+
+def deviceLogFile(device):
+    """Archivo de log del dispositivo, el id viene de la red asi que se limpia antes de usarlo"""
+    return os.path.join(DEVICE_LOGS_PATH_DIR, re.sub(r"[^A-Za-z0-9_-]", "_", device) + ".log")
+
+
+def storeDeviceLogs(logJSON):
+    """Guarda un lote de lineas [ms desde arranque, nivel, tag, mensaje] en el archivo del dispositivo
+    y en su indice. uptime es el reloj del dispositivo al enviar el lote"""
+    device = str(logJSON.get('device') or UNKNOWN_DEVICE)
+    now = time.time()
+    uptime = logJSON.get('uptime', 0)
+    lines = []
+    for timestamp, level, tag, message in logJSON.get('logs', []):
+        lineTime = now - max(uptime - timestamp, 0) / 1000
+        lines.append({
+            "time": datetime.fromtimestamp(lineTime).astimezone().isoformat(timespec='milliseconds'),
+            "level": level,
+            "tag": tag,
+            "message": message,
+        })
+    dropped = int(logJSON.get('dropped', 0))
+    suppressed = int(logJSON.get('suppressed', 0))
+
+    os.makedirs(DEVICE_LOGS_PATH_DIR, exist_ok=True)
+    text = "".join(f"{line['time']} {line['level']} {line['tag']}: {line['message']}\n" for line in lines)
+    if dropped or suppressed:
+        text += (f"{datetime.fromtimestamp(now).astimezone().isoformat(timespec='milliseconds')} "
+                 f"- {dropped} lineas perdidas, {suppressed} limitadas\n")
+    appendText(deviceLogFile(device), text)
+
+    with indexLock:
+        index = indexes.setdefault(device, DeviceLogIndex())
+        index.lines.extend(lines)
+        index.levels.update(line['level'] for line in lines)
+        index.tags.update(line['tag'] for line in lines)
+        index.dropped += dropped
+        index.suppressed += suppressed
+        index.lastSeen = datetime.fromtimestamp(now).astimezone().isoformat()
+
+
+def queryDeviceLogs(device=None, level=None, tag=None, limit=200):
+    """Regresa las ultimas lineas indexadas (de todos los dispositivos si device es None)
+    filtradas por nivel y tag, junto con el resumen de cada dispositivo"""
+    with indexLock:
+        devices = {name: index.summary() for name, index in indexes.items()}
+        selected = [device] if device else list(indexes)
+        lines = []
+        for name in selected:
+            if name not in indexes:
+                continue
+            lines.extend(dict(line, device=name) for line in indexes[name].lines
+                         if (not level or line['level'] == level) and (not tag or line['tag'] == tag))
+    lines.sort(key=lambda line: line['time'])
+    return {"devices": devices, "lines": lines[-limit:] if limit > 0 else []}
@@ -0,0 +1,102 @@
+# ## ###############################################
+#
+# deviceSessions.py
+# Registro de los dispositivos conectados (TCP o MQTT)
+# con su estado y su canal de comandos
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import threading
+import time
+from telemetryCodec import CompactTelemetryDecoder
+
+
+class DeviceSession:
+    """Estado de un dispositivo conectado: identidad, actividad, decodificador de tramas
+    compactas (tienen estado) y canal de comandos"""
+    transport = "?"
+
+    def __init__(self, deviceId, address):
+        self.deviceId = deviceId
+        self.address = address
+        self.connectedAt = time.time()
+        self.lastSeen = self.connectedAt
+        self.rxBytes = 0
+        self.messages = 0
+        self.commands = 0
+        self.decoder = CompactTelemetryDecoder()
+        self.closed = False
+
+    def touch(self, received=0, messages=0):
+        """Registra actividad del dispositivo"""
+        self.lastSeen = time.time()
+        self.rxBytes += received
+        self.messages += messages
+
+    def sendCommand(self, funcDict):
+        """Envia un comando (diccionario JSON) al dispositivo, regresa True si salio"""
+        raise NotImplementedError
+
+    def close(self):
+        """Termina la sesion, la llama el registro cuando otra sesion toma el mismo id"""
+        self.closed = True
+
+    def summary(self):
+        return {
+            "device": self.deviceId,
+            "transport": self.transport,
+            "address": str(self.address),
+            "connectedAt": self.connectedAt,
+            "lastSeen": self.lastSeen,
+            "rxBytes": self.rxBytes,
+            "messages": self.messages,
+            "commands": self.commands,
+        }
+
+
+# Sesiones por id de dispositivo, en orden de conexion (la ultima es el destino por defecto)
+sessions = {}
+sessionsLock = threading.Lock()
+
+
+def registerSession(session):
+    """Agrega la sesion; si el dispositivo ya tenia otra (se reconecto antes de que la vieja
+    expirara) la vieja se cierra"""
+    with sessionsLock:
+        previous = sessions.pop(session.deviceId, None)
+        sessions[session.deviceId] = session
+    if previous is not None and previous is not session:
+        previous.close()
+
+
+def renameSession(session, deviceId):
+    """Cambia el id provisional de una sesion (direccion) por el id que anuncia el dispositivo"""
+    if session.deviceId == deviceId:
+        return
+    with sessionsLock:
+        if sessions.get(session.deviceId) is session:
+            del sessions[session.deviceId]
+        session.deviceId = deviceId
+    registerSession(session)
+
+
+def unregisterSession(session):
+    """Quita la sesion si sigue registrada (una sesion nueva del mismo dispositivo no se toca)"""
+    with sessionsLock:
+        if sessions.get(session.deviceId) is session:
+            del sessions[session.deviceId]
+
+
+def findSession(device=None):
+    """Sesion del dispositivo, o la del ultimo dispositivo conectado si device es None"""
+    with sessionsLock:
+        if device is not None:
+            return sessions.get(device)
+        return next(reversed(sessions.values()), None)
+
+
+def sessionSummaries():
+    with sessionsLock:
+        return [session.summary() for session in sessions.values()]
@@ -0,0 +1,185 @@
+#! /usr/bin/env python3
+# ## ###############################################
+#
+# fleetSimulator.py
+# Flota simulada de dispositivos TCP para medir la capacidad
+# del servidor de datos (conexiones, mensajes por segundo, fallas)
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import argparse
+import asyncio
+import json
+import random
+import time
+import urllib.error
+import urllib.request
+
+DEFAULT_PORT = 42069
+REPORT_PERIOD_S = 5
+CONNECT_TIMEOUT_S = 10
+# Conexiones abiertas a la vez durante el arranque, como dispositivos encendiendo escalonados
+CONNECT_CONCURRENCY = 64
+
+
+class FleetStats:
+    def __init__(self):
+        self.connected = 0
+        self.failed = 0
+        self.dropped = 0
+        self.sent = 0
+        self.commands = {}
+
+
+def deviceName(index):
+    return f"sim-{index:04d}"
+
+
+def sensorsLine(rng):
+    """Mensaje de telemetria en el mismo formato que sendSensorsDataToServer"""
+    temperature = round(rng.uniform(18, 32), 2)
+    return {"sensors": [
+        {"sensor": "LM135", "temperature": temperature},
+        {"sensor": "AM2302", "temperature": round(temperature + rng.uniform(-0.5, 0.5), 2),
+         "humidity": round(rng.uniform(40, 80), 2)},
+    ]}
+
+
+def ackFor(command):
+    """Confirma un comando (individual o en lote) como lo hace el firmware"""
+    ack = {"ack": command["id"], "timestamp": int(time.time() * 1000), "status": "ok", "applyTime_us": 50}
+    if "batch" in command:
+        ack["batch"] = [{"function": op["function"], "status": "ok", "state": op["argument"]}
+                        for op in command["batch"]]
+    else:
+        ack["state"] = command.get("argument")
+    return ack
+
+
+async def receiveCommands(name, reader, writer, stats):
+    """Confirma los comandos que envia el servidor y los cuenta por dispositivo"""
+    while True:
+        line = await reader.readline()
+        if not line:
+            return
+        command = json.loads(line)
+        stats.commands.setdefault(name, []).append(command)
+        writer.write((json.dumps(ackFor(command)) + "\n").encode())
+
+
+async def simulateDevice(index, args, stats, gate, stop):
+    name = deviceName(index)
+    rng = random.Random(index)
+    async with gate:
+        try:
+            reader, writer = await asyncio.wait_for(asyncio.open_connection(args.host, args.port), CONNECT_TIMEOUT_S)
+        except (OSError, asyncio.TimeoutError):
+            stats.failed += 1
+            return
+    stats.connected += 1
+    receiver = asyncio.create_task(receiveCommands(name, reader, writer, stats))
+    period = 1.0 / args.rate
+    try:
+        writer.write((json.dumps({"hello": name, "uptime": 0, "state": {"setIrrigation": 0}}) + "\n").encode())
+        # Fase aleatoria para no enviar todos en el mismo instante
+        await asyncio.sleep(rng.uniform(0, period))
+        nextSend = time.monotonic()
+        while not stop.is_set():
+            writer.write((json.dumps(sensorsLine(rng)) + "\n").encode())
+            await writer.drain()
+            stats.sent += 1
+            nextSend += period
+            await asyncio.sleep(max(0.0, nextSend - time.monotonic()))
+            if receiver.done():
+                raise ConnectionResetError
+    except (OSError, ConnectionResetError):
+        stats.dropped += 1
+    finally:
+        receiver.cancel()
+        writer.close()
+        try:
+            await writer.wait_closed()
+        except OSError:
+            pass
+
+
+def webRequest(webUrl, path, body=None):
+    data = json.dumps(body).encode() if body is not None else None
+    req = urllib.request.Request(webUrl + path, data=data, headers={"Content-Type": "application/json"})
+    try:
+        with urllib.request.urlopen(req, timeout=5) as response:
+            return json.loads(response.read() or b"null")
+    except (urllib.error.URLError, ConnectionError, json.JSONDecodeError):
+        # El POST del servidor web no regresa cuerpo
+        return None
+
+
+async def checkRouting(args, stats):
+    """Envia una temperatura distinta a algunos dispositivos por id y verifica que cada uno
+    recibio solo la suya, y que /api/devices lista a toda la flota"""
+    loop = asyncio.get_running_loop()
+    devices = await loop.run_in_executor(None, webRequest, args.web, "/api/devices")
+    names = {d["device"] for d in devices or []}
+    missing = [deviceName(i) for i in range(args.devices) if deviceName(i) not in names]
+    print(f"[Flota]: /api/devices lista {len(names)} dispositivos, faltan {len(missing)}")
+
+    targets = random.Random(0).sample(range(args.devices), min(5, args.devices))
+    for index in targets:
+        body = {"action": "update_temperature", "targetTemp": 20 + index % 10, "device": deviceName(index)}
+        await loop.run_in_executor(None, webRequest, args.web, "/", body)
+    await asyncio.sleep(1)
+    wrong = 0
+    for index in targets:
+        received = stats.commands.get(deviceName(index), [])
+        if [c.get("argument") for c in received] != [20 + index % 10]:
+            wrong += 1
+    others = sum(len(c) for name, c in stats.commands.items()
+                 if name not in {deviceName(i) for i in targets})
+    print(f"[Flota]: Comandos por id: {len(targets) - wrong}/{len(targets)} correctos, "
+          f"{others} entregados a otros dispositivos")
+    return not missing and wrong == 0 and others == 0
+
+
+async def runFleet(args):
+    stats = FleetStats()
+    stop = asyncio.Event()
+    gate = asyncio.Semaphore(CONNECT_CONCURRENCY)
+    start = time.monotonic()
+    tasks = [asyncio.create_task(simulateDevice(i, args, stats, gate, stop)) for i in range(args.devices)]
+
+    routingOk = True
+    lastSent, lastTime = 0, start
+    checked = False
+    while time.monotonic() - start < args.duration:
+        await asyncio.sleep(REPORT_PERIOD_S)
+        now = time.monotonic()
+        print(f"[Flota]: {stats.connected}/{args.devices} conectados, {stats.failed} fallas, "
+              f"{stats.dropped} caidos, {(stats.sent - lastSent) / (now - lastTime):.0f} msg/s")
+        lastSent, lastTime = stats.sent, now
+        if args.web and not checked and stats.connected + stats.failed == args.devices:
+            checked = True
+            routingOk = await checkRouting(args, stats)
+
+    stop.set()
+    await asyncio.gather(*tasks)
+    elapsed = time.monotonic() - start
+    print(f"[Flota]: {stats.connected} conexiones, {stats.failed} fallas, {stats.dropped} caidas, "
+          f"{stats.sent} mensajes en {elapsed:.0f} s ({stats.sent / elapsed:.0f} msg/s en promedio)")
+    return stats.failed == 0 and stats.dropped == 0 and routingOk
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description="Simula una flota de dispositivos TCP (hello, telemetria JSON y acks) contra el servidor de datos.")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT)
+    parser.add_argument("--devices", type=int, default=200)
+    parser.add_argument("--rate", type=float, default=1.0, help="Mensajes por segundo por dispositivo")
+    parser.add_argument("--duration", type=float, default=60, help="Segundos")
+    parser.add_argument("--web", help="URL del servidor web (p. ej. http://127.0.0.1:8080) para verificar "
+                                      "/api/devices y el envio de comandos por id")
+    args = parser.parse_args()
+    ok = asyncio.run(runFleet(args))
+    raise SystemExit(0 if ok else 1)
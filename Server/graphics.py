@@ -1,116 +1,139 @@
 # graph_utils.py
-import matplotlib
-import matplotlib.pyplot as plt
-import matplotlib.dates as mdates
+import collections
+import queue
+import threading
 import time
 from datetime import datetime, timezone
 import os
-
-matplotlib.use('AGG')  # Usando el rasterizado a .png
+from sampleStore import appendSamples
+from seriesStore import persistSamples
+from rollupStore import accumulateRollups
 
 # Parámetros globales
-GRAPH_PERIOD_S = 80
-GRAPH_Y_MARGIN = 5
-LM135_GRAPH = "LT"
-AM2302T_GRAPH = "AT"
-AM2302H_GRAPH = "AH"
 MAIN_DIRECTORY_PATH_DIR = "Status"
-LM135_DATA_PATH_DIR = MAIN_DIRECTORY_PATH_DIR + "/LM135/"
-AM2302T_DATA_PATH_DIR = MAIN_DIRECTORY_PATH_DIR + "/AM2302T/"
-AM2302H_DATA_PATH_DIR = MAIN_DIRECTORY_PATH_DIR + "/AM2302H/"
 LOG_FILE_PATH = MAIN_DIRECTORY_PATH_DIR + "/actions.log"
-
-# Datos globales
-LM135Data = []
-AM2302TData = []
-AM2302HData = []
-timeData = []
-
-
-def graphMeasurements(data, graph_type):
-    global timeData
-    if graph_type == LM135_GRAPH:
-        mylabel = "Temperatura LM135"
-        units = "[°C]"
-        path = LM135_DATA_PATH_DIR
-    elif graph_type == AM2302T_GRAPH:
-        mylabel = "Temperatura AM2302"
-        units = "[°C]"
-        path = AM2302T_DATA_PATH_DIR
-    elif graph_type == AM2302H_GRAPH:
-        mylabel = "Humedad"
-        units = "[%]"
-        path = AM2302H_DATA_PATH_DIR
-    else:
-        mylabel = "?"
-        units = "?"
-
-    if len(data) == 0:
-        print(f"[Servidor de datos]: Datos vacíos para {mylabel}, no se generará gráfica.")
-        return
-
-    if len(data) != len(timeData):
-        print(f"[Servidor de datos]: Datos de {mylabel} no coinciden con datos de tiempo, no se generará gráfica.")
-        return
-
-    fig, ax = plt.subplots()
-    ax.plot(timeData, data, label=mylabel)
-
-    plt.ylim(min(data) - GRAPH_Y_MARGIN, max(data) + GRAPH_Y_MARGIN)
-    ax.xaxis.set_major_formatter(mdates.DateFormatter('%M:%S'))
-    ax.xaxis.set_major_locator(mdates.AutoDateLocator())
-
-    plt.title(f"Registro de: {mylabel} el {timeData[0].day}/{timeData[0].month}/{timeData[0].year} a las {timeData[0].hour} h")
-    plt.xlabel("Tiempo [min:seg]")
-    plt.ylabel(f"{mylabel} {units}")
-    plt.legend()
-    plt.tight_layout()
-
-    filename = f"{path}{mylabel}@{timeData[0].day}-{timeData[0].month}-{timeData[0].year}_{timeData[0].hour}:{timeData[0].minute}.png"
-    plt.savefig(filename)
-    plt.clf()
-    plt.close(fig)
-    print(f"[Servidor de datos]: Nueva gráfica disponible: {mylabel}")
-
-
-def storeData(receivedJSON):
-    """Guarda los datos recibidos del JSON en las listas globales."""
-    global LM135Data, AM2302TData, AM2302HData, timeData
-    sensors_data = receivedJSON['sensors']
-
-    for sensor in sensors_data:
+HISTORY_FILE_PATH = MAIN_DIRECTORY_PATH_DIR + "/history.csv"
+SUMMARY_FILE_PATH = MAIN_DIRECTORY_PATH_DIR + "/summaries.csv"
+JOURNAL_FLAG_UPTIME = 1
+SUMMARY_FLAG_UPTIME = 1
+# Dispositivo al que se atribuyen los datos cuando no se sabe quien los envio
+UNKNOWN_DEVICE = "desconocido"
+# Bloques del journal recibidos por (dispositivo, segmento) e indexados por offset: un reenvio reemplaza
+# al anterior y nada se guarda hasta que llega el fin del segmento
+journalChunks = {}
+# Segmentos ya guardados por (dispositivo, arranque, segmento, primer timestamp). Si el ack se pierde el
+# dispositivo reenvia el segmento, y los numeros de segmento se reusan cuando su journal queda vacio
+committedSegments = collections.OrderedDict()
+COMMITTED_SEGMENTS_MAX = 4096
+# Texto a agregar a los archivos CSV y de log; lo escribe un hilo aparte para no bloquear el lazo de eventos
+textQueue = queue.Queue()
+
+
+def appendText(path, text):
+    """Encola text para agregarlo al final de path; no toca el disco"""
+    textQueue.put((path, text))
+
+
+def textWriter():
+    """Hilo que escribe lo encolado, un append por archivo con todo lo que se junto mientras escribia"""
+    while True:
+        batch = [textQueue.get()]
+        while True:
+            try:
+                batch.append(textQueue.get_nowait())
+            except queue.Empty:
+                break
+        files = {}
+        for path, text in batch:
+            files.setdefault(path, []).append(text)
+        for path, texts in files.items():
+            try:
+                with open(path, "a", encoding="utf-8") as f:
+                    f.write("".join(texts))
+            except OSError as e:
+                print(f"[Servidor de datos]: Error escribiendo {path}: {e}")
+        for _ in batch:
+            textQueue.task_done()
+
+
+def startTextWriter():
+    threading.Thread(target=textWriter, daemon=True).start()
+
+
+def storeData(receivedJSON, sampleTime=None, device=UNKNOWN_DEVICE):
+    """Guarda los datos recibidos del JSON en las muestras recientes del dispositivo y en su serie
+    en disco. sampleTime es el timestamp de la muestra, por defecto el momento de recepcion"""
+    if sampleTime is None:
+        sampleTime = time.time()
+    values = {}
+    for sensor in receivedJSON['sensors']:
         name = sensor['sensor']
         if name == 'LM135':
-            LM135Data.append(sensor['temperature'])
+            values["LM135"] = sensor['temperature']
         elif name == 'AM2302':
-            AM2302TData.append(sensor['temperature'])
-            AM2302HData.append(sensor['humidity'])
-
-    timeData.append(datetime.fromtimestamp(time.time()).astimezone())
-
-
-def resetMeasurements():
-    """Reinicia todas las mediciones."""
-    global LM135Data, AM2302TData, AM2302HData, timeData
-    LM135Data.clear()
-    AM2302TData.clear()
-    AM2302HData.clear()
-    timeData.clear()
-
-
-def periodicGraphsUpdate():
-    """Hilo encargado de generar las gráficas de forma periódica."""
-    global LM135Data, AM2302TData, AM2302HData, timeData
-    resetMeasurements()
-    start = time.time()
-    while True:
-        if time.time() - start >= GRAPH_PERIOD_S:
-            start = time.time()
-            graphMeasurements(LM135Data, LM135_GRAPH)
-            graphMeasurements(AM2302TData, AM2302T_GRAPH)
-            graphMeasurements(AM2302HData, AM2302H_GRAPH)
-            resetMeasurements()
-        time.sleep(1)
+            values["AM2302T"] = sensor['temperature']
+            values["AM2302H"] = sensor['humidity']
+    appendSamples(device, int(sampleTime * 1e9), values)
+    persistSamples(device, int(sampleTime * 1e9), values)
+    accumulateRollups(device, int(sampleTime * 1e9), values)
+
+
+def storeJournalRecords(journalJSON, device=UNKNOWN_DEVICE):
+    """Recibe un bloque de las muestras que el dispositivo almaceno en flash sin conexion, se guardan
+    con commitJournalSegment. Cada registro es [timestamp, flags, LM135, AM2302T, AM2302H, arranque]
+    con valores en decimas (el firmware anterior no envia el arranque)"""
+    chunk = (time.time(), journalJSON.get('uptime', 0), journalJSON.get('boot'), journalJSON['records'])
+    journalChunks.setdefault((device, journalJSON['journal']), {})[journalJSON['offset']] = chunk
+
+
+def commitJournalSegment(endJSON, device=UNKNOWN_DEVICE):
+    """Guarda en el historico las muestras de un segmento terminado. Regresa cuantas se guardaron,
+    0 si el segmento ya se habia guardado"""
+    chunks = journalChunks.pop((device, endJSON['journalEnd']), {})
+    rows = []
+    for offset in sorted(chunks):
+        now, uptime, boot, records = chunks[offset]
+        for record in records:
+            timestamp, flags, lm135, am2302T, am2302H = record[:5]
+            recordBoot = record[5] if len(record) > 5 else boot
+            if not rows:
+                # El segmento se identifica con su primer registro tal como lo guardo el dispositivo
+                key = (device, recordBoot, endJSON['journalEnd'], timestamp)
+            if int(flags) & JOURNAL_FLAG_UPTIME:
+                # Reloj sin sincronizar: segundos desde el arranque, solo se pueden fechar los del
+                # arranque actual; los de arranques anteriores se guardan sin hora
+                timestamp = now - (uptime - timestamp) if recordBoot == boot else None
+            rows.append((timestamp, lm135 / 10, am2302T / 10, am2302H / 10))
+    if not rows or key in committedSegments:
+        return 0
+    committedSegments[key] = True
+    if len(committedSegments) > COMMITTED_SEGMENTS_MAX:
+        committedSegments.popitem(last=False)
+
+    lines = []
+    for timestamp, lm135, am2302T, am2302H in rows:
+        sampleTime = "" if timestamp is None else datetime.fromtimestamp(timestamp).astimezone().isoformat()
+        lines.append(f"{sampleTime},{lm135},{am2302T},{am2302H},{device}\n")
+        if timestamp is None:
+            continue
+        values = {"LM135": lm135, "AM2302T": am2302T, "AM2302H": am2302H}
+        persistSamples(device, int(timestamp * 1e9), values)
+        accumulateRollups(device, int(timestamp * 1e9), values)
+    appendText(HISTORY_FILE_PATH, "".join(lines))
+    return len(rows)
+
+
+def storeSummary(summaryJSON, device=UNKNOWN_DEVICE):
+    """Guarda el resumen de una ventana (n, media, minimo, maximo, desviacion) por canal.
+    Si el reloj del dispositivo no estaba sincronizado la ventana se fecha al recibirla"""
+    start = summaryJSON['start']
+    if int(summaryJSON.get('flags', 0)) & SUMMARY_FLAG_UPTIME:
+        start = time.time() - summaryJSON['window']
+    windowTime = datetime.fromtimestamp(start).astimezone().isoformat()
+    appendText(SUMMARY_FILE_PATH, "".join(
+        f"{windowTime},{summaryJSON['window']},{channel},"
+        f"{s['n']},{s['mean']},{s['min']},{s['max']},{s['std']},{device}\n"
+        for channel, s in summaryJSON['channels'].items()))
 
 
 def createDataDirectories():
@@ -121,24 +144,17 @@ def createDataDirectories():
         except PermissionError:
             print("[Servidor de datos]: Error de permisos al intentar crear archivos")
 
-    if not os.path.exists(LM135_DATA_PATH_DIR):
-        try:
-            os.mkdir(LM135_DATA_PATH_DIR)
-            print(f"[Servidor de datos]: Directorio '{LM135_DATA_PATH_DIR}' creado.")
-        except PermissionError:
-            print("[Servidor de datos]: Error de permisos al intentar crear archivos")
-
-    if not os.path.exists(AM2302T_DATA_PATH_DIR):
+    if not os.path.exists(HISTORY_FILE_PATH):
         try:
-            os.mkdir(AM2302T_DATA_PATH_DIR)
-            print(f"[Servidor de datos]: Directorio '{AM2302T_DATA_PATH_DIR}' creado.")
+            with open(HISTORY_FILE_PATH, "w") as f:
+                f.write("time,LM135,AM2302T,AM2302H,device\n")
         except PermissionError:
             print("[Servidor de datos]: Error de permisos al intentar crear archivos")
 
-    if not os.path.exists(AM2302H_DATA_PATH_DIR):
+    if not os.path.exists(SUMMARY_FILE_PATH):
         try:
-            os.mkdir(AM2302H_DATA_PATH_DIR)
-            print(f"[Servidor de datos]: Directorio '{AM2302H_DATA_PATH_DIR}' creado.")
+            with open(SUMMARY_FILE_PATH, "w") as f:
+                f.write("time,window,channel,n,mean,min,max,std,device\n")
         except PermissionError:
             print("[Servidor de datos]: Error de permisos al intentar crear archivos")
 
@@ -152,6 +168,5 @@ def createDataDirectories():
 
 def writeToLOG(LOGentry):
     serverTime = datetime.fromtimestamp(time.time()).astimezone()
-    with open(LOG_FILE_PATH, "a") as f:
-        f.write(LOGentry)
-        f.write(f' @ {serverTime.day}-{serverTime.month}-{serverTime.year} {serverTime.hour}:{serverTime.minute}\n')
\ No newline at end of file
+    appendText(LOG_FILE_PATH,
+               f'{LOGentry} @ {serverTime.day}-{serverTime.month}-{serverTime.year} {serverTime.hour}:{serverTime.minute}\n')
\ No newline at end of file
@@ -0,0 +1,70 @@
+# ## ###############################################
+#
+# latency.py
+# Histogramas de latencia de los comandos enviados al ESP32
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import threading
+
+# Limites superiores de cada cubeta en milisegundos (escala logaritmica)
+BUCKET_LIMITS_MS = [0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000]
+
+# Etapas medidas: click web -> envio TCP -> aplicacion en dispositivo -> ack
+CLICK_TO_SEND = "click_to_send"
+SEND_TO_ACK = "send_to_ack"
+DEVICE_APPLY = "device_apply"
+CLICK_TO_ACK = "click_to_ack"
+
+
+class LatencyHistogram:
+    """Histograma de latencias con cubetas fijas, seguro entre hilos."""
+
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._counts = [0] * (len(BUCKET_LIMITS_MS) + 1)
+        self._count = 0
+        self._sum = 0.0
+        self._max = 0.0
+
+    def record(self, latency_ms):
+        index = len(BUCKET_LIMITS_MS)
+        for i, limit in enumerate(BUCKET_LIMITS_MS):
+            if latency_ms <= limit:
+                index = i
+                break
+        with self._lock:
+            self._counts[index] += 1
+            self._count += 1
+            self._sum += latency_ms
+            self._max = max(self._max, latency_ms)
+
+    def snapshot(self):
+        with self._lock:
+            buckets = {f"<={limit}": c for limit, c in zip(BUCKET_LIMITS_MS, self._counts)}
+            buckets[f">{BUCKET_LIMITS_MS[-1]}"] = self._counts[-1]
+            return {
+                "count": self._count,
+                "mean_ms": self._sum / self._count if self._count else 0.0,
+                "max_ms": self._max,
+                "buckets": buckets,
+            }
+
+
+histograms = {
+    CLICK_TO_SEND: LatencyHistogram(),
+    SEND_TO_ACK: LatencyHistogram(),
+    DEVICE_APPLY: LatencyHistogram(),
+    CLICK_TO_ACK: LatencyHistogram(),
+}
+
+
+def recordLatency(stage, latency_ms):
+    histograms[stage].record(latency_ms)
+
+
+def latencySnapshot():
+    """Regresa un diccionario serializable con todos los histogramas."""
+    return {stage: h.snapshot() for stage, h in histograms.items()}
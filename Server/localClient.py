@@ -0,0 +1,109 @@
+#! /usr/bin/env python3
+# ## ###############################################
+#
+# localClient.py
+# Cliente de prueba del endpoint HTTP local del ESP32
+# (GET /status y POST /command), no requiere el servidor de datos
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import argparse
+import json
+import sys
+import time
+import urllib.error
+import urllib.request
+
+TIMEOUT_S = 2
+SNAPSHOT_KEYS = ("uptime_ms", "sensors", "setpoint", "bulb", "fan", "fanManual", "irrigation", "diag")
+
+
+def request(baseUrl, path, body=None):
+    """Regresa (codigo HTTP, JSON de respuesta, latencia en ms)"""
+    data = json.dumps(body).encode() if isinstance(body, dict) else body
+    req = urllib.request.Request(baseUrl + path, data=data,
+                                 headers={"Content-Type": "application/json"} if data else {})
+    start = time.perf_counter()
+    try:
+        with urllib.request.urlopen(req, timeout=TIMEOUT_S) as response:
+            code, payload = response.status, response.read()
+    except urllib.error.HTTPError as e:
+        code, payload = e.code, e.read()
+    latency = (time.perf_counter() - start) * 1000
+    try:
+        return code, json.loads(payload), latency
+    except json.JSONDecodeError:
+        return code, None, latency
+
+
+def sendCommand(baseUrl, function, argument, commandId, channel=None):
+    command = {"id": commandId, "timestamp": int(time.time() * 1000), "function": function, "argument": argument}
+    if channel is not None:
+        command["channel"] = channel
+    return request(baseUrl, "/command", command)
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p))]
+
+
+def testStatusLatency(baseUrl, reads):
+    latencies = []
+    for _ in range(reads):
+        code, snapshot, latency = request(baseUrl, "/status")
+        assert code == 200, f"GET /status regresó {code}"
+        missing = [k for k in SNAPSHOT_KEYS if k not in snapshot]
+        assert not missing, f"Faltan campos en el snapshot: {missing}"
+        latencies.append(latency)
+    print(f"[Cliente local]: GET /status x{reads}: p50 {percentile(latencies, 0.5):.1f} ms, "
+          f"p99 {percentile(latencies, 0.99):.1f} ms, max {max(latencies):.1f} ms")
+    return snapshot
+
+
+def testSetpointRoundTrip(baseUrl, snapshot):
+    original = snapshot["setpoint"]
+    target = original + 0.5
+    code, ack, latency = sendCommand(baseUrl, "setDesiredTemperature", target, 1)
+    assert code == 200 and ack["status"] == "ok", f"Comando rechazado: {code} {ack}"
+    assert ack["ack"] == 1 and abs(ack["state"] - target) < 0.01, f"Ack inesperado: {ack}"
+    _, updated, _ = request(baseUrl, "/status")
+    print(f"[Cliente local]: setDesiredTemperature confirmado en {latency:.1f} ms "
+          f"(aplicado en {ack['applyTime_us']} us)")
+    # El snapshot se genera al pedirlo, la espera solo cubre un firmware anterior que lo generaba con cada muestra
+    deadline = time.time() + 15
+    while abs(updated["setpoint"] - target) > 0.01 and time.time() < deadline:
+        time.sleep(0.5)
+        _, updated, _ = request(baseUrl, "/status")
+    assert abs(updated["setpoint"] - target) < 0.01, "El snapshot no refleja la nueva temperatura deseada"
+    sendCommand(baseUrl, "setDesiredTemperature", original, 2)
+
+
+def testRejectedCommands(baseUrl):
+    code, ack, _ = sendCommand(baseUrl, "functionThatDoesNotExist", 0, 3)
+    assert code == 404 and ack["status"] == "ESP_ERR_NOT_SUPPORTED", f"Función desconocida: {code} {ack}"
+    code, _, _ = request(baseUrl, "/command", b"{not json")
+    assert code == 400, f"JSON inválido regresó {code}"
+    code, ack, _ = sendCommand(baseUrl, "setReportDeadband", 0.5, 4, channel=99)
+    assert code == 400, f"Canal inválido regresó {code}"
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Pruebas de integración contra el endpoint local del ESP32")
+    parser.add_argument("device", help="IP[:puerto] del ESP32")
+    parser.add_argument("--reads", type=int, default=200, help="Lecturas para medir latencia")
+    parser.add_argument("--read-only", action="store_true", help="No enviar comandos")
+    args = parser.parse_args()
+    baseUrl = f"http://{args.device}"
+
+    try:
+        snapshot = testStatusLatency(baseUrl, args.reads)
+        if not args.read_only:
+            testSetpointRoundTrip(baseUrl, snapshot)
+            testRejectedCommands(baseUrl)
+    except (AssertionError, urllib.error.URLError, OSError) as e:
+        print(f"[Cliente local]: FALLA: {e}")
+        sys.exit(1)
+    print("[Cliente local]: Todas las pruebas pasaron")
@@ -8,10 +8,20 @@
 # License: MIT
 #
 # ## ###############################################
-
+import argparse
 from dataServer import startDataServer
 from webServer import startWebServer
 
 if __name__ == '__main__':
-    startDataServer()
-    startWebServer()
\ No newline at end of file
+    parser = argparse.ArgumentParser(description="Servidor del invernadero")
+    parser.add_argument("--mqtt", metavar="BROKER",
+                        help="Consumir datos de un broker MQTT en lugar de esperar la conexión TCP del ESP32")
+    parser.add_argument("--mqtt-port", type=int, default=1883)
+    args = parser.parse_args()
+
+    if args.mqtt:
+        from mqttServer import startMQTTServer
+        startMQTTServer(args.mqtt, args.mqtt_port)
+    else:
+        startDataServer()
+    startWebServer()
@@ -0,0 +1,103 @@
+#! /usr/bin/env python3
+# ## ###############################################
+#
+# malformedCommands.py
+# Servidor de datos de prueba que envia comandos mal formados
+# al ESP32 y verifica que cada uno se confirme con error
+# sin que la sesion se caiga
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import argparse
+import json
+import socket
+import sys
+import time
+from streamFramer import StreamFramer, FRAME_LINE
+
+DATA_PORT = 42069
+ACK_TIMEOUT_S = 5
+HELLO_TIMEOUT_S = 120
+
+# (descripcion, bytes enviados, id esperado en el ack, status esperado)
+# Un mensaje que no se puede interpretar se confirma con id 0 y sin funcion
+CASES = (
+    ("Texto que no es JSON", b"esto no es un comando\n", 0, "ESP_ERR_INVALID_ARG"),
+    ("JSON truncado", b'{"id": 11, "timestamp": 0, "function": "setIrrig\n', 0, "ESP_ERR_INVALID_ARG"),
+    ("Bytes arbitrarios", bytes(range(1, 10)) + bytes(range(0x80, 0xc0)) + b"\n", 0, "ESP_ERR_INVALID_ARG"),
+    ("Lote vacio", b'{"id": 12, "timestamp": 0, "batch": []}\n', 12, "ESP_ERR_INVALID_SIZE"),
+    # Argumentos que no caben en el entero al que se convierten (cJSON lee 1e999 como inf)
+    ("Ventana infinita", b'{"id": 14, "timestamp": 0, "function": "setAggregationWindow", "argument": 1e999}\n',
+     14, "ESP_ERR_INVALID_ARG"),
+    ("Flujo fuera de rango", b'{"id": 15, "timestamp": 0, "function": "setTelemetryStream", "argument": 257}\n',
+     15, "ESP_ERR_INVALID_ARG"),
+    # Al final un comando valido (sin efecto) demuestra que la sesion y el parser siguen en pie
+    ("Funcion desconocida", b'{"id": 13, "timestamp": 0, "function": "functionThatDoesNotExist", "argument": 0}\n',
+     13, "ESP_ERR_NOT_SUPPORTED"),
+)
+
+
+def readJSON(conn, framer, timeout, predicate):
+    """Regresa la primera linea JSON que cumple predicate, ignorando telemetria y tramas compactas"""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        conn.settimeout(max(0.1, deadline - time.time()))
+        try:
+            data = conn.recv(4096)
+        except socket.timeout:
+            break
+        if not data:
+            raise ConnectionError("El dispositivo cerro la sesion")
+        for kind, frame in framer.feed(data):
+            if kind != FRAME_LINE:
+                continue
+            try:
+                message = json.loads(frame)
+            except ValueError:
+                continue
+            if predicate(message):
+                return message
+    return None
+
+
+def runCases(conn):
+    framer = StreamFramer()
+    hello = readJSON(conn, framer, HELLO_TIMEOUT_S, lambda m: 'hello' in m)
+    assert hello is not None, "El dispositivo no envio hello"
+    print(f"[Comandos mal formados]: Sesion con {hello['hello']}")
+    for description, payload, expectedId, expectedStatus in CASES:
+        conn.sendall(payload)
+        ack = readJSON(conn, framer, ACK_TIMEOUT_S, lambda m: 'ack' in m)
+        assert ack is not None, f"{description}: sin ack"
+        assert ack['ack'] == expectedId and ack['status'] == expectedStatus, f"{description}: ack inesperado {ack}"
+        try:
+            function = json.loads(payload).get('function', "")
+        except ValueError:
+            function = ""
+        assert ack.get('function', "") == function, f"{description}: funcion basura {ack}"
+        print(f"[Comandos mal formados]: {description}: {ack['status']}")
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description="Reemplaza al servidor de datos (detenerlo antes) y envia comandos mal formados al ESP32")
+    parser.add_argument("--port", type=int, default=DATA_PORT)
+    args = parser.parse_args()
+
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(('0.0.0.0', args.port))
+    server.listen(1)
+    print(f"[Comandos mal formados]: Esperando al dispositivo en el puerto {args.port}...")
+    conn, address = server.accept()
+    try:
+        runCases(conn)
+    except (AssertionError, ConnectionError, OSError) as e:
+        print(f"[Comandos mal formados]: FALLA: {e}")
+        sys.exit(1)
+    finally:
+        conn.close()
+        server.close()
+    print("[Comandos mal formados]: Todos los mensajes se confirmaron con error y la sesion sigue activa")
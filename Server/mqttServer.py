@@ -0,0 +1,115 @@
+# ## ###############################################
+#
+# mqttServer.py
+# Consumidor de datos del ESP32 a traves de un broker MQTT
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import json
+import threading
+import paho.mqtt.client as mqtt
+import dataServer
+from dataServer import processJSONMessage, storeCompactFrame
+from deviceSessions import DeviceSession, registerSession, unregisterSession, findSession
+from telemetryCodec import FRAME_MAGIC, FRAME_HEADER_LEN
+from graphics import createDataDirectories, startTextWriter
+from seriesStore import startSeriesWriter
+from rollupStore import startRollupWorker
+
+# Topicos definidos en components/MQTTLink/MQTTLink.h: greenhouse/<zona>/<dispositivo>/<tipo>
+TOPIC_ROOT = "greenhouse"
+DEVICE_TOPICS = ("telemetry", "ack", "journal", "log", "status")
+COMMAND_QOS = 1
+STATUS_ONLINE = "online"
+
+mqttClient = None
+
+
+class MQTTDeviceSession(DeviceSession):
+    """Dispositivo en linea en el broker, los comandos se publican en su topico cmd"""
+    transport = "mqtt"
+
+    def __init__(self, zone, device):
+        super().__init__(device, zone)
+        self.zone = zone
+
+    def sendCommand(self, funcDict):
+        if self.closed or mqttClient is None:
+            return False
+        result = mqttClient.publish(f"{TOPIC_ROOT}/{self.zone}/{self.deviceId}/cmd", json.dumps(funcDict), qos=COMMAND_QOS)
+        return result.rc == mqtt.MQTT_ERR_SUCCESS
+
+
+def deviceSession(zone, device):
+    """Sesion del dispositivo; los mensajes que llegan antes de su estado 'online' (retenidos,
+    o de un servidor reiniciado) tambien abren sesion"""
+    session = findSession(device)
+    if session is None or session.transport != MQTTDeviceSession.transport:
+        session = MQTTDeviceSession(zone, device)
+        registerSession(session)
+    return session
+
+
+def onConnect(client, userdata, flags, reasonCode, properties):
+    if reasonCode.is_failure:
+        print(f"[Servidor MQTT]: Conexión rechazada por el broker: {reasonCode}")
+        return
+    print("[Servidor MQTT]: Conectado al broker")
+    for leaf in DEVICE_TOPICS:
+        client.subscribe(f"{TOPIC_ROOT}/+/+/{leaf}", qos=1)
+
+
+def onMessage(client, userdata, message):
+    """Despacha un mensaje del dispositivo segun el ultimo nivel del topico"""
+    parts = message.topic.split("/")
+    if len(parts) != 4 or parts[0] != TOPIC_ROOT or parts[3] not in DEVICE_TOPICS:
+        return
+    _, zone, device, leaf = parts
+    payload = message.payload
+
+    if leaf == "status":
+        updateDeviceStatus(zone, device, payload.decode(errors="replace"))
+        return
+    if not payload:
+        return
+    session = deviceSession(zone, device)
+    session.touch(len(payload), 1)
+    if leaf == "telemetry" and payload[0] == FRAME_MAGIC:
+        length = int.from_bytes(payload[1:FRAME_HEADER_LEN], 'little')
+        if len(payload) != FRAME_HEADER_LEN + length:
+            print(f"[Servidor MQTT]: Trama de {device} con longitud inválida")
+            return
+        storeCompactFrame(session, payload[FRAME_HEADER_LEN:])
+    else:
+        processJSONMessage(payload, session)
+
+
+def updateDeviceStatus(zone, device, status):
+    """El estado es retenido y 'offline' es el last will, asi se sabe a quien enviar comandos"""
+    if status == STATUS_ONLINE:
+        print(f"[Servidor MQTT]: Dispositivo {device} en línea (zona {zone})")
+        # Una sesion nueva empieza con keyframe, reemplaza a la anterior del mismo dispositivo
+        registerSession(MQTTDeviceSession(zone, device))
+    else:
+        print(f"[Servidor MQTT]: Dispositivo {device} fuera de línea (zona {zone})")
+        session = findSession(device)
+        if session is not None and session.transport == MQTTDeviceSession.transport:
+            unregisterSession(session)
+
+
+def startMQTTServer(broker, port=1883):
+    """Se conecta al broker y consume los datos de todos los dispositivos en segundo plano"""
+    global mqttClient
+    createDataDirectories()
+    print(f"[Servidor MQTT]: Conectando a {broker}:{port}...")
+    mqttClient = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2, client_id="greenhouse-server")
+    mqttClient.on_connect = onConnect
+    mqttClient.on_message = onMessage
+    mqttClient.connect_async(broker, port)
+    mqttClient.loop_start()
+    threading.Thread(target=dataServer.retryUnacknowledgedCommands, daemon=True).start()
+    startTextWriter()
+    startSeriesWriter()
+    startRollupWorker()
@@ -0,0 +1,65 @@
+#! /usr/bin/env python3
+# ## ###############################################
+#
+# networkFlood.py
+# Inundacion de red sintetica hacia el ESP32 para medir
+# el aislamiento del nucleo de control (jitter del cruce por cero)
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import argparse
+import os
+import socket
+import time
+
+# Puerto sin servicio en el dispositivo: lwIP procesa cada datagrama y responde ICMP
+DEFAULT_PORT = 9
+REPORT_PERIOD_S = 5
+
+
+def flood(deviceIp, port, rate, size, duration):
+    """Envia datagramas UDP al dispositivo a una tasa fija (0 = tan rapido como sea posible)"""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    payload = os.urandom(size)
+    period = 1.0 / rate if rate > 0 else 0.0
+    start = time.time()
+    nextSend = start
+    nextReport = start + REPORT_PERIOD_S
+    sent = 0
+    errors = 0
+    while time.time() - start < duration:
+        try:
+            sock.sendto(payload, (deviceIp, port))
+            sent += 1
+        except OSError:
+            errors += 1
+        if period:
+            nextSend += period
+            delay = nextSend - time.time()
+            if delay > 0:
+                time.sleep(delay)
+        now = time.time()
+        if now >= nextReport:
+            print(f"[Inundacion]: {sent} paquetes ({sent / (now - start):.0f} pps, "
+                  f"{sent * size * 8 / (now - start) / 1e6:.2f} Mbit/s), {errors} errores")
+            nextReport += REPORT_PERIOD_S
+    sock.close()
+    return sent, errors
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description="Inunda al ESP32 con UDP. Comparar el log 'Cruce por cero' del dispositivo "
+                    "(jitter y latencia de disparo del TRIAC) en reposo y durante la inundacion.")
+    parser.add_argument("device", help="IP del ESP32")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT)
+    parser.add_argument("--rate", type=int, default=2000, help="Paquetes por segundo, 0 sin limite")
+    parser.add_argument("--size", type=int, default=1024, help="Bytes por paquete")
+    parser.add_argument("--duration", type=float, default=60, help="Segundos")
+    args = parser.parse_args()
+
+    print(f"[Inundacion]: {args.device}:{args.port}, {args.rate} pps de {args.size} B por {args.duration} s")
+    sent, errors = flood(args.device, args.port, args.rate, args.size, args.duration)
+    print(f"[Inundacion]: Terminada, {sent} paquetes enviados, {errors} errores")
@@ -0,0 +1,246 @@
+# ## ###############################################
+#
+# rollupStore.py
+# Agregados por minuto y por hora (min/max/promedio/muestras)
+# calculados durante la ingesta, con retencion por nivel y
+# compactacion en segundo plano
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import os
+import re
+import threading
+import time
+import numpy as np
+from seriesStore import SEGMENT_SPAN_NS, SEAL_GRACE_NS, querySeries, expiredDays, expireDay
+
+ROLLUPS_PATH_DIR = "Status/rollups/"
+# Niveles del mas fino al mas grueso: nombre, ancho del intervalo, lo que cubre cada archivo y cuanto
+# se conserva (None para siempre). Un canal a 2 s ocupa ~40 KB/dia por minuto y ~0.7 KB/dia por hora
+MINUTE_NS = 60 * 10**9
+HOUR_NS = 3600 * 10**9
+TIERS = (
+    ("1m", MINUTE_NS, SEGMENT_SPAN_NS, 180 * 86400 * 10**9),
+    ("1h", HOUR_NS, 30 * SEGMENT_SPAN_NS, None),
+)
+# Los registros parciales de cada lote se agregan a un .rol; cuando el periodo del archivo termina
+# se compacta en un .rlc con un registro por intervalo (y las muestras atrasadas que lleguen despues
+# van a un .rol nuevo que se mezcla en la siguiente compactacion)
+PARTIAL_EXTENSION = ".rol"
+COMPACT_EXTENSION = ".rlc"
+FLUSH_PERIOD_S = 10
+MAINTENANCE_PERIOD_S = 600
+
+ROLLUP = np.dtype([('time', '<i8'), ('min', '<f4'), ('max', '<f4'), ('sum', '<f8'), ('count', '<u4')])
+
+pending = {}
+pendingLock = threading.Lock()
+# Escritura, compactacion, borrado y la lectura de los archivos de una consulta
+rollupLock = threading.Lock()
+
+
+def _rollupDir(tier, device, channel):
+    return os.path.join(ROLLUPS_PATH_DIR, tier, re.sub(r"[^A-Za-z0-9_-]", "_", device), channel)
+
+
+def accumulateRollups(device, time_ns, values):
+    """Encola {canal: valor} del dispositivo para el siguiente lote de agregados; no toca el disco"""
+    with pendingLock:
+        for channel, value in values.items():
+            pending.setdefault((device, channel), []).append((time_ns, value))
+
+
+def aggregate(times, values, width_ns):
+    """Registros ROLLUP de las muestras en intervalos de width_ns (los NaN no cuentan)"""
+    valid = ~np.isnan(values)
+    times, values = times[valid], values[valid].astype(np.float64)
+    if len(times) == 0:
+        return np.empty(0, ROLLUP)
+    buckets = times // width_ns * width_ns
+    order = np.argsort(buckets, kind='stable')
+    buckets, values = buckets[order], values[order]
+    starts = np.flatnonzero(np.r_[True, buckets[1:] != buckets[:-1]])
+    records = np.empty(len(starts), ROLLUP)
+    records['time'] = buckets[starts]
+    records['min'] = np.minimum.reduceat(values, starts)
+    records['max'] = np.maximum.reduceat(values, starts)
+    records['sum'] = np.add.reduceat(values, starts)
+    records['count'] = np.diff(np.r_[starts, len(values)])
+    return records
+
+
+def merge(records):
+    """Junta los registros parciales del mismo intervalo, regresa uno por intervalo en orden"""
+    if len(records) == 0:
+        return records
+    records = records[np.argsort(records['time'], kind='stable')]
+    starts = np.flatnonzero(np.r_[True, records['time'][1:] != records['time'][:-1]])
+    if len(starts) == len(records):
+        return records
+    merged = np.empty(len(starts), ROLLUP)
+    merged['time'] = records['time'][starts]
+    merged['min'] = np.minimum.reduceat(records['min'], starts)
+    merged['max'] = np.maximum.reduceat(records['max'], starts)
+    merged['sum'] = np.add.reduceat(records['sum'], starts)
+    merged['count'] = np.add.reduceat(records['count'], starts)
+    return merged
+
+
+def _appendRecords(tier, width, span, device, channel, times, values):
+    records = aggregate(times, values, width)
+    if len(records) == 0:
+        return
+    directory = _rollupDir(tier, device, channel)
+    os.makedirs(directory, exist_ok=True)
+    files = records['time'] // span
+    for spanIndex in np.unique(files):
+        path = os.path.join(directory, f"{spanIndex * span}{PARTIAL_EXTENSION}")
+        with open(path, "ab") as f:
+            # Un registro a medias de una caida se descarta
+            size = f.tell()
+            if size % ROLLUP.itemsize:
+                f.truncate(size - size % ROLLUP.itemsize)
+            f.write(records[files == spanIndex].tobytes())
+
+
+def flushPending():
+    """Agrega lo encolado a cada nivel: un registro parcial por intervalo tocado en este lote"""
+    global pending
+    with pendingLock:
+        batch, pending = pending, {}
+    with rollupLock:
+        for (device, channel), samples in batch.items():
+            times = np.array([s[0] for s in samples], np.int64)
+            values = np.array([s[1] for s in samples], np.float64)
+            for tier, width, span, _ in TIERS:
+                _appendRecords(tier, width, span, device, channel, times, values)
+    return sum(len(samples) for samples in batch.values())
+
+
+def _spanFiles(tier, device, channel):
+    """{inicio: [extensiones]} de los archivos del nivel"""
+    try:
+        names = os.listdir(_rollupDir(tier, device, channel))
+    except FileNotFoundError:
+        return {}
+    files = {}
+    for name in names:
+        stem, extension = os.path.splitext(name)
+        if extension in (PARTIAL_EXTENSION, COMPACT_EXTENSION):
+            files.setdefault(int(stem), []).append(extension)
+    return files
+
+
+def queryRollups(tier, device, channel, start_ns, end_ns):
+    """Registros ROLLUP del nivel con intervalo en [start_ns, end_ns], uno por intervalo y en orden,
+    incluyendo lo que sigue en la cola"""
+    width, span = next((t[1], t[2]) for t in TIERS if t[0] == tier)
+    directory = _rollupDir(tier, device, channel)
+    parts = []
+    with rollupLock:
+        for spanStart, extensions in _spanFiles(tier, device, channel).items():
+            if spanStart + span <= start_ns or spanStart > end_ns:
+                continue
+            for extension in extensions:
+                parts.append(np.fromfile(os.path.join(directory, f"{spanStart}{extension}"), ROLLUP))
+    with pendingLock:
+        samples = list(pending.get((device, channel), ()))
+    if samples:
+        parts.append(aggregate(np.array([s[0] for s in samples], np.int64),
+                               np.array([s[1] for s in samples], np.float64), width))
+    if not parts:
+        return np.empty(0, ROLLUP)
+    records = np.concatenate(parts)
+    return merge(records[(records['time'] >= start_ns) & (records['time'] <= end_ns)])
+
+
+def compactRollups(now_ns=None):
+    """Compacta los archivos cuyo periodo termino hace mas de SEAL_GRACE_NS. Regresa cuantos"""
+    now_ns = time.time_ns() if now_ns is None else now_ns
+    compacted = 0
+    for tier, _, span, _ in TIERS:
+        for root, _, files in os.walk(os.path.join(ROLLUPS_PATH_DIR, tier)):
+            for name in files:
+                stem, extension = os.path.splitext(name)
+                if extension == PARTIAL_EXTENSION and int(stem) + span + SEAL_GRACE_NS <= now_ns:
+                    compacted += _compactFile(os.path.join(root, stem))
+    return compacted
+
+
+def _compactFile(stem):
+    """Mezcla el .rol (y el .rlc si ya habia) fuera del candado; si llegaron registros mientras tanto
+    se deja para la siguiente ronda"""
+    partialPath, compactPath = stem + PARTIAL_EXTENSION, stem + COMPACT_EXTENSION
+    with rollupLock:
+        size = os.path.getsize(partialPath)
+        records = np.fromfile(partialPath, ROLLUP)
+        if os.path.exists(compactPath):
+            records = np.concatenate((np.fromfile(compactPath, ROLLUP), records))
+    merged = merge(records)
+    with rollupLock:
+        if os.path.getsize(partialPath) != size:
+            return 0
+        with open(compactPath + ".tmp", "wb") as f:
+            f.write(merged.tobytes())
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(compactPath + ".tmp", compactPath)
+        os.remove(partialPath)
+    return 1
+
+
+def expireRollups(now_ns=None):
+    """Borra los archivos de cada nivel que salieron de su retencion. Regresa cuantos"""
+    now_ns = time.time_ns() if now_ns is None else now_ns
+    removed = 0
+    for tier, _, span, retention in TIERS:
+        if retention is None:
+            continue
+        for root, _, files in os.walk(os.path.join(ROLLUPS_PATH_DIR, tier)):
+            for name in files:
+                stem, extension = os.path.splitext(name)
+                if extension in (PARTIAL_EXTENSION, COMPACT_EXTENSION) and \
+                        int(stem) + span + retention <= now_ns:
+                    with rollupLock:
+                        os.remove(os.path.join(root, name))
+                    removed += 1
+    return removed
+
+
+def expireRaw(now_ns=None):
+    """Borra los dias de muestras crudas fuera de retencion. Si un dia no tiene agregados (se guardo
+    antes de que existieran) primero se calculan de las muestras. Regresa cuantos dias"""
+    expired = 0
+    for device, channel, dayStart in expiredDays(now_ns):
+        finest = TIERS[0]
+        if not _spanFiles(finest[0], device, channel).get(dayStart // finest[2] * finest[2]):
+            times, values = querySeries(device, channel, dayStart, dayStart + SEGMENT_SPAN_NS - 1)
+            with rollupLock:
+                for tier, width, span, _ in TIERS:
+                    _appendRecords(tier, width, span, device, channel, times, values)
+        expireDay(device, channel, dayStart)
+        expired += 1
+    return expired
+
+
+def periodicRollups():
+    """Hilo que escribe los agregados y cada MAINTENANCE_PERIOD_S compacta y aplica la retencion"""
+    lastMaintenance = 0
+    while True:
+        time.sleep(FLUSH_PERIOD_S)
+        try:
+            flushPending()
+            if time.monotonic() - lastMaintenance >= MAINTENANCE_PERIOD_S:
+                lastMaintenance = time.monotonic()
+                compacted, expired, rawDays = compactRollups(), expireRollups(), expireRaw()
+                if compacted or expired or rawDays:
+                    print(f"[Servidor de datos]: Agregados: {compacted} compactados, {expired} expirados, "
+                          f"{rawDays} dias crudos expirados")
+        except OSError as e:
+            print(f"[Servidor de datos]: Error escribiendo agregados: {e}")
+
+
+def startRollupWorker():
+    threading.Thread(target=periodicRollups, daemon=True).start()
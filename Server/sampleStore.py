@@ -0,0 +1,112 @@
+# ## ###############################################
+#
+# sampleStore.py
+# Muestras recientes en memoria: un buffer circular de NumPy
+# por dispositivo y por canal con tiempos en ns
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import threading
+import numpy as np
+from telemetryCodec import CHANNELS
+
+# Muestras por canal y dispositivo (una hora a 1 Hz), ~130 KB por dispositivo
+RING_CAPACITY = 3600
+
+
+class ChannelRing:
+    """Buffer circular preasignado de un canal: tiempos (ns desde epoch, int64) y valores (float32).
+    Un solo escritor a la vez; los lectores no toman candados: copian y descartan lo que el
+    escritor haya sobreescrito durante la copia"""
+
+    def __init__(self, capacity=RING_CAPACITY):
+        self.capacity = capacity
+        self.times = np.zeros(capacity, dtype=np.int64)
+        self.values = np.zeros(capacity, dtype=np.float32)
+        # Muestras escritas desde el inicio: claimed se incrementa antes de escribir una muestra y
+        # written despues (la publica), los lectores solo leen hasta written
+        self.claimed = 0
+        self.written = 0
+
+    def append(self, time_ns, value):
+        i = self.written % self.capacity
+        self.claimed += 1
+        self.times[i] = time_ns
+        self.values[i] = value
+        self.written += 1
+
+    def snapshot(self, after=0):
+        """Copia de las muestras con numero >= after que siguen en el buffer, de la mas vieja a la
+        mas nueva. Regresa (tiempos, valores, numero de la siguiente muestra) para leer solo lo
+        nuevo en la siguiente llamada"""
+        end = self.written
+        start = max(after, end - self.capacity, 0)
+        if start >= end:
+            return np.empty(0, np.int64), np.empty(0, np.float32), end
+        first, last = start % self.capacity, end % self.capacity
+        if first < last:
+            times, values = self.times[first:last].copy(), self.values[first:last].copy()
+        else:
+            times = np.concatenate((self.times[first:], self.times[:last]))
+            values = np.concatenate((self.values[first:], self.values[:last]))
+        # Lo que el escritor escribio (o esta escribiendo) mientras se copiaba pisa a las mas viejas
+        overwritten = self.claimed - self.capacity - start
+        if overwritten > 0:
+            times, values = times[overwritten:], values[overwritten:]
+        return times, values, end
+
+
+class DeviceSamples:
+    """Buffers de los canales de un dispositivo. Cada canal lleva sus propios tiempos, asi que un
+    sensor que falta no desalinea a los demas"""
+
+    def __init__(self, capacity=RING_CAPACITY):
+        self.channels = {channel: ChannelRing(capacity) for channel in CHANNELS}
+        # Solo serializa escritores (normalmente hay uno por dispositivo), los lectores no lo toman
+        self.writeLock = threading.Lock()
+
+    def append(self, time_ns, values):
+        """Agrega {canal: valor} con el mismo tiempo"""
+        with self.writeLock:
+            for channel, value in values.items():
+                ring = self.channels.get(channel)
+                if ring is not None:
+                    ring.append(time_ns, value)
+
+    def snapshot(self, cursors=None):
+        """Regresa {canal: (tiempos, valores)} y los cursores para leer solo lo nuevo la siguiente vez"""
+        cursors = cursors or {}
+        series = {}
+        nextCursors = {}
+        for channel, ring in self.channels.items():
+            times, values, nextCursors[channel] = ring.snapshot(cursors.get(channel, 0))
+            series[channel] = (times, values)
+        return series, nextCursors
+
+
+stores = {}
+# Solo protege la creacion de dispositivos nuevos
+storesLock = threading.Lock()
+
+
+def appendSamples(device, time_ns, values):
+    """Agrega {canal: valor} del dispositivo con tiempo time_ns (ns desde epoch)"""
+    store = stores.get(device)
+    if store is None:
+        with storesLock:
+            store = stores.setdefault(device, DeviceSamples())
+    store.append(time_ns, values)
+
+
+def deviceSnapshot(device, cursors=None):
+    """Copia de las muestras recientes del dispositivo, ({}, {}) si no hay"""
+    store = stores.get(device)
+    if store is None:
+        return {}, {}
+    return store.snapshot(cursors)
+
+
+def storedDevices():
+    return list(stores)
@@ -0,0 +1,173 @@
+# ## ###############################################
+#
+# seriesCodec.py
+# Formato comprimido de los segmentos sellados: delta de deltas
+# para los tiempos, deltas de valores en punto fijo, empaquetado
+# por bloques con excepciones y decodificacion vectorizada
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import numpy as np
+
+MAGIC = b"GRS1"
+# Muestras por bloque, una consulta solo descomprime los bloques que toca
+BLOCK_SAMPLES = 1024
+# Resolucion de lo que se guarda: el tiempo en la unidad de las tramas compactas (100 ms) y los
+# valores a centesimas (los sensores resuelven decimas)
+TIME_UNIT_NS = 100_000_000
+VALUE_SCALE = 100.0
+NAN_VALUE = np.iinfo(np.int32).min
+# Bits que cuesta una excepcion (indice u16 + valor u64)
+EXCEPTION_BITS = 80
+
+HEADER = np.dtype([('magic', 'S4'), ('blocks', '<u4')])
+BLOCK_INDEX = np.dtype([('first', '<i8'), ('last', '<i8'), ('offset', '<u8'), ('count', '<u4'), ('length', '<u4')])
+BLOCK_HEADER = np.dtype([('time0', '<i8'), ('delta0', '<i8'), ('value0', '<i4')])
+STREAM_HEADER = np.dtype([('width', 'u1'), ('exceptions', '<u2')])
+_SHIFTS = np.arange(64, dtype=np.uint64)
+
+
+class CodecError(Exception):
+    pass
+
+
+def _zigZag(values):
+    return ((values << 1) ^ (values >> 63)).astype(np.uint64)
+
+
+def _unZigZag(values):
+    return (values >> np.uint64(1)).astype(np.int64) ^ -(values & np.uint64(1)).astype(np.int64)
+
+
+def _encodeStream(values):
+    """Empaqueta enteros sin signo con el ancho de bits que minimiza el tamaño; los que no caben
+    (un hueco en los datos, un salto del sensor) se guardan aparte como excepciones"""
+    bitLength = (values[:, None] >= (np.uint64(1) << _SHIFTS)).sum(axis=1)
+    counts = np.bincount(bitLength, minlength=65)
+    exceeding = len(values) - np.cumsum(counts)
+    width = int(np.argmin(np.arange(65) * len(values) + exceeding * EXCEPTION_BITS))
+    positions = np.flatnonzero(bitLength > width).astype(np.uint16)
+
+    header = np.array([(width, len(positions))], dtype=STREAM_HEADER).tobytes()
+    packed = b""
+    if width:
+        low = values & np.uint64((1 << width) - 1) if width < 64 else values
+        bits = ((low[:, None] >> _SHIFTS[:width]) & np.uint64(1)).astype(np.uint8)
+        packed = np.packbits(bits.ravel(), bitorder='little').tobytes()
+    return header + packed + positions.astype('<u2').tobytes() + values[positions].astype('<u8').tobytes()
+
+
+def _decodeStream(buffer, offset, count):
+    """Regresa (valores, nueva posicion)"""
+    header = np.frombuffer(buffer, STREAM_HEADER, 1, offset)[0]
+    width, exceptions = int(header['width']), int(header['exceptions'])
+    offset += STREAM_HEADER.itemsize
+    if width:
+        packedLength = (count * width + 7) // 8
+        bits = np.unpackbits(np.frombuffer(buffer, np.uint8, packedLength, offset), count=count * width, bitorder='little')
+        values = (bits.reshape(count, width).astype(np.uint64) << _SHIFTS[:width]).sum(axis=1, dtype=np.uint64)
+        offset += packedLength
+    else:
+        values = np.zeros(count, np.uint64)
+    if exceptions:
+        positions = np.frombuffer(buffer, '<u2', exceptions, offset)
+        offset += 2 * exceptions
+        values[positions] = np.frombuffer(buffer, '<u8', exceptions, offset)
+        offset += 8 * exceptions
+    return values, offset
+
+
+def _encodeBlock(times, values):
+    """times en unidades de TIME_UNIT_NS y values en punto fijo, ambos int64"""
+    deltas = np.diff(times)
+    header = np.array([(times[0], deltas[0] if len(deltas) else 0, values[0])], dtype=BLOCK_HEADER).tobytes()
+    return header + _encodeStream(_zigZag(np.diff(deltas))) + _encodeStream(_zigZag(np.diff(values)))
+
+
+def _decodeBlock(buffer, offset, count):
+    header = np.frombuffer(buffer, BLOCK_HEADER, 1, offset)[0]
+    offset += BLOCK_HEADER.itemsize
+    deltaOfDeltas, offset = _decodeStream(buffer, offset, max(count - 2, 0))
+    valueDeltas, offset = _decodeStream(buffer, offset, count - 1)
+
+    deltas = np.empty(count - 1, np.int64)
+    if count > 1:
+        deltas[0] = header['delta0']
+        deltas[1:] = header['delta0'] + np.cumsum(_unZigZag(deltaOfDeltas))
+    times = np.empty(count, np.int64)
+    times[0] = header['time0']
+    times[1:] = header['time0'] + np.cumsum(deltas)
+    fixed = np.empty(count, np.int64)
+    fixed[0] = header['value0']
+    fixed[1:] = header['value0'] + np.cumsum(_unZigZag(valueDeltas))
+
+    return _fromFixedPoint(times, fixed)
+
+
+def _fixedPoint(times_ns, values):
+    """Tiempos en unidades de TIME_UNIT_NS y valores en punto fijo (int64), la resolucion que se guarda"""
+    units = (np.asarray(times_ns, np.int64) + TIME_UNIT_NS // 2) // TIME_UNIT_NS
+    scaled = np.asarray(values, np.float64) * VALUE_SCALE
+    fixed = np.where(np.isnan(scaled), NAN_VALUE, np.rint(np.nan_to_num(scaled))).astype(np.int64)
+    return units, fixed
+
+
+def _fromFixedPoint(units, fixed):
+    values = (fixed / VALUE_SCALE).astype(np.float32)
+    values[fixed == NAN_VALUE] = np.nan
+    return units * TIME_UNIT_NS, values
+
+
+def quantize(times_ns, values):
+    """(tiempos en ns, valores) exactamente como regresarian despues de sellarlos"""
+    return _fromFixedPoint(*_fixedPoint(times_ns, values))
+
+
+def encodeSeries(times_ns, values):
+    """Comprime una serie ordenada por tiempo al formato sellado:
+    [cabecera][indice de bloques (primer y ultimo tiempo, posicion, muestras, bytes)][bloques]"""
+    if len(times_ns) == 0:
+        raise CodecError("Serie vacia")
+    units, fixed = _fixedPoint(times_ns, values)
+
+    starts = range(0, len(units), BLOCK_SAMPLES)
+    index = np.zeros(len(starts), dtype=BLOCK_INDEX)
+    offset = HEADER.itemsize + index.nbytes
+    blocks = []
+    for i, start in enumerate(starts):
+        block = _encodeBlock(units[start:start + BLOCK_SAMPLES], fixed[start:start + BLOCK_SAMPLES])
+        count = min(BLOCK_SAMPLES, len(units) - start)
+        index[i] = (units[start] * TIME_UNIT_NS, units[start + count - 1] * TIME_UNIT_NS, offset, count, len(block))
+        offset += len(block)
+        blocks.append(block)
+    return np.array([(MAGIC, len(index))], dtype=HEADER).tobytes() + index.tobytes() + b"".join(blocks)
+
+
+def blockIndex(buffer):
+    """Indice de bloques de un segmento sellado (buffer puede ser un mmap)"""
+    header = np.frombuffer(buffer, HEADER, 1)[0]
+    if header['magic'] != MAGIC:
+        raise CodecError("No es un segmento sellado")
+    return np.frombuffer(buffer, BLOCK_INDEX, int(header['blocks']), HEADER.itemsize)
+
+
+def decodeRange(buffer, start_ns, end_ns):
+    """(tiempos en ns, valores) en [start_ns, end_ns]; solo se descomprimen los bloques que se
+    traslapan con el rango, encontrados por busqueda binaria en el indice"""
+    index = blockIndex(buffer)
+    first = int(np.searchsorted(index['last'], start_ns, 'left'))
+    last = int(np.searchsorted(index['first'], end_ns, 'right'))
+    if first >= last:
+        return np.empty(0, np.int64), np.empty(0, np.float32)
+    decoded = [_decodeBlock(buffer, int(index[b]['offset']), int(index[b]['count'])) for b in range(first, last)]
+    times = np.concatenate([d[0] for d in decoded])
+    values = np.concatenate([d[1] for d in decoded])
+    low = np.searchsorted(times, start_ns, 'left')
+    high = np.searchsorted(times, end_ns, 'right')
+    return times[low:high], values[low:high]
+
+
+def decodeAll(buffer):
+    return decodeRange(buffer, np.iinfo(np.int64).min, np.iinfo(np.int64).max)
@@ -0,0 +1,195 @@
+# ## ###############################################
+#
+# seriesQuery.py
+# Consultas por rango de tiempo con reduccion de puntos en el
+# servidor (min/max por intervalo o LTTB) desde las muestras
+# crudas o desde el nivel de agregados que alcance
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import threading
+import time
+from collections import OrderedDict
+import numpy as np
+from sampleStore import deviceSnapshot
+from seriesStore import querySegmentsVersioned, rangeVersion, RAW_RETENTION_NS
+from rollupStore import TIERS, queryRollups
+from telemetryCodec import CHANNELS
+
+DEFAULT_POINTS = 1000
+MAX_POINTS = 10000
+DEFAULT_RANGE_S = 3600
+MODES = ("minmax", "lttb")
+# Resultados de rangos ya sellados (no cambian); si se llena sale el que se uso hace mas tiempo
+CACHED_RESULTS = 256
+RAW_TIER = "raw"
+# Formato binario de /api/series (format=bin), little endian: puntos (u32), reservado (u32), tiempos en ms
+# (float64) y valores (float32). El navegador lo lee con Float64Array/Float32Array sin parsear, 12 bytes por punto
+POINTS_HEADER = np.dtype([('points', '<u4'), ('reserved', '<u4')])
+
+cache = OrderedDict()
+cacheLock = threading.Lock()
+
+
+class QueryError(Exception):
+    pass
+
+
+def downsampleMinMax(times, values, points, start_ns, end_ns):
+    """Divide [start_ns, end_ns] en points/2 intervalos iguales y conserva el minimo y el maximo de
+    cada uno en orden de tiempo, asi los picos sobreviven a cualquier nivel de zoom"""
+    buckets = max(points // 2, 1)
+    span = max(end_ns - start_ns, 1)
+    bucket = ((times - start_ns) / span * buckets).astype(np.int64).clip(0, buckets - 1)
+    # Los tiempos vienen ordenados, asi que cada intervalo es un tramo contiguo
+    starts = np.flatnonzero(np.r_[True, bucket[1:] != bucket[:-1]])
+    group = np.repeat(np.arange(len(starts)), np.diff(np.r_[starts, len(times)]))
+    keep = []
+    for reduce in (np.minimum, np.maximum):
+        extremes = np.flatnonzero(values == reduce.reduceat(values, starts)[group])
+        # El primero de cada intervalo si el extremo se repite
+        keep.append(extremes[np.r_[True, group[extremes][1:] != group[extremes][:-1]]])
+    keep = np.unique(np.concatenate(keep))
+    return times[keep], values[keep]
+
+
+def downsampleLTTB(times, values, points):
+    """Largest-Triangle-Three-Buckets: conserva el primero y el ultimo y de cada intervalo (por
+    numero de muestras) el punto que forma el triangulo mas grande con el punto elegido antes y el
+    promedio del intervalo siguiente. Cada intervalo se evalua vectorizado"""
+    n = len(times)
+    if points < 3 or n <= points:
+        return times, values
+    x = (times - times[0]).astype(np.float64)
+    y = values.astype(np.float64)
+    edges = np.linspace(1, n - 1, points - 1).astype(np.int64)
+    counts = np.diff(edges)
+    averageX = np.add.reduceat(x[1:n - 1], edges[:-1] - 1) / counts
+    averageY = np.add.reduceat(y[1:n - 1], edges[:-1] - 1) / counts
+    selected = np.empty(points, np.int64)
+    selected[0], selected[-1] = 0, n - 1
+    previous = 0
+    for i in range(points - 2):
+        low, high = edges[i], edges[i + 1]
+        nextX, nextY = (averageX[i + 1], averageY[i + 1]) if i + 1 < points - 2 else (x[-1], y[-1])
+        area = np.abs((x[previous] - nextX) * (y[low:high] - y[previous])
+                      - (x[previous] - x[low:high]) * (nextY - y[previous]))
+        previous = low + int(np.argmax(area))
+        selected[i + 1] = previous
+    return times[selected], values[selected]
+
+
+def chooseTier(start_ns, end_ns, points, mode, now_ns=None):
+    """Nivel del que se lee: el mas grueso cuyo intervalo no es mas ancho que el de cada punto pedido.
+    Si el rango ya salio de la retencion de los niveles finos, el mas fino que aun lo conserva"""
+    now_ns = time.time_ns() if now_ns is None else now_ns
+    perPoint = (end_ns - start_ns) / (max(points // 2, 1) if mode == "minmax" else points)
+    levels = [(RAW_TIER, 0, RAW_RETENTION_NS)] + [(tier, width, retention) for tier, width, _, retention in TIERS]
+    available = [level for level in levels if level[2] is None or start_ns >= now_ns - level[2]] or levels[-1:]
+    fitting = [level for level in available if level[1] <= perPoint]
+    return (fitting[-1] if fitting else available[0])[0]
+
+
+def rollupPoints(records, points, mode, start_ns, end_ns):
+    """Puntos de los registros de un nivel: con minmax el minimo y el maximo de cada intervalo (se
+    juntan intervalos si son mas que points/2), con lttb sobre los promedios"""
+    if len(records) == 0:
+        # Rango fuera de la retencion cruda sin agregados: reduceat no acepta arreglos vacios
+        return np.empty(0, np.int64), np.empty(0, np.float32)
+    if mode == "lttb":
+        return downsampleLTTB(records['time'], (records['sum'] / records['count']).astype(np.float32), points)
+    times = records['time']
+    buckets = max(points // 2, 1)
+    bucket = ((times - start_ns) / max(end_ns - start_ns, 1) * buckets).astype(np.int64).clip(0, buckets - 1)
+    starts = np.flatnonzero(np.r_[True, bucket[1:] != bucket[:-1]])
+    minimums = np.minimum.reduceat(records['min'], starts)
+    maximums = np.maximum.reduceat(records['max'], starts)
+    return np.repeat(times[starts], 2), np.column_stack((minimums, maximums)).ravel()
+
+
+def _rawRange(device, channel, start_ns, end_ns):
+    """Muestras del rango de disco mas las recientes en memoria que aun no se escriben.
+    Regresa (tiempos, valores, version sellada o None)"""
+    chunks, version = querySegmentsVersioned(device, channel, start_ns, end_ns)
+    if version is None:
+        series, _ = deviceSnapshot(device)
+        if channel in series:
+            recentTimes, recentValues = series[channel]
+            stored = chunks[-1][0][-1] if chunks else np.iinfo(np.int64).min
+            recent = (recentTimes > stored) & (recentTimes >= start_ns) & (recentTimes <= end_ns)
+            chunks.append((recentTimes[recent], recentValues[recent]))
+    if not chunks:
+        return np.empty(0, np.int64), np.empty(0, np.float32), version
+    times = np.concatenate([c[0] for c in chunks])
+    values = np.concatenate([c[1] for c in chunks])
+    valid = ~np.isnan(values)
+    return times[valid], values[valid], version
+
+
+def querySeriesPoints(device, channel, start_ns=None, end_ns=None, points=DEFAULT_POINTS, mode="minmax"):
+    """Serie del canal en [start_ns, end_ns] reducida a lo mas points puntos.
+    Regresa el diccionario que sirve /api/series (tiempos en ms)"""
+    if channel not in CHANNELS:
+        raise QueryError(f"Canal desconocido: {channel}")
+    if mode not in MODES:
+        raise QueryError(f"Modo desconocido: {mode}")
+    end_ns = time.time_ns() if end_ns is None else end_ns
+    start_ns = end_ns - DEFAULT_RANGE_S * 10**9 if start_ns is None else start_ns
+    if start_ns > end_ns:
+        raise QueryError("from debe ser anterior a to")
+    points = min(max(points, 2), MAX_POINTS)
+
+    key = (device, channel, start_ns, end_ns, points, mode)
+    with cacheLock:
+        cached = cache.get(key)
+        if cached is not None:
+            cache.move_to_end(key)
+    if cached is not None and cached[0] == rangeVersion(device, channel, start_ns, end_ns):
+        return dict(cached[1], cached=True)
+
+    started = time.perf_counter()
+    tier = chooseTier(start_ns, end_ns, points, mode)
+    if tier != RAW_TIER:
+        records = queryRollups(tier, device, channel, start_ns, end_ns)
+        if len(records) or start_ns < time.time_ns() - RAW_RETENTION_NS:
+            # Sin cache: leer un nivel es barato y su ultimo intervalo sigue cambiando
+            raw, version = int(records['count'].sum()), None
+            times, values = rollupPoints(records, points, mode, start_ns, end_ns)
+        else:
+            # Muestras guardadas antes de que hubiera agregados
+            tier = RAW_TIER
+    if tier == RAW_TIER:
+        times, values, version = _rawRange(device, channel, start_ns, end_ns)
+        raw = len(times)
+        if raw > points:
+            if mode == "minmax":
+                times, values = downsampleMinMax(times, values, points, start_ns, end_ns)
+            else:
+                times, values = downsampleLTTB(times, values, points)
+    result = {
+        "device": device,
+        "channel": channel,
+        "from": start_ns // 10**6,
+        "to": end_ns // 10**6,
+        "mode": mode,
+        "tier": tier,
+        "raw": raw,
+        "t": (times // 10**6).tolist(),
+        "v": np.round(values.astype(np.float64), 3).tolist(),
+        "elapsed_ms": round((time.perf_counter() - started) * 1000, 2),
+    }
+    if version is not None:
+        with cacheLock:
+            cache[key] = (version, result)
+            cache.move_to_end(key)
+            while len(cache) > CACHED_RESULTS:
+                cache.popitem(last=False)
+    return dict(result, cached=False)
+
+
+def encodePoints(result):
+    """Puntos de un resultado de querySeriesPoints en el formato binario"""
+    times = np.asarray(result["t"], '<f8')
+    return np.array([(len(times), 0)], POINTS_HEADER).tobytes() + times.tobytes() + np.asarray(result["v"], '<f4').tobytes()
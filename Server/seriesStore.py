@@ -0,0 +1,388 @@
+# ## ###############################################
+#
+# seriesStore.py
+# Almacen en disco de las muestras: segmentos por dispositivo y
+# canal con registros fijos, indice de tiempo y lectura por mmap;
+# los dias terminados se sellan comprimidos (seriesCodec.py)
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import bisect
+import os
+import re
+import threading
+import time
+import numpy as np
+from seriesCodec import encodeSeries, decodeRange, decodeAll, quantize
+
+SERIES_PATH_DIR = "Status/series/"
+# Cada segmento guarda las muestras de un dia UTC de un canal: Status/series/<dispositivo>/<canal>/<inicio ns>.seg
+SEGMENT_SPAN_NS = 86400 * 10**9
+SEGMENT_EXTENSION = ".seg"
+INDEX_EXTENSION = ".idx"
+SEALED_EXTENSION = ".grs"
+# Registros por entrada del indice disperso
+INDEX_STRIDE = 256
+# Las muestras se acumulan en memoria y se escriben en lote con este periodo
+FLUSH_PERIOD_S = 1
+# Segmentos abiertos por mmap que se conservan entre consultas
+MAPPED_SEGMENTS = 256
+# Un dia se sella (comprime) cuando termino hace este tiempo; lo que llegue despues (journal de
+# un dispositivo que estuvo desconectado) va a un segmento nuevo que se vuelve a sellar
+SEAL_GRACE_NS = 6 * 3600 * 10**9
+SEAL_PERIOD_S = 600
+# Las muestras crudas se borran despues de este tiempo; lo que queda son los agregados de rollupStore.py
+RAW_RETENTION_NS = 14 * 86400 * 10**9
+
+RECORD = np.dtype([('time', '<i8'), ('value', '<f4')])
+# Por cada bloque de INDEX_STRIDE registros: tiempo minimo, maximo y si el bloque esta ordenado
+INDEX_RECORD = np.dtype([('min', '<i8'), ('max', '<i8'), ('ordered', '<i8')])
+
+pending = {}
+pendingLock = threading.Lock()
+mapped = {}
+mappedLock = threading.Lock()
+# Segmentos cuyo final ya se reviso en este proceso (un registro a medias de una caida se recorta)
+checkedSegments = set()
+# Escritura, sellado y el listado/mapeo de las consultas lo toman para que una consulta nunca vea
+# un dia a medio sellar (ni dos veces ni ninguna); el calculo de las consultas es fuera de el
+sealLock = threading.Lock()
+# Cambia cada vez que un dia sellado cambia (se sella o le llegan muestras atrasadas), los
+# resultados guardados en cache de rangos sellados dejan de valer
+sealedVersion = 0
+
+
+def _seriesDir(device, channel):
+    # El id viene de la red, se limpia antes de usarlo en la ruta
+    return os.path.join(SERIES_PATH_DIR, re.sub(r"[^A-Za-z0-9_-]", "_", device), channel)
+
+
+def persistSamples(device, time_ns, values):
+    """Encola {canal: valor} del dispositivo para el siguiente lote; no toca el disco"""
+    with pendingLock:
+        for channel, value in values.items():
+            pending.setdefault((device, channel), []).append((time_ns, value))
+
+
+def flushPending():
+    """Escribe lo encolado: un append por segmento con todos sus registros nuevos"""
+    global pending
+    with pendingLock:
+        batch, pending = pending, {}
+    with sealLock:
+        for (device, channel), samples in batch.items():
+            records = np.array(samples, dtype=RECORD)
+            directory = _seriesDir(device, channel)
+            os.makedirs(directory, exist_ok=True)
+            buckets = records['time'] // SEGMENT_SPAN_NS
+            for bucket in np.unique(buckets):
+                _appendToSegment(os.path.join(directory, f"{bucket * SEGMENT_SPAN_NS}{SEGMENT_EXTENSION}"),
+                                 records[buckets == bucket])
+    return sum(len(samples) for samples in batch.values())
+
+
+def _appendToSegment(path, records):
+    global sealedVersion
+    if path not in checkedSegments and os.path.exists(path[:-len(SEGMENT_EXTENSION)] + SEALED_EXTENSION):
+        sealedVersion += 1
+    with open(path, "ab") as f:
+        size = f.tell()
+        if path not in checkedSegments:
+            checkedSegments.add(path)
+            if size % RECORD.itemsize:
+                size -= size % RECORD.itemsize
+                f.truncate(size)
+        f.write(records.tobytes())
+    # Entradas del indice de los bloques que se completaron con este lote
+    first = size // RECORD.itemsize
+    count = first + len(records)
+    indexPath = path[:-len(SEGMENT_EXTENSION)] + INDEX_EXTENSION
+    indexed = os.path.getsize(indexPath) // INDEX_RECORD.itemsize if os.path.exists(indexPath) else 0
+    if indexed >= count // INDEX_STRIDE:
+        return
+    data = np.fromfile(path, dtype=RECORD, count=count // INDEX_STRIDE * INDEX_STRIDE - indexed * INDEX_STRIDE,
+                       offset=indexed * INDEX_STRIDE * RECORD.itemsize)
+    blocks = data['time'].reshape(-1, INDEX_STRIDE)
+    entries = np.empty(len(blocks), dtype=INDEX_RECORD)
+    entries['min'] = blocks.min(axis=1)
+    entries['max'] = blocks.max(axis=1)
+    entries['ordered'] = np.all(np.diff(blocks, axis=1) >= 0, axis=1)
+    with open(indexPath, "ab") as f:
+        f.truncate(indexed * INDEX_RECORD.itemsize)
+        f.write(entries.tobytes())
+
+
+def periodicFlush():
+    """Hilo que escribe los lotes pendientes"""
+    while True:
+        time.sleep(FLUSH_PERIOD_S)
+        try:
+            flushPending()
+        except OSError as e:
+            print(f"[Servidor de datos]: Error escribiendo series: {e}")
+
+
+def sealSegments(now_ns=None):
+    """Comprime los segmentos de los dias que terminaron hace mas de SEAL_GRACE_NS.
+    Regresa (segmentos sellados, bytes antes, bytes despues)"""
+    now_ns = time.time_ns() if now_ns is None else now_ns
+    sealed, before, after = 0, 0, 0
+    for root, _, files in os.walk(SERIES_PATH_DIR):
+        for name in files:
+            if not name.endswith(SEGMENT_EXTENSION):
+                continue
+            if int(name[:-len(SEGMENT_EXTENSION)]) + SEGMENT_SPAN_NS + SEAL_GRACE_NS > now_ns:
+                continue
+            result = _sealSegment(os.path.join(root, name))
+            if result:
+                sealed += 1
+                before += result[0]
+                after += result[1]
+    return sealed, before, after
+
+
+def _mergeDay(ranges):
+    """Junta en orden de tiempo las muestras selladas de un dia con las de su segmento. Si el servidor
+    se cayo entre reemplazar el .grs y borrar el .seg, el .seg repite muestras que ya estan selladas:
+    todo se lleva a la resolucion del sellado (100 ms, centesimas) y cada par (tiempo, valor) se
+    conserva una sola vez"""
+    times, values = quantize(np.concatenate([r[0] for r in ranges]), np.concatenate([r[1] for r in ranges]))
+    keys = np.empty(len(times), np.dtype([('time', '<i8'), ('bits', '<u4')]))
+    keys['time'] = times
+    keys['bits'] = values.view(np.uint32)
+    first = np.sort(np.unique(keys, return_index=True)[1])
+    times, values = times[first], values[first]
+    order = np.argsort(times, kind='stable')
+    return times[order], values[order]
+
+
+def _sealSegment(path):
+    """Comprime el segmento (junto con lo que ya estaba sellado de ese dia) y lo reemplaza.
+    Si llegaron muestras mientras se comprimia no se toca y se intenta en la siguiente ronda"""
+    global sealedVersion
+    stem = path[:-len(SEGMENT_EXTENSION)]
+    sealedPath = stem + SEALED_EXTENSION
+    with sealLock:
+        size = os.path.getsize(path)
+        records = _mapSegment(path)
+        previous = _mapSealed(sealedPath) if os.path.exists(sealedPath) else None
+    times, values = _segmentRange(path, records, np.iinfo(np.int64).min, np.iinfo(np.int64).max)
+    if previous is not None:
+        times, values = _mergeDay([decodeAll(previous), (times, values)])
+    encoded = encodeSeries(times, values) if len(times) else None
+
+    with sealLock:
+        if os.path.getsize(path) != size:
+            return None
+        if encoded is not None:
+            with open(sealedPath + ".tmp", "wb") as f:
+                f.write(encoded)
+                f.flush()
+                os.fsync(f.fileno())
+            os.replace(sealedPath + ".tmp", sealedPath)
+        os.remove(path)
+        if os.path.exists(stem + INDEX_EXTENSION):
+            os.remove(stem + INDEX_EXTENSION)
+        checkedSegments.discard(path)
+        sealedVersion += 1
+        with mappedLock:
+            mapped.pop(path, None)
+            mapped.pop(sealedPath, None)
+    return size + (previous.nbytes if previous is not None else 0), len(encoded) if encoded is not None else 0
+
+
+def expiredDays(now_ns=None):
+    """Dias guardados que salieron de RAW_RETENTION_NS como [(dispositivo, canal, inicio ns)]"""
+    now_ns = time.time_ns() if now_ns is None else now_ns
+    days = set()
+    for root, _, files in os.walk(SERIES_PATH_DIR):
+        for name in files:
+            stem, extension = os.path.splitext(name)
+            if extension in (SEGMENT_EXTENSION, SEALED_EXTENSION) and \
+                    int(stem) + SEGMENT_SPAN_NS + RAW_RETENTION_NS <= now_ns:
+                device, channel = os.path.relpath(root, SERIES_PATH_DIR).split(os.sep)
+                days.add((device, channel, int(stem)))
+    return sorted(days)
+
+
+def expireDay(device, channel, dayStart):
+    """Borra las muestras crudas de un dia. Una consulta que ya mapeo los archivos los sigue leyendo"""
+    global sealedVersion
+    stem = os.path.join(_seriesDir(device, channel), str(dayStart))
+    with sealLock:
+        for extension in (SEGMENT_EXTENSION, INDEX_EXTENSION, SEALED_EXTENSION):
+            if os.path.exists(stem + extension):
+                os.remove(stem + extension)
+            checkedSegments.discard(stem + extension)
+            with mappedLock:
+                mapped.pop(stem + extension, None)
+        sealedVersion += 1
+
+
+def periodicSeal():
+    """Hilo que sella los dias terminados"""
+    while True:
+        try:
+            sealed, before, after = sealSegments()
+            if sealed:
+                print(f"[Servidor de datos]: {sealed} segmentos sellados, {before} -> {after} bytes")
+        except OSError as e:
+            print(f"[Servidor de datos]: Error sellando series: {e}")
+        time.sleep(SEAL_PERIOD_S)
+
+
+def startSeriesWriter():
+    threading.Thread(target=periodicFlush, daemon=True).start()
+    threading.Thread(target=periodicSeal, daemon=True).start()
+
+
+def _mapFile(path, dtype):
+    """Archivo como memmap de solo lectura (se vuelve a mapear si el archivo crecio)"""
+    count = os.path.getsize(path) // dtype.itemsize
+    with mappedLock:
+        cached = mapped.get(path)
+        if cached is not None and len(cached) == count:
+            return cached
+        if count == 0:
+            return np.empty(0, dtype=dtype)
+        if len(mapped) >= MAPPED_SEGMENTS:
+            mapped.clear()
+        mapped[path] = np.memmap(path, dtype=dtype, mode='r', shape=(count,))
+        return mapped[path]
+
+
+def _mapSegment(path):
+    return _mapFile(path, RECORD)
+
+
+def _mapSealed(path):
+    return _mapFile(path, np.dtype(np.uint8))
+
+
+def _blockBounds(path, records):
+    """(min, max, ordenado) de cada bloque del segmento: los del indice mas el bloque incompleto
+    (o los que el indice aun no tiene) calculados de los datos"""
+    try:
+        index = np.fromfile(path[:-len(SEGMENT_EXTENSION)] + INDEX_EXTENSION, dtype=INDEX_RECORD)
+    except FileNotFoundError:
+        # Todavia no completa un bloque, o el segmento se acaba de sellar
+        index = np.empty(0, INDEX_RECORD)
+    index = index[:len(records) // INDEX_STRIDE]
+    tail = records['time'][len(index) * INDEX_STRIDE:]
+    if len(tail):
+        extra = np.empty((len(tail) + INDEX_STRIDE - 1) // INDEX_STRIDE, dtype=INDEX_RECORD)
+        for i in range(len(extra)):
+            block = tail[i * INDEX_STRIDE:(i + 1) * INDEX_STRIDE]
+            extra[i] = (block.min(), block.max(), np.all(np.diff(block) >= 0))
+        index = np.concatenate((index, extra))
+    return index
+
+
+def _segmentRange(path, records, start_ns, end_ns):
+    """(tiempos, valores) del segmento en [start_ns, end_ns]. Si el segmento esta ordenado el
+    rango se encuentra por busqueda binaria (indice y luego registros) y son vistas del mmap;
+    si llegaron muestras atrasadas (journal) se filtra y se ordena una copia"""
+    if len(records) == 0:
+        return records['time'], records['value']
+    index = _blockBounds(path, records)
+    if np.all(index['ordered']) and np.all(index['min'][1:] >= index['max'][:-1]):
+        times = records['time']
+        first = int(np.searchsorted(index['max'], start_ns, 'left'))
+        last = int(np.searchsorted(index['min'], end_ns, 'right'))
+        if first >= last:
+            return times[:0], records['value'][:0]
+        low = first * INDEX_STRIDE
+        low += int(np.searchsorted(times[low:low + INDEX_STRIDE], start_ns, 'left'))
+        high = (last - 1) * INDEX_STRIDE
+        high += int(np.searchsorted(times[high:high + INDEX_STRIDE], end_ns, 'right'))
+        return times[low:high], records['value'][low:high]
+
+    candidates = np.flatnonzero((index['max'] >= start_ns) & (index['min'] <= end_ns))
+    selected = np.concatenate([records[b * INDEX_STRIDE:(b + 1) * INDEX_STRIDE] for b in candidates]) \
+        if len(candidates) else records[:0]
+    selected = selected[(selected['time'] >= start_ns) & (selected['time'] <= end_ns)]
+    selected = selected[np.argsort(selected['time'], kind='stable')]
+    return selected['time'], selected['value']
+
+
+def querySegments(device, channel, start_ns, end_ns):
+    """Muestras guardadas del canal en [start_ns, end_ns] como [(tiempos, valores)] por dia, en
+    orden. De los dias sin sellar son vistas del mmap; de los sellados solo se descomprimen los
+    bloques que toca el rango. Lo que sigue en la cola de escritura (hasta FLUSH_PERIOD_S) no aparece"""
+    return querySegmentsVersioned(device, channel, start_ns, end_ns)[0]
+
+
+def _rangeDays(device, channel, start_ns, end_ns):
+    """Dias del canal que se traslapan con el rango {inicio: [extensiones]} y sealedVersion si todos
+    estan sellados (None si no). Se llama con sealLock tomado"""
+    version = sealedVersion
+    if end_ns >= time.time_ns() - SEGMENT_SPAN_NS - SEAL_GRACE_NS:
+        # Aun puede llegar algo a un dia sin segmento
+        version = None
+    try:
+        names = os.listdir(_seriesDir(device, channel))
+    except FileNotFoundError:
+        return {}, version
+    days = {}
+    for name in names:
+        stem, extension = os.path.splitext(name)
+        if extension in (SEGMENT_EXTENSION, SEALED_EXTENSION):
+            days.setdefault(int(stem), []).append(extension)
+    starts = sorted(days)
+    # Dias que se traslapan con el rango: el que contiene start_ns y los que empiezan antes de end_ns
+    first = max(bisect.bisect_right(starts, start_ns) - 1, 0)
+    last = bisect.bisect_right(starts, end_ns)
+    selected = {dayStart: days[dayStart] for dayStart in starts[first:last]}
+    if any(SEGMENT_EXTENSION in extensions for extensions in selected.values()):
+        version = None
+    return selected, version
+
+
+def rangeVersion(device, channel, start_ns, end_ns):
+    """sealedVersion si el rango solo toca dias sellados (su contenido no cambia mientras sealedVersion
+    sea el mismo) o None si toca segmentos abiertos"""
+    with sealLock:
+        return _rangeDays(device, channel, start_ns, end_ns)[1]
+
+
+def querySegmentsVersioned(device, channel, start_ns, end_ns):
+    """Como querySegments, regresa tambien rangeVersion del rango leido"""
+    directory = _seriesDir(device, channel)
+    with sealLock:
+        days, version = _rangeDays(device, channel, start_ns, end_ns)
+        sources = []
+        for dayStart, extensions in days.items():
+            stem = os.path.join(directory, str(dayStart))
+            sources.append([(stem + extension, _mapSegment(stem + extension) if extension == SEGMENT_EXTENSION
+                             else _mapSealed(stem + extension)) for extension in extensions])
+
+    chunks = []
+    for parts in sources:
+        ranges = [_segmentRange(path, data, start_ns, end_ns) if path.endswith(SEGMENT_EXTENSION)
+                  else decodeRange(data, start_ns, end_ns) for path, data in parts]
+        ranges = [r for r in ranges if len(r[0])]
+        if len(ranges) > 1:
+            # Dia sellado con muestras que llegaron despues (o que ya estaban selladas, tras una caida)
+            ranges = [_mergeDay(ranges)]
+        chunks.extend(ranges)
+    return chunks, version
+
+
+def querySeries(device, channel, start_ns, end_ns):
+    """Como querySegments pero en un solo par de arreglos (copia si hay mas de un segmento)"""
+    chunks = querySegments(device, channel, start_ns, end_ns)
+    if not chunks:
+        return np.empty(0, np.int64), np.empty(0, np.float32)
+    if len(chunks) == 1:
+        return chunks[0]
+    return np.concatenate([c[0] for c in chunks]), np.concatenate([c[1] for c in chunks])
+
+
+def seriesDevices():
+    """Dispositivos con series guardadas (nombres ya limpiados)"""
+    try:
+        return sorted(os.listdir(SERIES_PATH_DIR))
+    except FileNotFoundError:
+        return []
@@ -0,0 +1,120 @@
+# ## ###############################################
+#
+# streamFramer.py
+# Separacion incremental en tramas del flujo TCP de un dispositivo
+# (lineas JSON y tramas compactas) con resincronizacion
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+from telemetryCodec import FRAME_MAGIC, FRAME_HEADER_LEN, FRAME_KEYFRAME, FRAME_DELTA, FRAME_SUMMARY
+
+FRAME_LINE = "line"
+FRAME_COMPACT = "compact"
+# La linea mas larga del firmware es un lote de logs (LOG_BATCH_LINE_MAX_LEN = 1280)
+MAX_LINE_LEN = 4096
+# La trama compacta mas larga del firmware es de ~170 bytes (TELEMETRY_FRAME_MAX_LEN)
+MAX_COMPACT_PAYLOAD = 512
+COMPACT_TYPES = (FRAME_KEYFRAME, FRAME_DELTA, FRAME_SUMMARY)
+LINE_START = ord("{")
+SEPARATORS = b" \t\r\n"
+
+
+class StreamFramer:
+    """Acumula los bytes de una conexion y extrae tramas completas aunque TCP las junte o las parta.
+    Una trama es una linea JSON terminada en '\\n' o [0xA5][longitud][payload]. Si el flujo se
+    corrompe (cabecera invalida, bytes que no inician una trama o una linea sin fin) se descartan
+    bytes hasta el siguiente '\\n' o 0xA5 y las tramas posteriores se recuperan"""
+
+    def __init__(self, maxLineLen=MAX_LINE_LEN, maxPayloadLen=MAX_COMPACT_PAYLOAD):
+        self.maxLineLen = maxLineLen
+        self.maxPayloadLen = maxPayloadLen
+        self.buffer = bytearray()
+        self.resyncing = False
+        self.bytes = 0
+        self.lines = 0
+        self.compactFrames = 0
+        self.resyncs = 0
+        self.discardedBytes = 0
+        self.oversized = 0
+        self.rejected = 0
+
+    def feed(self, data):
+        """Agrega los bytes recibidos, regresa las tramas completas [(FRAME_LINE o FRAME_COMPACT, bytes)]
+        en orden. Lo incompleto queda en el buffer (nunca mas de una trama maxima)"""
+        self.bytes += len(data)
+        buf = self.buffer
+        buf += data
+        frames = []
+        pos = 0
+        while pos < len(buf):
+            byte = buf[pos]
+            if byte == FRAME_MAGIC:
+                if len(buf) - pos <= FRAME_HEADER_LEN:
+                    break
+                length = int.from_bytes(buf[pos + 1:pos + FRAME_HEADER_LEN], 'little')
+                if not 0 < length <= self.maxPayloadLen or buf[pos + FRAME_HEADER_LEN] not in COMPACT_TYPES:
+                    pos = self._resync(pos, pos + 1)
+                    continue
+                end = pos + FRAME_HEADER_LEN + length
+                if end > len(buf):
+                    break
+                frames.append((FRAME_COMPACT, bytes(buf[pos + FRAME_HEADER_LEN:end])))
+                self.compactFrames += 1
+                self.resyncing = False
+                pos = end
+            elif self.resyncing or (byte != LINE_START and byte not in SEPARATORS):
+                # A media trama, un '{' puede ser el de un objeto anidado
+                pos = self._resync(pos, pos)
+            elif byte != LINE_START:
+                pos += 1
+            else:
+                end = buf.find(b"\n", pos, pos + self.maxLineLen + 1)
+                if end < 0:
+                    if len(buf) - pos <= self.maxLineLen:
+                        break
+                    self.oversized += 1
+                    pos = self._resync(pos, pos + 1)
+                    continue
+                frames.append((FRAME_LINE, bytes(buf[pos:end]).rstrip(b"\r")))
+                self.lines += 1
+                pos = end + 1
+        del buf[:pos]
+        return frames
+
+    def _resync(self, start, searchFrom):
+        """Descarta desde start hasta el siguiente inicio posible de trama (despues de un '\\n' o en
+        un 0xA5 a partir de searchFrom) y regresa esa posicion. Una corrupcion cuenta una sola
+        resincronizacion aunque tome varios intentos"""
+        buf = self.buffer
+        if not self.resyncing:
+            self.resyncs += 1
+            self.resyncing = True
+        newline = buf.find(b"\n", searchFrom)
+        magic = buf.find(FRAME_MAGIC, searchFrom)
+        if magic >= 0 and (newline < 0 or magic < newline):
+            nextStart = magic
+        elif newline >= 0:
+            nextStart = newline + 1
+            self.resyncing = False
+        else:
+            nextStart = len(buf)
+        self.discardedBytes += nextStart - start
+        return nextStart
+
+    def reject(self):
+        """Registra una trama bien delimitada cuyo contenido no se pudo decodificar"""
+        self.rejected += 1
+
+    def stats(self):
+        return {
+            "bytes": self.bytes,
+            "lines": self.lines,
+            "compactFrames": self.compactFrames,
+            "resyncs": self.resyncs,
+            "discardedBytes": self.discardedBytes,
+            "oversized": self.oversized,
+            "rejected": self.rejected,
+            "buffered": len(self.buffer),
+        }
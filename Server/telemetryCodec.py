@@ -0,0 +1,124 @@
+# ## ###############################################
+#
+# telemetryCodec.py
+# Decodificador de tramas compactas (delta + varint) del ESP32
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+
+# Formato definido en components/TelemetryCodec/TelemetryCodec.h
+FRAME_MAGIC = 0xA5
+FRAME_HEADER_LEN = 3
+FRAME_KEYFRAME = 0x01
+FRAME_DELTA = 0x02
+FRAME_SUMMARY = 0x03
+SUMMARY_FLAG_UPTIME = 0x01
+STDDEV_SCALE = 100.0
+CHANNELS = ("LM135", "AM2302T", "AM2302H")
+TIME_UNIT_S = 0.1
+FIXED_POINT_SCALE = 10.0
+
+
+class FrameError(Exception):
+    pass
+
+
+def readVarint(payload, pos):
+    """Lee un varint LEB128 sin signo, regresa (valor, nueva posicion)"""
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(payload) or shift > 28:
+            raise FrameError("Varint truncado")
+        byte = payload[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, pos
+        shift += 7
+
+
+def unZigZag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+class CompactTelemetryDecoder:
+    """Decodificador con estado: las tramas delta dependen de la anterior,
+    por lo que se descartan hasta recibir el primer keyframe de la sesion."""
+
+    def __init__(self):
+        self.lastValues = None
+        self.lastSequence = None
+        self.frames = 0
+        self.discardedFrames = 0
+
+    def decodeFrame(self, payload):
+        """Decodifica el payload de una trama (sin cabecera). Regresa (segundos que tenia la ultima
+        muestra al enviarse, [(segundos desde la muestra anterior, {canal: valor})])"""
+        frameType = payload[0]
+        sequence, pos = readVarint(payload, 1)
+        if pos + 3 > len(payload):
+            raise FrameError("Cabecera truncada")
+        count = payload[pos]
+        age = int.from_bytes(payload[pos + 1:pos + 3], 'little') * TIME_UNIT_S
+        pos += 3
+
+        if frameType == FRAME_KEYFRAME:
+            values = [0] * len(CHANNELS)
+        elif frameType == FRAME_DELTA and self.lastValues is not None \
+                and sequence == self.lastSequence + 1:
+            values = list(self.lastValues)
+        else:
+            # Sin keyframe previo o trama perdida: hay que esperar al siguiente keyframe
+            self.lastValues = None
+            self.discardedFrames += 1
+            return age, []
+
+        samples = []
+        for _ in range(count):
+            dt, pos = readVarint(payload, pos)
+            for ch in range(len(CHANNELS)):
+                delta, pos = readVarint(payload, pos)
+                values[ch] += unZigZag(delta)
+            samples.append((dt * TIME_UNIT_S,
+                            {name: v / FIXED_POINT_SCALE for name, v in zip(CHANNELS, values)}))
+        if pos != len(payload):
+            raise FrameError("Bytes sobrantes en la trama")
+
+        self.lastValues = values
+        self.lastSequence = sequence
+        self.frames += 1
+        return age, samples
+
+
+def decodeSummaryFrame(payload):
+    """Decodifica una trama de resumen por ventana (no depende del estado del decodificador).
+    Regresa el mismo diccionario que envia el modo JSON en la llave 'summary'"""
+    if payload[0] != FRAME_SUMMARY:
+        raise FrameError("No es una trama de resumen")
+    flags = payload[1]
+    start, pos = readVarint(payload, 2)
+    window, pos = readVarint(payload, pos)
+    channels = {}
+    for name in CHANNELS:
+        count, pos = readVarint(payload, pos)
+        fields = []
+        for _ in range(3):
+            value, pos = readVarint(payload, pos)
+            fields.append(unZigZag(value) / FIXED_POINT_SCALE)
+        stddev, pos = readVarint(payload, pos)
+        channels[name] = {"n": count, "mean": fields[0], "min": fields[1], "max": fields[2],
+                          "std": stddev / STDDEV_SCALE}
+    if pos != len(payload):
+        raise FrameError("Bytes sobrantes en la trama")
+    return {"start": start, "flags": flags, "window": window, "channels": channels}
+
+
+def samplesToSensorsJSON(values):
+    """Convierte una muestra decodificada al formato JSON que envia el modo texto"""
+    return {"sensors": [
+        {"sensor": "LM135", "temperature": values["LM135"]},
+        {"sensor": "AM2302", "temperature": values["AM2302T"], "humidity": values["AM2302H"]},
+    ]}
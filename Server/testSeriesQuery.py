@@ -0,0 +1,96 @@
+#! /usr/bin/env python3
+# ## ###############################################
+#
+# testSeriesQuery.py
+# Pruebas de las consultas por rango (seriesQuery.py) y del sellado (seriesStore.py)
+# (python3 -m unittest testSeriesQuery desde Server/)
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import os
+import shutil
+import tempfile
+import time
+import unittest
+import numpy as np
+import rollupStore
+import seriesStore
+from seriesQuery import rollupPoints, querySeriesPoints, MODES
+
+
+class EmptyRangeTest(unittest.TestCase):
+    """Un rango sin muestras ni agregados regresa una serie vacia en lugar de fallar"""
+
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        self.paths = (seriesStore.SERIES_PATH_DIR, rollupStore.ROLLUPS_PATH_DIR)
+        seriesStore.SERIES_PATH_DIR = self.directory.name + "/series/"
+        rollupStore.ROLLUPS_PATH_DIR = self.directory.name + "/rollups/"
+
+    def tearDown(self):
+        seriesStore.SERIES_PATH_DIR, rollupStore.ROLLUPS_PATH_DIR = self.paths
+        self.directory.cleanup()
+
+    def testRollupPointsWithoutRecords(self):
+        for mode in MODES:
+            times, values = rollupPoints(np.empty(0, rollupStore.ROLLUP), 100, mode, 0, 10**12)
+            self.assertEqual(len(times), 0)
+            self.assertEqual(len(values), 0)
+
+    def testRangeOutsideRawRetention(self):
+        # Un año atras: solo el nivel por hora lo conserva y este dispositivo no tiene agregados
+        end_ns = time.time_ns() - 365 * 86400 * 10**9
+        for mode in MODES:
+            result = querySeriesPoints("sin-datos", "LM135", end_ns - 30 * 86400 * 10**9, end_ns, 500, mode)
+            self.assertEqual(result["tier"], "1h")
+            self.assertEqual((result["raw"], result["t"], result["v"]), (0, [], []))
+
+
+
+class SealCrashTest(unittest.TestCase):
+    """Una caida entre reemplazar el .grs y borrar el .seg no duplica las muestras del dia"""
+
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        self.path = seriesStore.SERIES_PATH_DIR
+        seriesStore.SERIES_PATH_DIR = self.directory.name + "/series/"
+
+    def tearDown(self):
+        seriesStore.SERIES_PATH_DIR = self.path
+        seriesStore.checkedSegments.clear()
+        seriesStore.mapped.clear()
+        self.directory.cleanup()
+
+    def testLeftoverSegmentIsNotMergedTwice(self):
+        # Tiempos en ns y valores en float32 como llegan, no a la resolucion del sellado
+        day = (time.time_ns() // seriesStore.SEGMENT_SPAN_NS - 3) * seriesStore.SEGMENT_SPAN_NS
+        rng = np.random.default_rng(1)
+        times = day + np.cumsum(rng.integers(1_900_000_000, 2_100_000_000, 500))
+        values = (20 + rng.random(500) * 5).astype(np.float32)
+        for t, v in zip(times, values):
+            seriesStore.persistSamples("gh", int(t), {"LM135": float(v)})
+        seriesStore.flushPending()
+        segment = os.path.join(seriesStore._seriesDir("gh", "LM135"), f"{day}{seriesStore.SEGMENT_EXTENSION}")
+        shutil.copy(segment, self.directory.name + "/segment")
+        self.assertEqual(seriesStore.sealSegments()[0], 1)
+        sealed = seriesStore.querySeries("gh", "LM135", day, day + seriesStore.SEGMENT_SPAN_NS)
+        self.assertEqual(len(sealed[0]), 500)
+
+        # La caida deja el .seg junto al .grs que ya tiene sus muestras, y luego llega una atrasada
+        shutil.copy(self.directory.name + "/segment", segment)
+        seriesStore.checkedSegments.clear()
+        seriesStore.mapped.clear()
+        seriesStore.persistSamples("gh", int(times[-1]) + 10**9, {"LM135": 30.0})
+        seriesStore.flushPending()
+        for _ in range(2):
+            queried, _ = seriesStore.querySeries("gh", "LM135", day, day + seriesStore.SEGMENT_SPAN_NS)
+            self.assertEqual(len(queried), 501)
+            self.assertTrue(np.all(np.diff(queried) > 0))
+            seriesStore.sealSegments()
+        self.assertEqual(os.listdir(os.path.dirname(segment)), [f"{day}{seriesStore.SEALED_EXTENSION}"])
+
+
+if __name__ == '__main__':
+    unittest.main()
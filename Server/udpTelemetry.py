@@ -0,0 +1,178 @@
+# ## ###############################################
+#
+# udpTelemetry.py
+# Receptor de telemetria por datagramas UDP del ESP32
+# con contabilidad de perdidas y reordenamiento por dispositivo
+#
+# Autor: Alexis Solis
+# License: MIT
+#
+# ## ###############################################
+import collections
+import socket
+import struct
+import threading
+import time
+from telemetryCodec import samplesToSensorsJSON
+from graphics import storeData
+
+# Formato definido en TelemetryDatagram (components/WiFi/WiFi.h)
+DATAGRAM_FORMAT = struct.Struct("<BBH6sIQhhH")
+DATAGRAM_MAGIC = 0xA6
+DATAGRAM_FLAG_UPTIME = 1
+FIXED_POINT_SCALE = 10.0
+UDP_PORT = 42070
+
+# Datagramas que se retienen esperando a uno faltante antes de declararlo perdido
+REORDER_WINDOW = 16
+REORDER_TIMEOUT_S = 1.0
+# Rangos de secuencias declaradas perdidas que se recuerdan para distinguir una llegada tardia de un duplicado
+LOST_RANGES_MAX = 64
+
+
+class SequenceTracker:
+    """Entrega las muestras de un dispositivo en orden de secuencia dentro de una ventana pequeña
+    y cuenta perdidas, reordenamientos, duplicados y llegadas tardias."""
+
+    def __init__(self):
+        self.bootID = None
+        self.nextSequence = None
+        self.highestSequence = None
+        self.pending = {}
+        self.lostRanges = collections.deque(maxlen=LOST_RANGES_MAX)
+        self.received = 0
+        self.lost = 0
+        self.reordered = 0
+        self.duplicates = 0
+        self.late = 0
+        self.restarts = 0
+
+    def push(self, bootID, sequence, sample, now):
+        """Agrega un datagrama, regresa las muestras que ya pueden entregarse en orden"""
+        delivered = []
+        if bootID != self.bootID:
+            # Dispositivo reiniciado: la secuencia empieza de nuevo
+            if self.bootID is not None:
+                delivered = self._drain(now, force=True)
+                self.restarts += 1
+            self.bootID = bootID
+            self.nextSequence = sequence
+            self.highestSequence = sequence
+            self.lostRanges.clear()
+        elif sequence < self.nextSequence:
+            # Ya se habia declarado perdido (tardio) o es un duplicado de uno entregado
+            if any(start <= sequence < end for start, end in self.lostRanges):
+                self.late += 1
+            else:
+                self.duplicates += 1
+            return []
+
+        if sequence in self.pending:
+            self.duplicates += 1
+            return delivered
+        self.received += 1
+        if sequence < self.highestSequence:
+            self.reordered += 1
+        self.highestSequence = max(self.highestSequence, sequence)
+        self.pending[sequence] = (now, sample)
+        return delivered + self._drain(now)
+
+    def expire(self, now):
+        """Entrega lo retenido por mas de REORDER_TIMEOUT_S aunque falten datagramas"""
+        return self._drain(now)
+
+    def _drain(self, now, force=False):
+        delivered = []
+        while self.pending:
+            if self.nextSequence in self.pending:
+                delivered.append(self.pending.pop(self.nextSequence)[1])
+                self.nextSequence += 1
+                continue
+            oldest = min(self.pending)
+            if force or max(self.pending) - self.nextSequence >= REORDER_WINDOW or \
+                    now - self.pending[oldest][0] > REORDER_TIMEOUT_S:
+                self.lost += oldest - self.nextSequence
+                self.lostRanges.append((self.nextSequence, oldest))
+                self.nextSequence = oldest
+            else:
+                break
+        return delivered
+
+    def stats(self):
+        expected = self.received + self.lost
+        return {
+            "received": self.received,
+            "lost": self.lost,
+            "lossRate": self.lost / expected if expected else 0.0,
+            "reordered": self.reordered,
+            "duplicates": self.duplicates,
+            "late": self.late,
+            "restarts": self.restarts,
+        }
+
+
+trackers = {}
+trackersLock = threading.Lock()
+
+
+def decodeDatagram(data, arrival):
+    """Regresa (dispositivo, arranque, secuencia, (tiempo, valores)) o None si el datagrama no es valido"""
+    if len(data) != DATAGRAM_FORMAT.size or data[0] != DATAGRAM_MAGIC:
+        return None
+    _, flags, bootID, mac, sequence, timestamp_ms, lm135, am2302t, am2302h = DATAGRAM_FORMAT.unpack(data)
+    device = "gh-" + mac[3:].hex()
+    # Sin reloj sincronizado solo se conoce el tiempo desde el arranque, se usa la llegada
+    sampleTime = arrival if flags & DATAGRAM_FLAG_UPTIME else timestamp_ms / 1000.0
+    values = {"LM135": lm135 / FIXED_POINT_SCALE,
+              "AM2302T": am2302t / FIXED_POINT_SCALE,
+              "AM2302H": am2302h / FIXED_POINT_SCALE}
+    return device, bootID, sequence, (sampleTime, values)
+
+
+def storeSamples(samples, device):
+    for sampleTime, values in samples:
+        storeData(samplesToSensorsJSON(values), sampleTime, device)
+
+
+def receiveDatagrams(udpSocket):
+    """Hilo receptor: un solo socket para todos los dispositivos"""
+    invalid = 0
+    while True:
+        try:
+            data, address = udpSocket.recvfrom(64)
+        except socket.timeout:
+            data = None
+        except OSError as e:
+            print(f"[Servidor UDP]: Error recibiendo: {e}")
+            time.sleep(1)
+            continue
+        now = time.time()
+        with trackersLock:
+            if data is not None:
+                decoded = decodeDatagram(data, now)
+                if decoded is None:
+                    invalid += 1
+                    print(f"[Servidor UDP]: Datagrama inválido de {address} ({invalid} en total)")
+                else:
+                    device, bootID, sequence, sample = decoded
+                    if device not in trackers:
+                        print(f"[Servidor UDP]: Nuevo dispositivo {device} en {address}")
+                        trackers[device] = SequenceTracker()
+                    storeSamples(trackers[device].push(bootID, sequence, sample, now), device)
+            for device, tracker in trackers.items():
+                storeSamples(tracker.expire(now), device)
+
+
+def udpTelemetryStats():
+    """Estadisticas de secuencia por dispositivo"""
+    with trackersLock:
+        return {device: tracker.stats() for device, tracker in trackers.items()}
+
+
+def startUDPTelemetryServer(port=UDP_PORT):
+    udpSocket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udpSocket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    udpSocket.bind(('0.0.0.0', port))
+    udpSocket.settimeout(REORDER_TIMEOUT_S / 2)
+    print(f"[Servidor UDP]: Escuchando telemetría en el puerto {port}...")
+    threading.Thread(target=receiveDatagrams, daemon=True, args=(udpSocket,)).start()
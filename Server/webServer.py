@@ -10,10 +10,18 @@
 import os
 import sys
 import json
+import time
 import magic
 import subprocess
 from http.server import BaseHTTPRequestHandler, HTTPServer
-from dataServer import setFanPower, setDesiredTemperature, toggleIrrigation, addNewIrrigationAlarm
+from dataServer import setFanPower, setFanAuto, setDesiredTemperature, toggleIrrigation, addNewIrrigationAlarm, setReportPolicy, setTelemetryStream, applyPreset
+from latency import latencySnapshot
+from udpTelemetry import udpTelemetryStats
+from deviceLogs import queryDeviceLogs
+from deviceSessions import sessionSummaries
+from seriesQuery import querySeriesPoints, encodePoints, QueryError, DEFAULT_POINTS
+from seriesStore import seriesDevices
+from urllib.parse import urlparse, parse_qs
 
 # Obtener IP del host (Linux)
 address = subprocess.run(
@@ -67,18 +75,36 @@ class WebServer(BaseHTTPRequestHandler):
         self.end_headers()
         self.wfile.write(bytes(json.dumps(data), "utf-8"))
 
-    def _parse_post(self, json_obj):
+    def _serve_series(self, result):
+        """Sirve los puntos de una serie en el formato binario, el resto del resultado va en cabeceras"""
+        body = encodePoints(result)
+        self.send_response(200)
+        self.send_header("Content-type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("X-Series-Tier", result["tier"])
+        self.send_header("X-Series-Raw", str(result["raw"]))
+        self.send_header("X-Series-Elapsed-Ms", str(result["elapsed_ms"]))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def _parse_post(self, json_obj, clickTime):
         if 'action' not in json_obj:
             return
 
         switcher = {
             'update_fan': setFanPower,
+            'fan_auto': setFanAuto,
             'toggle_irrigation': toggleIrrigation,
             'update_temperature': setDesiredTemperature,
-            'add_irrigation_alarm': addNewIrrigationAlarm
+            'add_irrigation_alarm': addNewIrrigationAlarm,
+            'update_report_policy': setReportPolicy,
+            'update_telemetry_stream': setTelemetryStream,
+            'apply_preset': applyPreset
         }
 
         func = switcher.get(json_obj['action'], None)
+        # Dispositivo destino, vacio para el ultimo conectado
+        device = json_obj.get('device') or None
 
         if func:
             action = json_obj['action']
@@ -86,26 +112,51 @@ class WebServer(BaseHTTPRequestHandler):
             # --- Control del ventilador ---
             if action == 'update_fan':
                 power = float(json_obj.get('fanPower', 0))
-                print(f"\tCall {func}(power={power})")
-                func(power)
+                print(f"\tCall {func}(power={power},device={device})")
+                func(power, clickTime, device)
+
+            # --- Ventilador controlado por el lazo de temperatura ---
+            elif action == 'fan_auto':
+                print(f"\tCall {func}(device={device})")
+                func(clickTime, device)
 
             # --- Toggle del sistema de irrigado ---
             elif action == 'toggle_irrigation':
-                print(f"\tCall {func}()")
-                func()
+                print(f"\tCall {func}(device={device})")
+                func(clickTime, device)
 
             # --- Actualización de la temperatura deseada ---
             elif action == 'update_temperature':
                 temp = float(json_obj.get('targetTemp', 25))
-                print(f"\tCall {func}(temp={temp})")
-                func(temp)
+                print(f"\tCall {func}(temp={temp},device={device})")
+                func(temp, clickTime, device)
 
             # --- Añadir alarma de irrigación ---
             elif action == 'add_irrigation_alarm':
                 hour = float(json_obj.get('hour', 0))
                 minute = float(json_obj.get('minute', 0))
-                print(f"\tCall {func}(hour={hour},minute={minute})")
-                func(hour, minute)
+                print(f"\tCall {func}(hour={hour},minute={minute},device={device})")
+                func(hour, minute, device)
+
+            # --- Politica de reporte por excepcion de un canal ---
+            elif action == 'update_report_policy':
+                channel = json_obj.get('channel', '')
+                deadband = float(json_obj.get('deadband', 0))
+                maxSilence = float(json_obj.get('maxSilence', 60))
+                print(f"\tCall {func}(channel={channel},deadband={deadband},maxSilence={maxSilence},device={device})")
+                func(channel, deadband, maxSilence, clickTime, device)
+
+            elif action == 'update_telemetry_stream':
+                stream = json_obj.get('stream', '')
+                window = int(json_obj.get('window') or 0)
+                print(f"\tCall {func}(stream={stream},window={window},device={device})")
+                func(stream, window, clickTime, device)
+
+            # --- Modo completo (varias funciones en un solo lote) ---
+            elif action == 'apply_preset':
+                preset = json_obj.get('preset', '')
+                print(f"\tCall {func}(preset={preset},device={device})")
+                func(preset, clickTime, device)
 
     # -------------------- GET --------------------
     def do_GET(self):
@@ -116,20 +167,59 @@ class WebServer(BaseHTTPRequestHandler):
             self._serve_ui_file()
             return
 
-        # API para listar imágenes
-        if self.path.startswith('/api/images/'):
-            folder = self.path.split('/')[-1]
-            base_dir = os.path.join(BASE_DIR, "Status", folder)
-            if not os.path.isdir(base_dir):
-                self.send_error(404, f"Folder not found: {folder}")
-                return
+        # API para consultar latencias de comandos
+        if self.path == '/api/latency':
+            self._serve_json(latencySnapshot())
+            return
 
-            images = [
-                f"/Status/{folder}/{f}"
-                for f in os.listdir(base_dir)
-                if f.lower().endswith(('.png', '.jpg', '.jpeg', '.gif'))
-            ]
-            self._serve_json(images)
+        # API para consultar los dispositivos conectados y su actividad
+        if self.path == '/api/devices':
+            self._serve_json(sessionSummaries())
+            return
+
+        # API para consultar perdidas de la telemetria UDP por dispositivo
+        if self.path == '/api/udp':
+            self._serve_json(udpTelemetryStats())
+            return
+
+        # API para consultar los logs de los dispositivos (?device=&level=&tag=&limit=)
+        if self.path.startswith('/api/devicelogs'):
+            query = parse_qs(urlparse(self.path).query)
+            try:
+                limit = int(query.get('limit', ['200'])[0])
+            except ValueError:
+                limit = 200
+            self._serve_json(queryDeviceLogs(query.get('device', [None])[0],
+                                             query.get('level', [None])[0],
+                                             query.get('tag', [None])[0],
+                                             limit))
+            return
+
+        # API para listar los dispositivos con series guardadas (conectados o no)
+        if self.path == '/api/series/devices':
+            self._serve_json(seriesDevices())
+            return
+
+        # API para consultar una serie (?device=&channel=&from=&to=&points=&mode=&format=), from y to
+        # en segundos unix (por defecto la ultima hora), mode minmax o lttb, format json o bin
+        if self.path.startswith('/api/series'):
+            query = parse_qs(urlparse(self.path).query)
+            try:
+                start = query.get('from', [None])[0]
+                end = query.get('to', [None])[0]
+                result = querySeriesPoints(query.get('device', [''])[0],
+                                           query.get('channel', [''])[0],
+                                           int(float(start) * 1e9) if start else None,
+                                           int(float(end) * 1e9) if end else None,
+                                           int(query.get('points', [DEFAULT_POINTS])[0]),
+                                           query.get('mode', ['minmax'])[0])
+            except (ValueError, QueryError) as e:
+                self.send_error(400, str(e))
+                return
+            if query.get('format', ['json'])[0] == 'bin':
+                self._serve_series(result)
+            else:
+                self._serve_json(result)
             return
 
         # API para leer log
@@ -151,13 +241,14 @@ class WebServer(BaseHTTPRequestHandler):
 
     # -------------------- POST --------------------
     def do_POST(self):
+        clickTime = time.time()
         content_length = int(self.headers.get('Content-Length', 0))
         if content_length < 1:
             return
         post_data = self.rfile.read(content_length)
         try:
             jobj = json.loads(post_data.decode("utf-8"))
-            self._parse_post(jobj)
+            self._parse_post(jobj, clickTime)
         except Exception:
             print(sys.exc_info())
             print("Datos POST no reconocidos")
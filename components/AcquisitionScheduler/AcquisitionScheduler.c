@@ -0,0 +1,115 @@
+/**
+ *************************************
+ * @file: AcquisitionScheduler.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+#include "AcquisitionScheduler.h"
+
+static const char *ACQ_TAG = "Acquisition";
+
+
+// @brief Period in whole ticks, at least one
+static uint32_t _toTicks(const AcquisitionScheduler *scheduler, uint32_t period_ms){
+	uint32_t ticks = (period_ms + scheduler->tick_ms / 2) / scheduler->tick_ms;
+	return (ticks == 0) ? 1 : ticks;
+}
+
+// @brief Timer callback: only wakes the acquisition task, sensors are never read in the timer task
+static void _tickCallback(void *arg){
+	AcquisitionScheduler *scheduler = arg;
+	xTaskNotifyGive(scheduler->task);
+}
+
+// @brief Reads every source due at tick, all of them with the timestamp of the tick
+static void _runTick(AcquisitionScheduler *scheduler, uint32_t tick){
+	int64_t sampleTime = scheduler->start_ms + (int64_t)tick * scheduler->tick_ms;
+	uint32_t sampled = 0;
+	for(size_t i = 0; i < scheduler->count; ++i){
+		AcquisitionSource *source = &scheduler->sources[i];
+		// Signed difference so a tick counter wrap does not stop the source
+		if((int32_t)(tick - source->nextTick) < 0)
+			continue;
+		uint32_t period = source->read(source->context, sampleTime);
+		if(period > 0)
+			source->periodTicks = _toTicks(scheduler, period);
+		source->nextTick = tick + source->periodTicks;
+		sampled |= 1u << i;
+	}
+	if(sampled && scheduler->onTick)
+		scheduler->onTick(sampled, sampleTime);
+}
+
+static void _acquisitionTask(void *pvParameters){
+	AcquisitionScheduler *scheduler = pvParameters;
+	while(true){
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		// Tick derived from time, so a late wake up (or a slow sensor) skips ticks instead of piling them up
+		int64_t now = esp_timer_get_time() / 1000;
+		uint32_t tick = (uint32_t)((now - scheduler->start_ms + scheduler->tick_ms / 2) / scheduler->tick_ms);
+		_runTick(scheduler, tick);
+	}
+}
+
+
+esp_err_t acquisitionSchedulerInit(AcquisitionScheduler *scheduler, uint32_t tick_ms, AcquisitionTickDone onTick){
+	if(NULL == scheduler || 0 == tick_ms)
+		return ESP_ERR_INVALID_ARG;
+	*scheduler = (AcquisitionScheduler){
+		.tick_ms = tick_ms,
+		.onTick = onTick,
+	};
+	return ESP_OK;
+}
+
+
+esp_err_t acquisitionSchedulerAdd(AcquisitionScheduler *scheduler, AcquisitionRead read, void *context,
+                                  uint32_t period_ms, uint32_t phase_ms){
+	if(NULL == scheduler || NULL == read)
+		return ESP_ERR_INVALID_ARG;
+	if(NULL != scheduler->task)
+		return ESP_ERR_INVALID_STATE;
+	if(scheduler->count >= ACQUISITION_MAX_SOURCES)
+		return ESP_ERR_NO_MEM;
+	scheduler->sources[scheduler->count++] = (AcquisitionSource){
+		.read = read,
+		.context = context,
+		.periodTicks = _toTicks(scheduler, period_ms),
+		.nextTick = (phase_ms + scheduler->tick_ms / 2) / scheduler->tick_ms,
+	};
+	return ESP_OK;
+}
+
+
+esp_err_t acquisitionSchedulerStart(AcquisitionScheduler *scheduler, uint32_t stackSize, UBaseType_t priority, BaseType_t coreID){
+	if(NULL == scheduler || NULL != scheduler->task || 0 == scheduler->count)
+		return ESP_ERR_INVALID_STATE;
+
+	scheduler->start_ms = esp_timer_get_time() / 1000;
+	if(pdPASS != xTaskCreatePinnedToCore(_acquisitionTask, "Acquisition", stackSize, scheduler, priority, &scheduler->task, coreID)){
+		ESP_LOGE(ACQ_TAG, "Cannot create acquisition task");
+		return ESP_ERR_NO_MEM;
+	}
+
+	const esp_timer_create_args_t timerArgs = {
+		.callback = _tickCallback,
+		.arg = scheduler,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "acquisition",
+	};
+	esp_err_t err = esp_timer_create(&timerArgs, &scheduler->timer);
+	if(ESP_OK == err)
+		err = esp_timer_start_periodic(scheduler->timer, (uint64_t)scheduler->tick_ms * 1000);
+	if(ESP_OK != err){
+		ESP_LOGE(ACQ_TAG, "Cannot start tick timer: %s", esp_err_to_name(err));
+		vTaskDelete(scheduler->task);
+		scheduler->task = NULL;
+		return err;
+	}
+	// First tick (phase 0 sources) right away instead of one tick later
+	xTaskNotifyGive(scheduler->task);
+	ESP_LOGI(ACQ_TAG, "%u sensores cada %" PRIu32 " ms", (unsigned)scheduler->count, scheduler->tick_ms);
+	return ESP_OK;
+}
@@ -0,0 +1,102 @@
+/**
+ *************************************
+ * @file: AcquisitionScheduler.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * Single task that samples every sensor on a common time grid. An esp_timer wakes the task once
+ * per tick and every source whose period (and phase) falls on that tick is read in the same pass
+ * with the same timestamp, so readings of different sensors taken together are time coherent.
+ */
+#define ACQUISITION_MAX_SOURCES 8
+
+/**
+ * Reads a sensor. Returns the period until its next reading in ms (rounded to whole ticks),
+ * 0 keeps the current period.
+ */
+typedef uint32_t (*AcquisitionRead)(void *context, int64_t sampleTime_ms);
+
+/**
+ * Called after every tick in which at least one source was read. Bit i of sampledMask is set if
+ * source i (in the order they were added) was read.
+ */
+typedef void (*AcquisitionTickDone)(uint32_t sampledMask, int64_t sampleTime_ms);
+
+typedef struct{
+	AcquisitionRead read;
+	void *context;
+	uint32_t periodTicks;
+	uint32_t nextTick;
+}AcquisitionSource;
+
+typedef struct{
+	AcquisitionSource sources[ACQUISITION_MAX_SOURCES];
+	size_t count;
+	uint32_t tick_ms;
+	int64_t start_ms;
+	AcquisitionTickDone onTick;
+	esp_timer_handle_t timer;
+	TaskHandle_t task;
+}AcquisitionScheduler;
+
+/**
+ * @brief      Sets the tick of the time grid
+ *
+ * @param      scheduler  Scheduler
+ * @param[in]  tick_ms    Grid resolution, sensor periods are multiples of it
+ * @param[in]  onTick     Called after the sources of a tick are read (can be NULL)
+ *
+ * @return
+ * - ESP_OK Scheduler configured
+ * - ESP_ERR_INVALID_ARG NULL scheduler or zero tick
+ */
+esp_err_t acquisitionSchedulerInit(AcquisitionScheduler *scheduler, uint32_t tick_ms, AcquisitionTickDone onTick);
+
+/**
+ * @brief      Adds a sensor to the table
+ *
+ * @param      scheduler  Scheduler
+ * @param[in]  read       Reads the sensor and returns its next period
+ * @param      context    Passed to read
+ * @param[in]  period_ms  Initial period
+ * @param[in]  phase_ms   Offset of first reading, sources with equal period and phase are always read together
+ *
+ * @return
+ * - ESP_OK Source added
+ * - ESP_ERR_INVALID_ARG NULL parameter
+ * - ESP_ERR_NO_MEM Table is full (ACQUISITION_MAX_SOURCES)
+ * - ESP_ERR_INVALID_STATE Scheduler already started
+ */
+esp_err_t acquisitionSchedulerAdd(AcquisitionScheduler *scheduler, AcquisitionRead read, void *context,
+                                  uint32_t period_ms, uint32_t phase_ms);
+
+/**
+ * @brief      Creates the acquisition task and starts the tick timer
+ *
+ * @param      scheduler  Scheduler
+ * @param[in]  stackSize  Stack of the task, must fit the deepest read callback
+ * @param[in]  priority   Priority of the task
+ * @param[in]  coreID     Core of the task
+ *
+ * @return
+ * - ESP_OK Scheduler running
+ * - ESP_ERR_INVALID_STATE Already started or no sources
+ * - ESP_ERR_NO_MEM Task could not be created
+ * - Error returned by esp_timer otherwise
+ */
+esp_err_t acquisitionSchedulerStart(AcquisitionScheduler *scheduler, uint32_t stackSize, UBaseType_t priority, BaseType_t coreID);
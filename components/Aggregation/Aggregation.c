@@ -0,0 +1,62 @@
+/**
+ *************************************
+ * @file: Aggregation.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "Aggregation.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+void aggregatorConfig(WindowAggregator *agg, uint32_t window_ms, int64_t now_ms){
+	if(NULL == agg)
+		return;
+	memset(agg->channels, 0, sizeof(agg->channels));
+	agg->window_ms = window_ms;
+	agg->windowStart_ms = now_ms;
+}
+
+void aggregatorAdd(WindowAggregator *agg, int channel, float value){
+	if(NULL == agg || channel < 0 || channel >= AGGREGATION_CHANNELS || isnan(value))
+		return;
+
+	WelfordAccumulator *acc = &agg->channels[channel];
+	acc->count++;
+	if(1 == acc->count){
+		acc->min = value;
+		acc->max = value;
+	}
+	else if(value < acc->min)
+		acc->min = value;
+	else if(value > acc->max)
+		acc->max = value;
+	float delta = value - acc->mean;
+	acc->mean += delta / acc->count;
+	acc->m2 += delta * (value - acc->mean);
+}
+
+bool aggregatorWindowElapsed(const WindowAggregator *agg, int64_t now_ms){
+	return NULL != agg && now_ms - agg->windowStart_ms >= agg->window_ms;
+}
+
+uint32_t aggregatorClose(WindowAggregator *agg, ChannelSummary summaries[AGGREGATION_CHANNELS], int64_t now_ms){
+	if(NULL == agg || NULL == summaries)
+		return 0;
+
+	for(int ch = 0; ch < AGGREGATION_CHANNELS; ++ch){
+		const WelfordAccumulator *acc = &agg->channels[ch];
+		summaries[ch].count = acc->count;
+		summaries[ch].mean = acc->mean;
+		summaries[ch].min = acc->min;
+		summaries[ch].max = acc->max;
+		// Sample standard deviation, a single sample has no spread
+		summaries[ch].stddev = (acc->count > 1) ? sqrtf(acc->m2 / (acc->count - 1)) : 0.0f;
+	}
+	uint32_t duration = (uint32_t)(now_ms - agg->windowStart_ms);
+	aggregatorConfig(agg, agg->window_ms, now_ms);
+	return duration;
+}
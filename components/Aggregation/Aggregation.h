@@ -0,0 +1,77 @@
+/**
+ *************************************
+ * @file: Aggregation.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define AGGREGATION_CHANNELS 3
+
+// Running statistics of one channel (Welford), m2 is the sum of squared differences from the mean
+typedef struct{
+	uint32_t count;
+	float mean;
+	float m2;
+	float min;
+	float max;
+}WelfordAccumulator;
+
+typedef struct{
+	uint32_t count;
+	float mean;
+	float min;
+	float max;
+	float stddev;
+}ChannelSummary;
+
+typedef struct{
+	WelfordAccumulator channels[AGGREGATION_CHANNELS];
+	uint32_t window_ms;
+	int64_t windowStart_ms;
+}WindowAggregator;
+
+/**
+ * @brief      Sets the window length and starts a new empty window
+ *
+ * @param      agg        Aggregator
+ * @param[in]  window_ms  Window length
+ * @param[in]  now_ms     Current time in ms (monotonic)
+ */
+void aggregatorConfig(WindowAggregator *agg, uint32_t window_ms, int64_t now_ms);
+
+/**
+ * @brief      Adds a sample of one channel to the current window in O(1)
+ *
+ * @param      agg      Aggregator
+ * @param[in]  channel  Channel [0, AGGREGATION_CHANNELS)
+ * @param[in]  value    Sample
+ */
+void aggregatorAdd(WindowAggregator *agg, int channel, float value);
+
+/**
+ * @brief      Checks if the current window is complete
+ *
+ * @param[in]  agg     Aggregator
+ * @param[in]  now_ms  Current time in ms
+ *
+ * @return     true if window_ms elapsed since the window started
+ */
+bool aggregatorWindowElapsed(const WindowAggregator *agg, int64_t now_ms);
+
+/**
+ * @brief      Closes the current window and starts the next one
+ *
+ * @param      agg        Aggregator
+ * @param[out] summaries  Statistics of every channel (count 0 if a channel had no samples)
+ * @param[in]  now_ms     Current time in ms
+ *
+ * @return     Duration of the closed window in ms
+ */
+uint32_t aggregatorClose(WindowAggregator *agg, ChannelSummary summaries[AGGREGATION_CHANNELS], int64_t now_ms);
@@ -0,0 +1,93 @@
+/**
+ *************************************
+ * @file: ControlState.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "ControlState.h"
+#include <math.h>
+#include <string.h>
+
+static const char *CS_TAG = "ControlState";
+
+static nvs_handle_t _stateHandle = 0;
+static bool _initialized = false;
+static ControlState _lastSaved;
+static bool _hasLastSaved = false;
+static int64_t _lastWriteTime_ms = 0;
+static uint32_t _writeCount = 0;
+
+esp_err_t controlStateInit(){
+	esp_err_t E = nvs_open(CONTROL_STATE_NAMESPACE, NVS_READWRITE, &_stateHandle);
+	if(E){
+		ESP_LOGE(CS_TAG, "Cannot open NVS namespace: %s", esp_err_to_name(E));
+		return E;
+	}
+	_initialized = true;
+	return ESP_OK;
+}
+
+esp_err_t controlStateLoad(ControlState *state){
+	if(!_initialized || NULL == state)
+		return ESP_ERR_INVALID_STATE;
+
+	size_t length = sizeof(ControlState);
+	esp_err_t E = nvs_get_blob(_stateHandle, CONTROL_STATE_KEY, state, &length);
+	if(E)
+		return E;
+	if(length != sizeof(ControlState) || state->version != CONTROL_STATE_VERSION){
+		ESP_LOGI(CS_TAG, "Persisted state has another layout, ignoring it");
+		return ESP_ERR_INVALID_VERSION;
+	}
+	_lastSaved = *state;
+	_hasLastSaved = true;
+	return ESP_OK;
+}
+
+/**
+ * @brief      Checks if settings other than the integrator differ between two states
+ */
+static bool _settingsChanged(const ControlState *a, const ControlState *b){
+	return a->desiredTemperature != b->desiredTemperature ||
+		a->Kp != b->Kp || a->Ki != b->Ki || a->Kd != b->Kd ||
+		a->fanDuty != b->fanDuty || a->fanManual != b->fanManual ||
+		a->irrigation != b->irrigation;
+}
+
+esp_err_t controlStateSave(const ControlState *state){
+	if(!_initialized || NULL == state)
+		return ESP_ERR_INVALID_STATE;
+
+	int64_t now = esp_timer_get_time() / 1000;
+	int64_t sinceLastWrite = now - _lastWriteTime_ms;
+	bool mustWrite;
+	if(!_hasLastSaved || _settingsChanged(state, &_lastSaved))
+		mustWrite = sinceLastWrite >= CONTROL_STATE_MIN_WRITE_INTERVAL_MS || !_hasLastSaved;
+	else
+		mustWrite = sinceLastWrite >= CONTROL_STATE_INTEGRAL_WRITE_INTERVAL_MS &&
+			fabsf(state->integral - _lastSaved.integral) > CONTROL_STATE_INTEGRAL_EPSILON;
+	if(!mustWrite)
+		return ESP_OK;
+
+	ControlState toWrite = *state;
+	toWrite.version = CONTROL_STATE_VERSION;
+	esp_err_t E = nvs_set_blob(_stateHandle, CONTROL_STATE_KEY, &toWrite, sizeof(ControlState));
+	if(ESP_OK == E)
+		E = nvs_commit(_stateHandle);
+	if(E){
+		ESP_LOGE(CS_TAG, "Cannot persist state: %s", esp_err_to_name(E));
+		return E;
+	}
+	_lastSaved = toWrite;
+	_hasLastSaved = true;
+	_lastWriteTime_ms = now;
+	_writeCount++;
+	return ESP_OK;
+}
+
+uint32_t controlStateWriteCount(){
+	return _writeCount;
+}
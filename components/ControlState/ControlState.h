@@ -0,0 +1,85 @@
+/**
+ *************************************
+ * @file: ControlState.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+
+#define CONTROL_STATE_NAMESPACE "ctrl_state"
+#define CONTROL_STATE_KEY "snapshot"
+#define CONTROL_STATE_VERSION 2
+#define CONTROL_STATE_MIN_WRITE_INTERVAL_MS 10000
+#define CONTROL_STATE_INTEGRAL_WRITE_INTERVAL_MS 300000
+#define CONTROL_STATE_INTEGRAL_EPSILON 0.01f
+
+typedef struct{
+	uint32_t version;
+	float desiredTemperature;
+	float Kp;
+	float Ki;
+	float Kd;
+	float integral;
+	float fanDuty;
+	bool fanManual;
+	bool irrigation;
+}ControlState;
+
+/**
+ * @brief      Opens the NVS namespace used to persist controller state
+ *
+ * @return
+ * - ESP_OK Success
+ * - Error returned by nvs_open otherwise
+ * @warning nvs_flash_init must be called before
+ */
+esp_err_t controlStateInit();
+
+/**
+ * @brief      Loads last persisted controller state
+ *
+ * @param[out] state  Restored state
+ *
+ * @return
+ * - ESP_OK State was restored
+ * - ESP_ERR_NVS_NOT_FOUND No state was persisted yet
+ * - ESP_ERR_INVALID_VERSION Persisted state belongs to another firmware layout
+ * - ESP_ERR_INVALID_STATE controlStateInit was not called
+ */
+esp_err_t controlStateLoad(ControlState *state);
+
+/**
+ * @brief      Persists controller state if rate limits allow it
+ *
+ * Settings (setpoint, gains, fan mode and duty, irrigation) are written at most once every
+ * CONTROL_STATE_MIN_WRITE_INTERVAL_MS. A change only in the PID integrator is written at most once every
+ * CONTROL_STATE_INTEGRAL_WRITE_INTERVAL_MS and only if it moved more than CONTROL_STATE_INTEGRAL_EPSILON.
+ * Unchanged states are never written. Deferred changes are written by a later call, so this
+ * function must be called periodically.
+ *
+ * @param[in]  state  Current controller state
+ *
+ * @return
+ * - ESP_OK State was written or nothing had to be written yet
+ * - ESP_ERR_INVALID_STATE controlStateInit was not called
+ * - Error returned by NVS otherwise
+ */
+esp_err_t controlStateSave(const ControlState *state);
+
+/**
+ * @brief      Gets the number of NVS writes done since boot
+ *
+ * @return     Number of writes
+ */
+uint32_t controlStateWriteCount();
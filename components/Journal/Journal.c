@@ -0,0 +1,334 @@
+/**
+ *************************************
+ * @file: Journal.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "Journal.h"
+#include "esp_littlefs.h"
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *JOURNAL_TAG = "Journal";
+
+static SemaphoreHandle_t _journalMutex = NULL;
+static uint32_t _oldestSegment = 0;
+static uint32_t _currentSegment = 0;
+static size_t _currentCount = 0;
+static JournalRecord _buffer[JOURNAL_FLUSH_RECORDS];
+static size_t _buffered = 0;
+static uint16_t _bootCount = 0;
+
+/**
+ * @brief      Builds the file path of a segment
+ */
+static void _segmentPath(uint32_t segment, char path[], size_t len){
+	snprintf(path, len, JOURNAL_BASE_PATH "/%08" PRIu32 JOURNAL_SEGMENT_EXTENSION, segment);
+}
+
+/**
+ * @brief      Computes the checksum of a record (inverted sum so an erased or zeroed record is invalid)
+ */
+static uint8_t _recordChecksum(const JournalRecord *record){
+	const uint8_t *bytes = (const uint8_t *)record;
+	uint8_t sum = 0;
+	for(size_t i = 0; i < offsetof(JournalRecord, checksum); ++i)
+		sum += bytes[i];
+	return ~sum;
+}
+
+/**
+ * @brief      Discards the oldest closed segment
+ *
+ * @return     false if there is no closed segment left
+ *
+ * @warning    Journal mutex must be held
+ */
+static bool _discardOldestSegment(){
+	if(_oldestSegment >= _currentSegment)
+		return false;
+	char path[32];
+	_segmentPath(_oldestSegment, path, sizeof(path));
+	remove(path);
+	ESP_LOGW(JOURNAL_TAG, "Journal full, segment %" PRIu32 " discarded", _oldestSegment);
+	_oldestSegment++;
+	return true;
+}
+
+/**
+ * @brief      Discards oldest segments until the journal fits in JOURNAL_MAX_SEGMENTS
+ *
+ * @warning    Journal mutex must be held
+ */
+static void _enforceMaxSegments(){
+	while(_currentSegment - _oldestSegment >= JOURNAL_MAX_SEGMENTS)
+		_discardOldestSegment();
+}
+
+/**
+ * @brief      Tells if a failed write was caused by the partition running out of room
+ */
+static bool _partitionFull(int error){
+	if(ENOSPC == error)
+		return true;
+	size_t total = 0, used = 0;
+	return ESP_OK == esp_littlefs_info(JOURNAL_PARTITION_LABEL, &total, &used) && used >= total;
+}
+
+/**
+ * @brief      Writes buffered records at the end of the current segment. A failed write is cut
+ *             back to whole records so the segment never ends with a torn one
+ *
+ * @return
+ * - ESP_OK Every buffered record was written
+ * - ESP_ERR_NO_MEM The partition has no room
+ * - ESP_FAIL Any other write error
+ *
+ * @warning    Journal mutex must be held
+ */
+static esp_err_t _flush(){
+	if(0 == _buffered)
+		return ESP_OK;
+
+	char path[32];
+	_segmentPath(_currentSegment, path, sizeof(path));
+	errno = 0;
+	FILE *f = fopen(path, "ab");
+	if(NULL == f){
+		int error = errno;
+		ESP_LOGE(JOURNAL_TAG, "Cannot open %s: %s", path, strerror(error));
+		return _partitionFull(error) ? ESP_ERR_NO_MEM : ESP_FAIL;
+	}
+	size_t written = fwrite(_buffer, sizeof(JournalRecord), _buffered, f);
+	if(written != _buffered){
+		// Records that made it stay, the rest are retried
+		int error = errno;
+		fflush(f);
+		ftruncate(fileno(f), (_currentCount + written) * sizeof(JournalRecord));
+		fclose(f);
+		ESP_LOGE(JOURNAL_TAG, "Short write in %s: %s", path, strerror(error));
+		_currentCount += written;
+		_buffered -= written;
+		memmove(_buffer, _buffer + written, _buffered * sizeof(JournalRecord));
+		return _partitionFull(error) ? ESP_ERR_NO_MEM : ESP_FAIL;
+	}
+	fclose(f);
+	_currentCount += _buffered;
+	_buffered = 0;
+	if(_currentCount >= JOURNAL_RECORDS_PER_SEGMENT){
+		_currentSegment++;
+		_currentCount = 0;
+		_enforceMaxSegments();
+	}
+	return ESP_OK;
+}
+
+/**
+ * @brief      Reads the boot counter from NVS and stores the next one
+ */
+static void _countBoot(){
+	nvs_handle_t handle;
+	esp_err_t E = nvs_open(JOURNAL_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if(ESP_OK == E){
+		uint16_t previous = 0;
+		nvs_get_u16(handle, JOURNAL_BOOT_KEY, &previous);
+		_bootCount = previous + 1;
+		E = nvs_set_u16(handle, JOURNAL_BOOT_KEY, _bootCount);
+		if(ESP_OK == E)
+			E = nvs_commit(handle);
+		nvs_close(handle);
+	}
+	if(ESP_OK != E)
+		ESP_LOGE(JOURNAL_TAG, "Cannot count boot: %s", esp_err_to_name(E));
+}
+
+esp_err_t journalInit(){
+	_countBoot();
+	esp_vfs_littlefs_conf_t conf = {
+		.base_path = JOURNAL_BASE_PATH,
+		.partition_label = JOURNAL_PARTITION_LABEL,
+		.format_if_mount_failed = true,
+		.dont_mount = false,
+	};
+	esp_err_t E = esp_vfs_littlefs_register(&conf);
+	if(E){
+		ESP_LOGE(JOURNAL_TAG, "Cannot mount LittleFS: %s", esp_err_to_name(E));
+		return E;
+	}
+
+	// Segments are numbered consecutively, the ones found on boot are all closed
+	uint32_t minSegment = UINT32_MAX;
+	uint32_t maxSegment = 0;
+	bool found = false;
+	DIR *dir = opendir(JOURNAL_BASE_PATH);
+	if(dir){
+		struct dirent *entry;
+		while(NULL != (entry = readdir(dir))){
+			char *end;
+			uint32_t segment = strtoul(entry->d_name, &end, 10);
+			if(end == entry->d_name || 0 != strcmp(end, JOURNAL_SEGMENT_EXTENSION))
+				continue;
+			found = true;
+			if(segment < minSegment)
+				minSegment = segment;
+			if(segment > maxSegment)
+				maxSegment = segment;
+		}
+		closedir(dir);
+	}
+	_currentSegment = found ? maxSegment + 1 : 0;
+	_oldestSegment = found ? minSegment : _currentSegment;
+	_currentCount = 0;
+	_buffered = 0;
+
+	_journalMutex = xSemaphoreCreateMutex();
+	if(NULL == _journalMutex)
+		return ESP_ERR_NO_MEM;
+
+	size_t total = 0, used = 0;
+	esp_littlefs_info(JOURNAL_PARTITION_LABEL, &total, &used);
+	ESP_LOGI(JOURNAL_TAG, "Journal mounted, boot %u, %" PRIu32 " pending segments, %u/%u bytes used",
+		_bootCount, _currentSegment - _oldestSegment, (unsigned)used, (unsigned)total);
+	return ESP_OK;
+}
+
+uint16_t journalBootCount(){
+	return _bootCount;
+}
+
+void journalBuildRecord(JournalRecord *record, int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp){
+	if(NULL == record)
+		return;
+
+	time_t now = time(NULL);
+	if(now >= JOURNAL_MIN_VALID_EPOCH){
+		// Sample age is taken from the monotonic clock, a batch journaled late keeps its own times
+		int64_t age_ms = esp_timer_get_time() / 1000 - sampleTime_ms;
+		record->timestamp = (uint32_t)(now - ((age_ms > 0) ? age_ms / 1000 : 0));
+		record->flags = 0;
+	}
+	else{
+		record->timestamp = (uint32_t)(sampleTime_ms / 1000);
+		record->flags = JOURNAL_FLAG_UPTIME;
+	}
+	record->LM135Temp = (int16_t)lroundf(LM135Temp * 10.0f);
+	record->AM2302Temp = (int16_t)lroundf(AM2302Temp * 10.0f);
+	record->AM2302Hum = (uint16_t)lroundf(AM2302Hum * 10.0f);
+	record->boot = _bootCount;
+	record->checksum = _recordChecksum(record);
+}
+
+bool journalRecordIsValid(const JournalRecord *record){
+	return NULL != record && record->checksum == _recordChecksum(record);
+}
+
+esp_err_t journalAppend(const JournalRecord *record){
+	if(NULL == _journalMutex || NULL == record)
+		return ESP_ERR_INVALID_STATE;
+
+	esp_err_t E = ESP_OK;
+	xSemaphoreTake(_journalMutex, portMAX_DELAY);
+	_buffer[_buffered++] = *record;
+	if(JOURNAL_FLUSH_RECORDS == _buffered){
+		E = _flush();
+		// Partition full before JOURNAL_MAX_SEGMENTS: the oldest segment makes room for the new records.
+		// One per append, any other error keeps the backlog and is returned
+		if(ESP_ERR_NO_MEM == E && _discardOldestSegment())
+			E = _flush();
+	}
+	if(JOURNAL_FLUSH_RECORDS == _buffered){
+		// Still not written: the oldest buffered record goes so the buffer keeps the newest ones
+		memmove(_buffer, _buffer + 1, (JOURNAL_FLUSH_RECORDS - 1) * sizeof(JournalRecord));
+		_buffered--;
+	}
+	xSemaphoreGive(_journalMutex);
+	return E;
+}
+
+esp_err_t journalSeal(){
+	if(NULL == _journalMutex)
+		return ESP_ERR_INVALID_STATE;
+
+	xSemaphoreTake(_journalMutex, portMAX_DELAY);
+	esp_err_t E = _flush();
+	if(ESP_OK == E && _currentCount > 0){
+		_currentSegment++;
+		_currentCount = 0;
+		_enforceMaxSegments();
+	}
+	xSemaphoreGive(_journalMutex);
+	return E;
+}
+
+uint32_t journalOldestSegment(){
+	if(NULL == _journalMutex)
+		return JOURNAL_NO_SEGMENT;
+
+	char path[32];
+	struct stat st;
+	uint32_t segment = JOURNAL_NO_SEGMENT;
+	xSemaphoreTake(_journalMutex, portMAX_DELAY);
+	while(_oldestSegment < _currentSegment){
+		_segmentPath(_oldestSegment, path, sizeof(path));
+		if(0 == stat(path, &st)){
+			segment = _oldestSegment;
+			break;
+		}
+		_oldestSegment++;
+	}
+	xSemaphoreGive(_journalMutex);
+	return segment;
+}
+
+esp_err_t journalReadSegment(uint32_t segment, size_t offset, JournalRecord *records, size_t maxRecords, size_t *count){
+	if(NULL == _journalMutex || NULL == records || NULL == count)
+		return ESP_ERR_INVALID_STATE;
+
+	char path[32];
+	_segmentPath(segment, path, sizeof(path));
+	*count = 0;
+	xSemaphoreTake(_journalMutex, portMAX_DELAY);
+	FILE *f = fopen(path, "rb");
+	if(NULL == f){
+		xSemaphoreGive(_journalMutex);
+		return ESP_ERR_NOT_FOUND;
+	}
+	fseek(f, offset * sizeof(JournalRecord), SEEK_SET);
+	size_t read = fread(records, sizeof(JournalRecord), maxRecords, f);
+	fclose(f);
+	xSemaphoreGive(_journalMutex);
+
+	*count = read;
+	return ESP_OK;
+}
+
+esp_err_t journalDeleteSegment(uint32_t segment){
+	if(NULL == _journalMutex)
+		return ESP_ERR_INVALID_STATE;
+
+	char path[32];
+	esp_err_t E = ESP_OK;
+	xSemaphoreTake(_journalMutex, portMAX_DELAY);
+	if(segment >= _currentSegment){
+		E = ESP_ERR_INVALID_ARG;
+	}
+	else{
+		_segmentPath(segment, path, sizeof(path));
+		remove(path);
+		if(segment == _oldestSegment)
+			_oldestSegment++;
+	}
+	xSemaphoreGive(_journalMutex);
+	return E;
+}
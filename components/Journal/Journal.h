@@ -0,0 +1,149 @@
+/**
+ *************************************
+ * @file: Journal.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+
+
+#define JOURNAL_PARTITION_LABEL "journal"
+#define JOURNAL_BASE_PATH "/journal"
+#define JOURNAL_RECORDS_PER_SEGMENT 512
+#define JOURNAL_MAX_SEGMENTS 256
+#define JOURNAL_FLUSH_RECORDS 16
+#define JOURNAL_MIN_VALID_EPOCH 1700000000
+#define JOURNAL_FLAG_UPTIME (1 << 0)
+#define JOURNAL_NO_SEGMENT UINT32_MAX
+#define JOURNAL_SEGMENT_EXTENSION ".jrn"
+#define JOURNAL_NVS_NAMESPACE "journal"
+#define JOURNAL_BOOT_KEY "boot"
+
+/**
+ * One sample stored in flash. Values use fixed point (0.1 °C / 0.1 %RH).
+ * If JOURNAL_FLAG_UPTIME is set, timestamp is seconds since boot because the clock was not synchronized,
+ * and it only means something to the server if boot is the boot of the session replaying it.
+ */
+typedef struct __attribute__((packed)){
+	uint32_t timestamp;
+	int16_t LM135Temp;
+	int16_t AM2302Temp;
+	uint16_t AM2302Hum;
+	uint16_t boot;
+	uint8_t flags;
+	uint8_t checksum;
+}JournalRecord;
+
+/**
+ * @brief      Mounts the LittleFS journal partition, finds existing segments and counts this boot.
+ *             NVS must be initialized.
+ *
+ * @return
+ * - ESP_OK Success
+ * - ESP_ERR_NOT_FOUND Journal partition does not exist in partition table
+ * - ESP_FAIL Partition could not be mounted nor formatted
+ */
+esp_err_t journalInit();
+
+/**
+ * @brief      Boots counted by the journal (wraps at 65536), stored in every record
+ *
+ * @return     Counter of the current boot
+ */
+uint16_t journalBootCount();
+
+/**
+ * @brief      Builds a record from sensor values. The timestamp is the wall clock time of the sample
+ *             if the clock is synchronized, seconds since boot otherwise
+ *
+ * @param[out] record         Record to fill
+ * @param[in]  sampleTime_ms  When the sample was taken, ms since boot (esp_timer)
+ * @param[in]  LM135Temp      LM135 temperature
+ * @param[in]  AM2302Hum   AM2302 humidity
+ * @param[in]  AM2302Temp  AM2302 temperature
+ */
+void journalBuildRecord(JournalRecord *record, int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp);
+
+/**
+ * @brief      Checks the checksum of a record read from flash
+ *
+ * @param[in]  record  Record to check
+ *
+ * @return     true if record is not corrupted
+ */
+bool journalRecordIsValid(const JournalRecord *record);
+
+/**
+ * @brief      Appends a record to the journal
+ *
+ * @param[in]  record  Record to append
+ *
+ * @return
+ * - ESP_OK Success
+ * - ESP_ERR_INVALID_STATE Journal not initialized
+ * - ESP_ERR_NO_MEM Partition full even after discarding the oldest segment
+ * - ESP_FAIL Flash write failed, no segment was discarded
+ *
+ * @note Records are buffered in RAM and written JOURNAL_FLUSH_RECORDS at a time to reduce flash wear.
+ *       The journal is a ring: when JOURNAL_MAX_SEGMENTS are full the oldest segments are discarded,
+ *       and when the partition has no room the oldest one is discarded (at most one per call). If the
+ *       buffer still cannot be written, its oldest record is dropped so the newest ones are kept.
+ */
+esp_err_t journalAppend(const JournalRecord *record);
+
+/**
+ * @brief      Writes buffered records and closes the current segment so it can be replayed
+ *
+ * @return
+ * - ESP_OK Success
+ * - ESP_ERR_INVALID_STATE Journal not initialized
+ * - ESP_FAIL Flash write failed
+ */
+esp_err_t journalSeal();
+
+/**
+ * @brief      Gets the oldest closed segment
+ *
+ * @return     Segment number or JOURNAL_NO_SEGMENT if there is nothing to replay
+ */
+uint32_t journalOldestSegment();
+
+/**
+ * @brief      Reads records from a closed segment
+ *
+ * @param[in]  segment     Segment number
+ * @param[in]  offset      Index of first record to read
+ * @param[out] records     Where to store records
+ * @param[in]  maxRecords  Capacity of records
+ * @param[out] count       Number of records read, check each one with journalRecordIsValid
+ *
+ * @return
+ * - ESP_OK Success, count is 0 at end of segment
+ * - ESP_ERR_NOT_FOUND Segment does not exist
+ * - ESP_ERR_INVALID_STATE Journal not initialized
+ */
+esp_err_t journalReadSegment(uint32_t segment, size_t offset, JournalRecord *records, size_t maxRecords, size_t *count);
+
+/**
+ * @brief      Deletes a segment once the server acknowledged it
+ *
+ * @param[in]  segment  Segment number
+ *
+ * @return
+ * - ESP_OK Success
+ * - ESP_ERR_INVALID_ARG Segment is the one being written
+ * - ESP_ERR_INVALID_STATE Journal not initialized
+ */
+esp_err_t journalDeleteSegment(uint32_t segment);
@@ -0,0 +1,214 @@
+/**
+ *************************************
+ * @file: LogStream.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+#include "LogStream.h"
+
+#define _RING_MASK (LOG_STREAM_RING_SIZE - 1)
+#define _FORMAT_MAX_LEN (LOG_STREAM_LINE_MAX_LEN + LOG_STREAM_TAG_MAX_LEN + 32)
+
+_Static_assert((LOG_STREAM_RING_SIZE & _RING_MASK) == 0, "LOG_STREAM_RING_SIZE must be a power of two");
+
+/*
+ * Bounded multi producer ring: a slot is free for position pos when its sequence equals pos and
+ * holds a line for the reader when it equals pos + 1. Writers claim positions with a CAS on
+ * _writePos, so two tasks never write the same slot and none of them waits for the other.
+ */
+typedef struct{
+	atomic_uint sequence;
+	LogEntry entry;
+}_LogSlot;
+
+typedef struct{
+	char tag[LOG_STREAM_TAG_MAX_LEN];
+	uint8_t tokens;
+	int64_t lastRefill_ms;
+}_TagBudget;
+
+static _LogSlot _ring[LOG_STREAM_RING_SIZE];
+static atomic_uint _writePos;
+static atomic_uint _dropped;
+static unsigned int _readPos = 0;
+static uint32_t _suppressed = 0;
+static _TagBudget _budgets[LOG_STREAM_MAX_TAGS];
+static esp_log_level_t _minLevel = ESP_LOG_WARN;
+static vprintf_like_t _previousVprintf = NULL;
+
+
+// @brief Severity of a log level letter, unknown lines are considered informative
+static esp_log_level_t _levelOf(char level){
+	switch(level){
+		case 'E': return ESP_LOG_ERROR;
+		case 'W': return ESP_LOG_WARN;
+		case 'D': return ESP_LOG_DEBUG;
+		case 'V': return ESP_LOG_VERBOSE;
+		default: return ESP_LOG_INFO;
+	}
+}
+
+// @brief Skips an ANSI color sequence ("\033[0;31m") if line starts with one
+static const char *_skipColor(const char *p){
+	if(*p != '\033')
+		return p;
+	while(*p && *p != 'm')
+		p++;
+	return *p ? p + 1 : p;
+}
+
+/**
+ * @brief      Splits a formatted line "L (timestamp) tag: message" into entry
+ *
+ * @return     false if the line must not be streamed
+ */
+static bool _parseLine(const char *line, LogEntry *entry){
+	const char *p = _skipColor(line);
+	entry->tag[0] = '\0';
+	entry->level = 'I';
+	if(strchr("EWIDV", p[0]) && p[0] != '\0' && p[1] == ' ' && p[2] == '('){
+		entry->level = p[0];
+		const char *tagStart = strstr(p, ") ");
+		const char *tagEnd = tagStart ? strstr(tagStart + 2, ": ") : NULL;
+		if(tagEnd){
+			tagStart += 2;
+			size_t tagLen = tagEnd - tagStart;
+			if(tagLen >= LOG_STREAM_TAG_MAX_LEN)
+				tagLen = LOG_STREAM_TAG_MAX_LEN - 1;
+			memcpy(entry->tag, tagStart, tagLen);
+			entry->tag[tagLen] = '\0';
+			p = tagEnd + 2;
+		}
+	}
+	if(_levelOf(entry->level) > _minLevel)
+		return false;
+
+	size_t len = strnlen(p, LOG_STREAM_LINE_MAX_LEN - 1);
+	memcpy(entry->message, p, len);
+	entry->message[len] = '\0';
+	// Trailing newline and color reset
+	char *escape = strchr(entry->message, '\033');
+	if(escape)
+		*escape = '\0';
+	len = strlen(entry->message);
+	while(len > 0 && (entry->message[len - 1] == '\n' || entry->message[len - 1] == '\r'))
+		entry->message[--len] = '\0';
+	return len > 0;
+}
+
+/**
+ * @brief      Log hook: prints the line as before and copies it into the ring
+ *
+ * @note Runs in the task that logs. Only uses its stack and a CAS, a full ring drops the line
+ */
+static int _logHook(const char *format, va_list args){
+	char line[_FORMAT_MAX_LEN];
+	va_list copy;
+	va_copy(copy, args);
+	int written = _previousVprintf ? _previousVprintf(format, args) : vprintf(format, args);
+	vsnprintf(line, sizeof(line), format, copy);
+	va_end(copy);
+
+	LogEntry entry;
+	if(!_parseLine(line, &entry))
+		return written;
+	entry.timestamp_ms = esp_log_timestamp();
+
+	unsigned int pos = atomic_load_explicit(&_writePos, memory_order_relaxed);
+	_LogSlot *slot;
+	while(true){
+		slot = &_ring[pos & _RING_MASK];
+		unsigned int sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		int diff = (int)(sequence - pos);
+		if(diff == 0){
+			if(atomic_compare_exchange_weak_explicit(&_writePos, &pos, pos + 1,
+			                                         memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if(diff < 0){
+			// Reader has not released this slot yet: ring is full
+			atomic_fetch_add_explicit(&_dropped, 1, memory_order_relaxed);
+			return written;
+		}
+		else{
+			pos = atomic_load_explicit(&_writePos, memory_order_relaxed);
+		}
+	}
+	slot->entry = entry;
+	atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+	return written;
+}
+
+/**
+ * @brief      Token bucket of a tag, the least recently refilled tag is evicted when table is full
+ *
+ * @return     true if the line can be forwarded
+ */
+static bool _allowTag(const char tag[], int64_t now_ms){
+	_TagBudget *budget = NULL;
+	_TagBudget *oldest = &_budgets[0];
+	for(int i = 0; i < LOG_STREAM_MAX_TAGS && NULL == budget; ++i){
+		if(0 == strncmp(_budgets[i].tag, tag, LOG_STREAM_TAG_MAX_LEN))
+			budget = &_budgets[i];
+		else if(_budgets[i].lastRefill_ms < oldest->lastRefill_ms)
+			oldest = &_budgets[i];
+	}
+	if(NULL == budget){
+		budget = oldest;
+		strncpy(budget->tag, tag, LOG_STREAM_TAG_MAX_LEN - 1);
+		budget->tag[LOG_STREAM_TAG_MAX_LEN - 1] = '\0';
+		budget->tokens = LOG_STREAM_TAG_BURST;
+		budget->lastRefill_ms = now_ms;
+	}
+
+	int64_t refills = (now_ms - budget->lastRefill_ms) / LOG_STREAM_TAG_RATE_MS;
+	if(refills > 0){
+		budget->tokens = (budget->tokens + refills > LOG_STREAM_TAG_BURST) ? LOG_STREAM_TAG_BURST : budget->tokens + refills;
+		budget->lastRefill_ms += refills * LOG_STREAM_TAG_RATE_MS;
+	}
+	if(0 == budget->tokens)
+		return false;
+	budget->tokens--;
+	return true;
+}
+
+
+esp_err_t logStreamInit(esp_log_level_t minLevel){
+	if(NULL != _previousVprintf)
+		return ESP_ERR_INVALID_STATE;
+	for(unsigned int i = 0; i < LOG_STREAM_RING_SIZE; ++i)
+		atomic_init(&_ring[i].sequence, i);
+	atomic_init(&_writePos, 0);
+	atomic_init(&_dropped, 0);
+	memset(_budgets, 0, sizeof(_budgets));
+	_minLevel = minLevel;
+	_previousVprintf = esp_log_set_vprintf(_logHook);
+	return ESP_OK;
+}
+
+
+size_t logStreamRead(LogEntry entries[], size_t maxEntries, int64_t now_ms){
+	size_t copied = 0;
+	while(copied < maxEntries){
+		_LogSlot *slot = &_ring[_readPos & _RING_MASK];
+		if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != _readPos + 1)
+			break;
+		entries[copied] = slot->entry;
+		atomic_store_explicit(&slot->sequence, _readPos + LOG_STREAM_RING_SIZE, memory_order_release);
+		_readPos++;
+		if(_allowTag(entries[copied].tag, now_ms))
+			copied++;
+		else
+			_suppressed++;
+	}
+	return copied;
+}
+
+
+void logStreamTakeStats(LogStreamStats *stats){
+	stats->dropped = atomic_exchange_explicit(&_dropped, 0, memory_order_relaxed);
+	stats->suppressed = _suppressed;
+	_suppressed = 0;
+}
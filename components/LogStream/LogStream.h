@@ -0,0 +1,73 @@
+/**
+ *************************************
+ * @file: LogStream.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+/*
+ * Copies every line written through ESP_LOGx into a bounded ring so a low priority task can
+ * forward it to the server. The hook only formats into a stack buffer and claims a ring slot
+ * with a compare and swap: it never blocks, allocates or waits for the reader. When the ring is
+ * full the line is dropped and counted. Lines are still printed on the UART as before.
+ */
+#define LOG_STREAM_RING_SIZE 32          // Must be a power of two
+#define LOG_STREAM_LINE_MAX_LEN 128
+#define LOG_STREAM_TAG_MAX_LEN 16
+#define LOG_STREAM_MAX_TAGS 16
+#define LOG_STREAM_TAG_BURST 5           // Lines a tag can send back to back
+#define LOG_STREAM_TAG_RATE_MS 2000      // One more line allowed every period
+
+typedef struct{
+	uint32_t timestamp_ms;               // esp_log_timestamp when the line was written
+	char level;                          // 'E', 'W', 'I', 'D' or 'V'
+	char tag[LOG_STREAM_TAG_MAX_LEN];
+	char message[LOG_STREAM_LINE_MAX_LEN];
+}LogEntry;
+
+typedef struct{
+	uint32_t dropped;                    // Lines lost because the ring was full
+	uint32_t suppressed;                 // Lines discarded by the per tag rate limit
+}LogStreamStats;
+
+/**
+ * @brief      Installs the log hook
+ *
+ * @param[in]  minLevel  Less severe lines are printed on the UART but not streamed
+ *
+ * @return
+ * - ESP_OK Hook installed
+ * - ESP_ERR_INVALID_STATE Already installed
+ */
+esp_err_t logStreamInit(esp_log_level_t minLevel);
+
+/**
+ * @brief      Takes up to maxEntries lines from the ring applying the per tag rate limit
+ *
+ * @param[out] entries     Where lines will be copied
+ * @param[in]  maxEntries  Size of entries
+ * @param[in]  now_ms      Current time in ms, used to refill the rate limit
+ *
+ * @return     Number of lines copied
+ * @note Single reader: must be called always from the same task
+ */
+size_t logStreamRead(LogEntry entries[], size_t maxEntries, int64_t now_ms);
+
+/**
+ * @brief      Gets and clears the drop counters accumulated since the last call
+ *
+ * @param[out] stats  Counters
+ */
+void logStreamTakeStats(LogStreamStats *stats);
@@ -0,0 +1,136 @@
+/**
+ *************************************
+ * @file: MQTTLink.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+#include "MQTTLink.h"
+
+static const char *MQTT_TAG = "MQTT";
+
+static esp_mqtt_client_handle_t _client = NULL;
+static MQTTCommandHandler _onCommand = NULL;
+static MQTTConnectionHandler _onConnection = NULL;
+static char _topics[SERVER_MSG_KINDS][MQTT_TOPIC_MAX_LEN];
+static char _commandTopic[MQTT_TOPIC_MAX_LEN];
+static char _statusTopic[MQTT_TOPIC_MAX_LEN];
+static const char *_kindNames[SERVER_MSG_KINDS] = {"telemetry", "ack", "journal", "log"};
+static const int _kindQoS[SERVER_MSG_KINDS] = {MQTT_TELEMETRY_QOS, MQTT_ACK_QOS, MQTT_JOURNAL_QOS, MQTT_LOG_QOS};
+
+/**
+ * @brief      Builds greenhouse/<zone>/<device>/<leaf>
+ *
+ * @return     false if topic does not fit
+ */
+static bool _buildTopic(char topic[], const char zone[], const char deviceID[], const char leaf[]){
+	int len = snprintf(topic, MQTT_TOPIC_MAX_LEN, MQTT_TOPIC_ROOT "/%s/%s/%s", zone, deviceID, leaf);
+	return len > 0 && len < MQTT_TOPIC_MAX_LEN;
+}
+
+
+static void _handleCommand(esp_mqtt_event_handle_t event){
+	int64_t rxTime = esp_timer_get_time();
+	// Commands (and batches) are a single JSON line, fragmented messages are not expected
+	if(event->current_data_offset != 0 || event->data_len != event->total_data_len ||
+	   event->data_len >= MQTT_COMMAND_MAX_LEN){
+		ESP_LOGE(MQTT_TAG, "Comando de %d bytes descartado", event->total_data_len);
+		return;
+	}
+	char message[MQTT_COMMAND_MAX_LEN];
+	size_t len = event->data_len;
+	memcpy(message, event->data, len);
+	while(len > 0 && (message[len - 1] == '\n' || message[len - 1] == '\r'))
+		len--;
+	message[len] = '\0';
+	if(len > 0 && _onCommand)
+		_onCommand(message, rxTime);
+}
+
+/**
+ * @brief      MQTT client event handler: announces the device, subscribes to commands and dispatches them
+ */
+static void _eventHandler(void *handlerArgs, esp_event_base_t base, int32_t eventID, void *eventData){
+	esp_mqtt_event_handle_t event = eventData;
+	switch((esp_mqtt_event_id_t)eventID){
+		case MQTT_EVENT_CONNECTED:
+			ESP_LOGI(MQTT_TAG, "Connected to broker");
+			esp_mqtt_client_publish(_client, _statusTopic, MQTT_STATUS_ONLINE, 0, 1, 1);
+			esp_mqtt_client_subscribe(_client, _commandTopic, MQTT_COMMAND_QOS);
+			if(_onConnection)
+				_onConnection(true);
+			break;
+		case MQTT_EVENT_DISCONNECTED:
+			ESP_LOGW(MQTT_TAG, "Disconnected from broker");
+			if(_onConnection)
+				_onConnection(false);
+			break;
+		case MQTT_EVENT_DATA:
+			_handleCommand(event);
+			break;
+		case MQTT_EVENT_ERROR:
+			ESP_LOGE(MQTT_TAG, "Client error, type %d", event->error_handle->error_type);
+			break;
+		default:
+			break;
+	}
+}
+
+
+esp_err_t MQTTLinkInit(const char brokerURI[], const char zone[], const char deviceID[],
+                       MQTTCommandHandler onCommand, MQTTConnectionHandler onConnection){
+	for(int kind = 0; kind < SERVER_MSG_KINDS; kind++){
+		if(!_buildTopic(_topics[kind], zone, deviceID, _kindNames[kind]))
+			return ESP_ERR_INVALID_ARG;
+	}
+	if(!_buildTopic(_commandTopic, zone, deviceID, "cmd") || !_buildTopic(_statusTopic, zone, deviceID, "status"))
+		return ESP_ERR_INVALID_ARG;
+	_onCommand = onCommand;
+	_onConnection = onConnection;
+
+	esp_mqtt_client_config_t config = {
+		.broker.address.uri = brokerURI,
+		.credentials.client_id = deviceID,
+		.session.last_will = {
+			.topic = _statusTopic,
+			.msg = MQTT_STATUS_OFFLINE,
+			.qos = 1,
+			.retain = 1,
+		},
+	};
+	_client = esp_mqtt_client_init(&config);
+	if(NULL == _client){
+		ESP_LOGE(MQTT_TAG, "Failed to create client");
+		return ESP_FAIL;
+	}
+	esp_mqtt_client_register_event(_client, ESP_EVENT_ANY_ID, _eventHandler, NULL);
+	ESP_LOGI(MQTT_TAG, "Publishing to %s/%s/%s", MQTT_TOPIC_ROOT, zone, deviceID);
+	esp_err_t E = esp_mqtt_client_start(_client);
+	if(ESP_OK != E){
+		// Client is released so a later call starts from scratch
+		ESP_LOGE(MQTT_TAG, "Failed to start client: %s", esp_err_to_name(E));
+		esp_mqtt_client_destroy(_client);
+		_client = NULL;
+	}
+	return E;
+}
+
+
+esp_err_t MQTTLinkPublish(ServerMessageKind kind, const uint8_t data[], size_t length){
+	if(NULL == _client || kind >= SERVER_MSG_KINDS)
+		return TCP_FAILURE;
+	int msgID;
+	if(_kindQoS[kind] > 0){
+		// Enqueue does not block the caller (it may be the MQTT task itself when acknowledging a command)
+		msgID = esp_mqtt_client_enqueue(_client, _topics[kind], (const char *)data, length, _kindQoS[kind], 0, true);
+	}
+	else{
+		msgID = esp_mqtt_client_publish(_client, _topics[kind], (const char *)data, length, _kindQoS[kind], 0);
+	}
+	if(msgID < 0){
+		ESP_LOGE(MQTT_TAG, "Failed to publish %s (%d)", _kindNames[kind], msgID);
+		return TCP_FAILURE;
+	}
+	return TCP_SUCCESS;
+}
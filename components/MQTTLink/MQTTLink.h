@@ -0,0 +1,74 @@
+/**
+ *************************************
+ * @file: MQTTLink.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "WiFi.h"
+
+/*
+ * Topics used by a device (zone and device id are set in MQTTLinkInit):
+ *   greenhouse/<zone>/<device>/telemetry  device -> server  QoS 0
+ *   greenhouse/<zone>/<device>/ack        device -> server  QoS 1
+ *   greenhouse/<zone>/<device>/journal    device -> server  QoS 1
+ *   greenhouse/<zone>/<device>/log        device -> server  QoS 0
+ *   greenhouse/<zone>/<device>/status     device -> server  QoS 1 retained, "offline" is the last will
+ *   greenhouse/<zone>/<device>/cmd        server -> device  QoS 1
+ * Payloads are the same JSON messages (without '\n') or compact frames sent over TCP.
+ */
+#define MQTT_TOPIC_ROOT "greenhouse"
+#define MQTT_TOPIC_MAX_LEN 96
+#define MQTT_COMMAND_MAX_LEN COMMAND_MESSAGE_MAX_LEN
+#define MQTT_TELEMETRY_QOS 0
+#define MQTT_ACK_QOS 1
+#define MQTT_JOURNAL_QOS 1
+#define MQTT_LOG_QOS 0
+#define MQTT_COMMAND_QOS 1
+#define MQTT_STATUS_ONLINE "online"
+#define MQTT_STATUS_OFFLINE "offline"
+
+typedef void (*MQTTCommandHandler)(const char message[], int64_t rxTime_us);
+typedef void (*MQTTConnectionHandler)(bool connected);
+
+/**
+ * @brief      Starts the MQTT client, it reconnects to the broker by itself
+ *
+ * @param[in]  brokerURI     Broker URI, e.g. mqtt://192.168.1.168:1883
+ * @param[in]  zone          Zone the device belongs to
+ * @param[in]  deviceID      Unique device identifier, also used as client id
+ * @param[in]  onCommand     Called for every message received on the command topic
+ * @param[in]  onConnection  Called when the broker session goes up or down
+ *
+ * @return
+ * - ESP_OK Client started
+ * - ESP_ERR_INVALID_ARG Topics do not fit in MQTT_TOPIC_MAX_LEN
+ * - ESP_FAIL Client could not be created
+ * - Error returned by esp_mqtt_client_start otherwise, the client is released and the call can be retried
+ * @note Handlers run in the MQTT client task
+ */
+esp_err_t MQTTLinkInit(const char brokerURI[], const char zone[], const char deviceID[],
+                       MQTTCommandHandler onCommand, MQTTConnectionHandler onConnection);
+
+/**
+ * @brief      Publishes a message to the topic of its kind (matches ServerPublisher)
+ *
+ * @param[in]  kind    Kind of message
+ * @param[in]  data    Payload
+ * @param[in]  length  Payload length
+ *
+ * @return
+ * - TCP_SUCCESS Message was sent (QoS 0) or queued for delivery (QoS 1)
+ * - TCP_FAILURE Otherwise
+ */
+esp_err_t MQTTLinkPublish(ServerMessageKind kind, const uint8_t data[], size_t length);
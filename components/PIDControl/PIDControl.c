@@ -32,6 +32,13 @@ void setPIDMaxAndMinVals(PIDController *pidC, float min ,float max){
 	pidC->minOutput = min;
 }
 
+void setPIDIntegralVal(PIDController *pidC, float integralVal){
+	if(NULL == pidC){
+		return;
+	}
+	pidC->IntegralVal = integralVal;
+}
+
 
 float computePIDOutput(PIDController *pidC, float inputVal){
 	if(pidC == NULL){
@@ -65,3 +72,46 @@ float computePIDOutput(PIDController *pidC, float inputVal){
 	return outVal;
 }
 
+
+void setSplitRangeDeadband(SplitRange *split, float deadband, float hysteresis){
+	if(NULL == split || deadband < 0.0f || deadband >= 1.0f){
+		return;
+	}
+	split->deadband = deadband;
+	split->hysteresis = hysteresis;
+	split->coolingActive = false;
+}
+
+
+void setSplitRangeBand(SplitRange *split, float Kp, float deadband_C, float hysteresis_C){
+	// Proportional estimate, a sustained error also moves the output through the integrator
+	float deadband = Kp * deadband_C;
+	if(deadband > SPLIT_RANGE_MAX_DEADBAND)
+		deadband = SPLIT_RANGE_MAX_DEADBAND;
+	setSplitRangeDeadband(split, deadband, Kp * hysteresis_C);
+}
+
+
+void computeSplitRangeOutputs(SplitRange *split, float pidOutput, float *heat, float *cool){
+	if(NULL == split || NULL == heat || NULL == cool){
+		return;
+	}
+	*heat = (pidOutput > 0.0f) ? pidOutput : 0.0f;
+
+	// Cooling turns on past deadband + hysteresis and off below deadband, so noise does not make it chatter
+	float demand = -pidOutput;
+	if(split->coolingActive && demand < split->deadband)
+		split->coolingActive = false;
+	else if(!split->coolingActive && demand >= split->deadband + split->hysteresis)
+		split->coolingActive = true;
+
+	if(!split->coolingActive){
+		*cool = 0.0f;
+		return;
+	}
+	*cool = (demand - split->deadband) / (1.0f - split->deadband);
+	if(*cool > 1.0f)
+		*cool = 1.0f;
+	else if(*cool < 0.0f)
+		*cool = 0.0f;
+}
@@ -7,6 +7,7 @@
  * ***********************************
  */
 #pragma once
+#include <stdbool.h>
 #include <unistd.h>
 #include "freertos/idf_additions.h"
 
@@ -26,11 +27,29 @@ typedef struct{
 	float minOutput;
 }PIDController;
 
+#define SPLIT_RANGE_MAX_DEADBAND 0.9f
+
+// Splits a [-1, 1] output: positive part heats, negative part beyond deadband cools
+typedef struct{
+	float deadband;
+	float hysteresis;
+	bool coolingActive;
+}SplitRange;
+
 void setPIDDesiredValue(PIDController *pidC, float desiredVal);
 
 void setPIDGains(PIDController *pidC, float Kp, float Ki, float Kd);
 
 void setPIDMaxAndMinVals(PIDController *pidC, float min ,float max);
 
+void setPIDIntegralVal(PIDController *pidC, float integralVal);
+
 float computePIDOutput(PIDController *pidC, float inputVal);
 
+void setSplitRangeDeadband(SplitRange *split, float deadband, float hysteresis);
+
+// Deadband and hysteresis in degrees over the setpoint, converted to output units with Kp
+void setSplitRangeBand(SplitRange *split, float Kp, float deadband_C, float hysteresis_C);
+
+void computeSplitRangeOutputs(SplitRange *split, float pidOutput, float *heat, float *cool);
+
@@ -53,19 +53,31 @@ esp_err_t FanInit(FanHandler *fanHan, gpio_num_t pin, ledc_channel_t channel){
 	return ESP_OK;
 }
 
+// @brief Converts a duty cycle percentage [0-1] into 11 bits duty
+static uint32_t _dutyFromPerc(float DCpercentage){
+	if(DCpercentage >= 1.0)
+	    return MAX_NUM_11_BITS;
+	else if(DCpercentage <= 0.0)
+	    return 0;
+	return (uint32_t)(MAX_NUM_11_BITS * DCpercentage);
+}
+
 esp_err_t setFanDutyCyclePerc(FanHandler *fanHan, float DCpercentage){
 	if(!fanHan)
 		return ESP_ERR_INVALID_ARG;
 
-	uint32_t dutyCycleInt;
-	if(DCpercentage >= 1.0)
-	    dutyCycleInt = MAX_NUM_11_BITS;
-	else if(DCpercentage <= 0.0)
-	    dutyCycleInt = 0;
-	else
-	    dutyCycleInt = (uint32_t)(MAX_NUM_11_BITS * DCpercentage);
+	// A running fade would make the update wait until it finishes
+	ledc_fade_stop(fanHan->PWMmode, fanHan->PWMchannel);
+	return ledc_set_duty_and_update(fanHan->PWMmode, fanHan->PWMchannel, _dutyFromPerc(DCpercentage), 0);
+}
+
+esp_err_t fadeFanDutyCyclePerc(FanHandler *fanHan, float DCpercentage, uint32_t fadeTime_ms){
+	if(!fanHan)
+		return ESP_ERR_INVALID_ARG;
 
-	return ledc_set_duty_and_update(fanHan->PWMmode, fanHan->PWMchannel, dutyCycleInt, 0);
+	ledc_fade_stop(fanHan->PWMmode, fanHan->PWMchannel);
+	return ledc_set_fade_time_and_start(fanHan->PWMmode, fanHan->PWMchannel, _dutyFromPerc(DCpercentage),
+	                                    fadeTime_ms, LEDC_FADE_NO_WAIT);
 }
 
 float getFanDutyCyclePerc(FanHandler *fanHan){
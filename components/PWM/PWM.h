@@ -55,6 +55,22 @@ esp_err_t FanInit(FanHandler *fanHan, gpio_num_t pin, ledc_channel_t channel);
  */
 esp_err_t setFanDutyCyclePerc(FanHandler *fanHan, float DCpercentage);
 
+/**
+ * @brief      Fades the fan duty cycle to DCpercentage [0-1] in hardware, returns without waiting
+ *
+ * @param      fanHan        Fan handler which have an initialized channel
+ * @param[in]  DCpercentage  Target duty cycle
+ * @param[in]  fadeTime_ms   Duration of the fade
+ *
+ * @return
+ * - ESP_OK Success
+ * - ESP_ERR_INVALID_STATE Channel not initialized or fade function not installed
+ * - ESP_ERR_INVALID_ARG Parameter error
+ * - ESP_FAIL Fade function init error
+ * @note A fade in progress is replaced by the new one
+ */
+esp_err_t fadeFanDutyCyclePerc(FanHandler *fanHan, float DCpercentage, uint32_t fadeTime_ms);
+
 /**
  * @brief      Gets the fan duty cycle percentage
  *
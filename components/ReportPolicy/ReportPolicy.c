@@ -0,0 +1,59 @@
+/**
+ *************************************
+ * @file: ReportPolicy.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "ReportPolicy.h"
+#include <math.h>
+#include <stddef.h>
+
+void reportPolicyConfig(ChannelReportPolicy *policy, float deadband, uint32_t maxSilence_ms){
+	if(NULL == policy)
+		return;
+	policy->deadband = (deadband < 0.0f) ? 0.0f : deadband;
+	policy->maxSilence_ms = maxSilence_ms;
+}
+
+bool reportPolicyShouldReport(const ChannelReportPolicy *policy, float value, int64_t now_ms){
+	if(NULL == policy || !policy->hasReported)
+		return true;
+	if(now_ms - policy->lastReportTime_ms >= policy->maxSilence_ms)
+		return true;
+	return fabsf(value - policy->lastReported) >= policy->deadband;
+}
+
+void reportPolicyMarkReported(ChannelReportPolicy *policy, float value, int64_t now_ms){
+	if(NULL == policy)
+		return;
+	policy->lastReported = value;
+	policy->lastReportTime_ms = now_ms;
+	policy->hasReported = true;
+}
+
+void adaptiveSamplerConfig(AdaptiveSampler *sampler, uint32_t minPeriod_ms, uint32_t maxPeriod_ms){
+	if(NULL == sampler)
+		return;
+	sampler->minPeriod_ms = minPeriod_ms;
+	sampler->maxPeriod_ms = (maxPeriod_ms < minPeriod_ms) ? minPeriod_ms : maxPeriod_ms;
+	sampler->period_ms = sampler->minPeriod_ms;
+}
+
+uint32_t adaptiveSamplerUpdate(AdaptiveSampler *sampler, float normalizedChange){
+	if(NULL == sampler)
+		return 0;
+
+	if(normalizedChange >= ADAPTIVE_FAST_CHANGE)
+		sampler->period_ms /= 2;
+	else if(normalizedChange < ADAPTIVE_SLOW_CHANGE)
+		sampler->period_ms += sampler->period_ms / 4;
+
+	if(sampler->period_ms < sampler->minPeriod_ms)
+		sampler->period_ms = sampler->minPeriod_ms;
+	else if(sampler->period_ms > sampler->maxPeriod_ms)
+		sampler->period_ms = sampler->maxPeriod_ms;
+	return sampler->period_ms;
+}
@@ -0,0 +1,81 @@
+/**
+ *************************************
+ * @file: ReportPolicy.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define ADAPTIVE_FAST_CHANGE 1.0f
+#define ADAPTIVE_SLOW_CHANGE 0.25f
+
+typedef struct{
+	float deadband;
+	uint32_t maxSilence_ms;
+	float lastReported;
+	int64_t lastReportTime_ms;
+	bool hasReported;
+}ChannelReportPolicy;
+
+typedef struct{
+	uint32_t minPeriod_ms;
+	uint32_t maxPeriod_ms;
+	uint32_t period_ms;
+}AdaptiveSampler;
+
+/**
+ * @brief      Sets deadband and heartbeat of a channel
+ *
+ * @param      policy         Channel policy
+ * @param[in]  deadband       Minimum change since last report that triggers a new report
+ * @param[in]  maxSilence_ms  Maximum time without reporting (heartbeat)
+ */
+void reportPolicyConfig(ChannelReportPolicy *policy, float deadband, uint32_t maxSilence_ms);
+
+/**
+ * @brief      Checks if a value must be reported
+ *
+ * @param[in]  policy   Channel policy
+ * @param[in]  value    Current value
+ * @param[in]  now_ms   Current time in ms
+ *
+ * @return     true if value moved beyond deadband since last report or heartbeat expired
+ */
+bool reportPolicyShouldReport(const ChannelReportPolicy *policy, float value, int64_t now_ms);
+
+/**
+ * @brief      Records that a value was reported
+ *
+ * @param      policy  Channel policy
+ * @param[in]  value   Reported value
+ * @param[in]  now_ms  Current time in ms
+ */
+void reportPolicyMarkReported(ChannelReportPolicy *policy, float value, int64_t now_ms);
+
+/**
+ * @brief      Sets acquisition period bounds, starting at the fastest period
+ *
+ * @param      sampler       Sampler
+ * @param[in]  minPeriod_ms  Period used while values change quickly
+ * @param[in]  maxPeriod_ms  Period used while values are stable
+ */
+void adaptiveSamplerConfig(AdaptiveSampler *sampler, uint32_t minPeriod_ms, uint32_t maxPeriod_ms);
+
+/**
+ * @brief      Adapts acquisition period to how fast the signal moves
+ *
+ * A change of at least ADAPTIVE_FAST_CHANGE deadbands halves the period, a change below
+ * ADAPTIVE_SLOW_CHANGE deadbands makes it 25% longer, always within configured bounds.
+ *
+ * @param      sampler           Sampler
+ * @param[in]  normalizedChange  Change since previous sample divided by channel deadband
+ *
+ * @return     Period to wait before next sample in ms
+ */
+uint32_t adaptiveSamplerUpdate(AdaptiveSampler *sampler, float normalizedChange);
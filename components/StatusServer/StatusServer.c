@@ -0,0 +1,100 @@
+/**
+ *************************************
+ * @file: StatusServer.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+#include "StatusServer.h"
+
+static const char *SS_TAG = "StatusServer";
+
+static httpd_handle_t _server = NULL;
+static StatusCommandHandler _onCommand = NULL;
+static StatusRenderer _onStatus = NULL;
+
+
+// @brief GET /status: renders the snapshot in the httpd task, so the control core never formats it
+static esp_err_t _statusHandler(httpd_req_t *req){
+	char snapshot[STATUS_SNAPSHOT_MAX_LEN];
+	int length = _onStatus(snapshot, sizeof(snapshot));
+	if(length < 0 || length >= sizeof(snapshot)){
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot render status");
+	}
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	return httpd_resp_send(req, snapshot, length);
+}
+
+// @brief POST /command: decodes, executes and acknowledges a command like the server session does
+static esp_err_t _commandHandler(httpd_req_t *req){
+	char body[STATUS_COMMAND_MAX_LEN];
+	if(req->content_len <= 0 || req->content_len >= sizeof(body)){
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid command length");
+	}
+	int received = 0;
+	while(received < req->content_len){
+		int len = httpd_req_recv(req, body + received, req->content_len - received);
+		if(len == HTTPD_SOCK_ERR_TIMEOUT)
+			continue;
+		if(len <= 0)
+			return ESP_FAIL;
+		received += len;
+	}
+	body[received] = '\0';
+
+	int64_t rxTime = esp_timer_get_time();
+	ServerCommand cmd;
+	float appliedState = 0.0f;
+	esp_err_t result = decodeJSONServerMessage(body, &cmd);
+	if(ESP_OK == result)
+		result = _onCommand(&cmd, &appliedState);
+	int64_t applyTime = esp_timer_get_time() - rxTime;
+
+	char ack[STATUS_ACK_MAX_LEN];
+	if(ESP_OK != renderAckJSON(ack, sizeof(ack), &cmd, result, appliedState, applyTime)){
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot render ack");
+	}
+	httpd_resp_set_type(req, "application/json");
+	if(ESP_ERR_INVALID_ARG == result)
+		httpd_resp_set_status(req, "400 Bad Request");
+	else if(ESP_ERR_NOT_SUPPORTED == result)
+		httpd_resp_set_status(req, "404 Not Found");
+	return httpd_resp_sendstr(req, ack);
+}
+
+
+esp_err_t statusServerStart(uint16_t port, BaseType_t coreID, StatusCommandHandler onCommand, StatusRenderer onStatus){
+	if(NULL == onCommand || NULL == onStatus)
+		return ESP_ERR_INVALID_ARG;
+	_onCommand = onCommand;
+	_onStatus = onStatus;
+
+	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+	config.server_port = port;
+	config.core_id = coreID;
+	config.max_open_sockets = 3;
+	config.lru_purge_enable = true;
+	esp_err_t E = httpd_start(&_server, &config);
+	if(E){
+		ESP_LOGE(SS_TAG, "Cannot start HTTP server: %s", esp_err_to_name(E));
+		return E;
+	}
+
+	httpd_uri_t statusURI = {
+		.uri = "/status",
+		.method = HTTP_GET,
+		.handler = _statusHandler,
+	};
+	httpd_uri_t commandURI = {
+		.uri = "/command",
+		.method = HTTP_POST,
+		.handler = _commandHandler,
+	};
+	httpd_register_uri_handler(_server, &statusURI);
+	httpd_register_uri_handler(_server, &commandURI);
+	ESP_LOGI(SS_TAG, "Serving /status and /command on port %u", port);
+	return ESP_OK;
+}
@@ -0,0 +1,51 @@
+/**
+ *************************************
+ * @file: StatusServer.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "WiFi.h"
+
+/*
+ * Local endpoint of the controller:
+ *   GET  /status   Snapshot rendered on request by the StatusRenderer (application/json)
+ *   POST /command  Same JSON command sent by the server, answered with the same ack
+ */
+#define STATUS_SNAPSHOT_MAX_LEN 512
+#define STATUS_COMMAND_MAX_LEN 256
+#define STATUS_ACK_MAX_LEN 256
+
+typedef esp_err_t (*StatusCommandHandler)(const ServerCommand *cmd, float *appliedState);
+
+/**
+ * Renders the snapshot into buffer like snprintf, returns its length (negative or >= size if it does not fit)
+ */
+typedef int (*StatusRenderer)(char buffer[], size_t size);
+
+/**
+ * @brief      Starts the HTTP server
+ *
+ * @param[in]  port       TCP port
+ * @param[in]  coreID     Core of the httpd task (tskNO_AFFINITY for any)
+ * @param[in]  onCommand  Executes commands received in POST /command
+ * @param[in]  onStatus   Renders the snapshot of GET /status into a STATUS_SNAPSHOT_MAX_LEN buffer
+ *
+ * @return
+ * - ESP_OK Server started
+ * - ESP_ERR_INVALID_ARG A handler is NULL
+ * - Error returned by httpd_start otherwise
+ * @note Handlers run in the httpd task (on coreID), onCommand and onStatus must be safe to call from it
+ */
+esp_err_t statusServerStart(uint16_t port, BaseType_t coreID, StatusCommandHandler onCommand, StatusRenderer onStatus);
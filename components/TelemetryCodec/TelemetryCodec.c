@@ -0,0 +1,144 @@
+/**
+ *************************************
+ * @file: TelemetryCodec.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "TelemetryCodec.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief      Writes an unsigned LEB128 varint
+ *
+ * @return     Number of bytes written
+ */
+static size_t _putVarint(uint8_t *out, uint32_t value){
+	size_t n = 0;
+	while(value >= 0x80){
+		out[n++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (uint8_t)value;
+	return n;
+}
+
+/**
+ * @brief      Maps signed to unsigned so small magnitudes give short varints
+ */
+static uint32_t _zigZag(int32_t value){
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief      Starts a frame writing its type, sequence and reserving header, sample count and age
+ */
+static void _beginFrame(TelemetryEncoder *enc){
+	enc->isKeyframe = (0 == enc->framesSinceKeyframe);
+	enc->frame[0] = TELEMETRY_FRAME_MAGIC;
+	enc->frameLength = TELEMETRY_FRAME_HEADER_LEN;
+	enc->frame[enc->frameLength++] = enc->isKeyframe ? TELEMETRY_FRAME_KEYFRAME : TELEMETRY_FRAME_DELTA;
+	enc->frameLength += _putVarint(&enc->frame[enc->frameLength], enc->sequence);
+	enc->countOffset = enc->frameLength;
+	enc->frame[enc->frameLength++] = 0;
+	enc->ageOffset = enc->frameLength;
+	enc->frame[enc->frameLength++] = 0;
+	enc->frame[enc->frameLength++] = 0;
+}
+
+/**
+ * @brief      Writes sample count and payload length of the batch, the frame is ready to send
+ */
+static void _finishFrame(TelemetryEncoder *enc){
+	size_t payloadLength = enc->frameLength - TELEMETRY_FRAME_HEADER_LEN;
+	enc->frame[enc->countOffset] = enc->batchSamples;
+	enc->frame[1] = (uint8_t)(payloadLength & 0xFF);
+	enc->frame[2] = (uint8_t)(payloadLength >> 8);
+}
+
+void telemetryEncoderReset(TelemetryEncoder *enc){
+	if(NULL == enc)
+		return;
+	memset(enc, 0, sizeof(TelemetryEncoder));
+	_beginFrame(enc);
+}
+
+esp_err_t telemetryEncoderAdd(TelemetryEncoder *enc, const float values[TELEMETRY_CHANNELS], int64_t time_ms){
+	if(NULL == enc || NULL == values)
+		return ESP_ERR_INVALID_ARG;
+
+	bool absolute = enc->isKeyframe && 0 == enc->batchSamples;
+	uint32_t dt = absolute ? 0 : (uint32_t)((time_ms - enc->lastTime_ms) / TELEMETRY_TIME_UNIT_MS);
+	enc->frameLength += _putVarint(&enc->frame[enc->frameLength], dt);
+	for(int ch = 0; ch < TELEMETRY_CHANNELS; ++ch){
+		int32_t fixed = (int32_t)lroundf(values[ch] * TELEMETRY_FIXED_POINT_SCALE);
+		int32_t encoded = absolute ? fixed : fixed - enc->lastValues[ch];
+		enc->frameLength += _putVarint(&enc->frame[enc->frameLength], _zigZag(encoded));
+		enc->lastValues[ch] = fixed;
+		enc->batchValues[enc->batchSamples][ch] = values[ch];
+	}
+	enc->lastTime_ms = time_ms;
+	enc->batchTimes_ms[enc->batchSamples] = time_ms;
+	enc->batchSamples++;
+
+	if(enc->batchSamples < TELEMETRY_BATCH_SAMPLES)
+		return ESP_OK;
+
+	_finishFrame(enc);
+	return ESP_ERR_NOT_FINISHED;
+}
+
+esp_err_t telemetryEncoderFinish(TelemetryEncoder *enc){
+	if(NULL == enc)
+		return ESP_ERR_INVALID_ARG;
+	if(0 == enc->batchSamples)
+		return ESP_ERR_INVALID_STATE;
+	_finishFrame(enc);
+	return ESP_OK;
+}
+
+void telemetryEncoderStamp(TelemetryEncoder *enc, int64_t now_ms){
+	if(NULL == enc || 0 == enc->batchSamples)
+		return;
+	int64_t age = (now_ms - enc->lastTime_ms) / TELEMETRY_TIME_UNIT_MS;
+	uint16_t units = (age < 0) ? 0 : (age > TELEMETRY_AGE_MAX) ? TELEMETRY_AGE_MAX : (uint16_t)age;
+	enc->frame[enc->ageOffset] = (uint8_t)(units & 0xFF);
+	enc->frame[enc->ageOffset + 1] = (uint8_t)(units >> 8);
+}
+
+void telemetryEncoderNextBatch(TelemetryEncoder *enc){
+	if(NULL == enc)
+		return;
+	enc->sequence++;
+	enc->framesSinceKeyframe = (enc->framesSinceKeyframe + 1) % TELEMETRY_KEYFRAME_INTERVAL;
+	enc->batchSamples = 0;
+	_beginFrame(enc);
+}
+
+size_t telemetryEncodeSummary(uint8_t frame[], uint32_t windowStart, uint8_t flags, uint32_t window_s,
+                              const ChannelSummary summaries[TELEMETRY_CHANNELS]){
+	if(NULL == frame || NULL == summaries)
+		return 0;
+
+	size_t length = TELEMETRY_FRAME_HEADER_LEN;
+	frame[0] = TELEMETRY_FRAME_MAGIC;
+	frame[length++] = TELEMETRY_FRAME_SUMMARY;
+	frame[length++] = flags;
+	length += _putVarint(&frame[length], windowStart);
+	length += _putVarint(&frame[length], window_s);
+	for(int ch = 0; ch < TELEMETRY_CHANNELS; ++ch){
+		const ChannelSummary *summary = &summaries[ch];
+		length += _putVarint(&frame[length], summary->count);
+		length += _putVarint(&frame[length], _zigZag((int32_t)lroundf(summary->mean * TELEMETRY_FIXED_POINT_SCALE)));
+		length += _putVarint(&frame[length], _zigZag((int32_t)lroundf(summary->min * TELEMETRY_FIXED_POINT_SCALE)));
+		length += _putVarint(&frame[length], _zigZag((int32_t)lroundf(summary->max * TELEMETRY_FIXED_POINT_SCALE)));
+		length += _putVarint(&frame[length], (uint32_t)lroundf(summary->stddev * TELEMETRY_STDDEV_SCALE));
+	}
+	size_t payloadLength = length - TELEMETRY_FRAME_HEADER_LEN;
+	frame[1] = (uint8_t)(payloadLength & 0xFF);
+	frame[2] = (uint8_t)(payloadLength >> 8);
+	return length;
+}
@@ -0,0 +1,139 @@
+/**
+ *************************************
+ * @file: TelemetryCodec.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ *
+ * Compact telemetry frames:
+ *
+ *   [MAGIC 0xA5][payload length, uint16 little endian][payload]
+ *
+ * Payload:
+ *
+ *   [frame type][sequence, varint][sample count][age, uint16 little endian]
+ *   per sample: [dt, varint in TELEMETRY_TIME_UNIT_MS since previous sample]
+ *               [one zig-zag varint per channel]
+ *
+ * Channels are fixed point values (0.1 °C / 0.1 %RH). In a keyframe the first sample holds
+ * absolute values and dt = 0, every other sample (and every sample of a delta frame) holds
+ * the difference with the previous sample, so a delta frame can only be decoded after the
+ * frames that precede it up to the last keyframe. Age is how old the newest sample was when the
+ * frame was sent, in TELEMETRY_TIME_UNIT_MS (saturated at TELEMETRY_AGE_MAX): the receiver dates it
+ * at reception time minus age, since a batch can wait until the max silence of the report policy.
+ *
+ * Summary payload (self-contained, it does not touch the delta state):
+ *
+ *   [TELEMETRY_FRAME_SUMMARY][flags][window start, varint seconds][window length, varint seconds]
+ *   per channel: [count, varint][mean][min][max, zig-zag varints fixed point][stddev, varint x100]
+ *
+ * If TELEMETRY_SUMMARY_FLAG_UPTIME is set, window start is seconds since boot.
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "Aggregation.h"
+
+
+#define TELEMETRY_FRAME_MAGIC 0xA5
+#define TELEMETRY_FRAME_HEADER_LEN 3
+#define TELEMETRY_FRAME_KEYFRAME 0x01
+#define TELEMETRY_FRAME_DELTA 0x02
+#define TELEMETRY_FRAME_SUMMARY 0x03
+#define TELEMETRY_SUMMARY_FLAG_UPTIME (1u << 0)
+#define TELEMETRY_STDDEV_SCALE 100.0f
+#define TELEMETRY_CHANNELS 3
+#define TELEMETRY_BATCH_SAMPLES 8
+#define TELEMETRY_KEYFRAME_INTERVAL 8
+#define TELEMETRY_TIME_UNIT_MS 100
+#define TELEMETRY_FIXED_POINT_SCALE 10.0f
+#define TELEMETRY_VARINT_MAX_LEN 5
+#define TELEMETRY_AGE_MAX UINT16_MAX
+#define TELEMETRY_FRAME_MAX_LEN (TELEMETRY_FRAME_HEADER_LEN + 1 + TELEMETRY_VARINT_MAX_LEN + 1 + 2 + \
+	TELEMETRY_BATCH_SAMPLES * (TELEMETRY_CHANNELS + 1) * TELEMETRY_VARINT_MAX_LEN)
+#define TELEMETRY_SUMMARY_FRAME_MAX_LEN (TELEMETRY_FRAME_HEADER_LEN + 2 + 2 * TELEMETRY_VARINT_MAX_LEN + \
+	TELEMETRY_CHANNELS * 5 * TELEMETRY_VARINT_MAX_LEN)
+
+typedef struct{
+	int32_t lastValues[TELEMETRY_CHANNELS];
+	int64_t lastTime_ms;
+	float batchValues[TELEMETRY_BATCH_SAMPLES][TELEMETRY_CHANNELS];
+	int64_t batchTimes_ms[TELEMETRY_BATCH_SAMPLES];
+	uint8_t batchSamples;
+	uint8_t framesSinceKeyframe;
+	uint32_t sequence;
+	bool isKeyframe;
+	uint8_t frame[TELEMETRY_FRAME_MAX_LEN];
+	size_t frameLength;
+	size_t countOffset;
+	size_t ageOffset;
+}TelemetryEncoder;
+
+/**
+ * @brief      Resets the encoder so next frame is a keyframe (must be called on every new session)
+ *
+ * @param      enc   Encoder
+ */
+void telemetryEncoderReset(TelemetryEncoder *enc);
+
+/**
+ * @brief      Adds a sample to the current batch
+ *
+ * @param      enc      Encoder
+ * @param[in]  values   One value per channel
+ * @param[in]  time_ms  Time of the sample in ms (any monotonic clock)
+ *
+ * @return
+ * - ESP_OK Sample added, batch is not full yet
+ * - ESP_ERR_NOT_FINISHED Batch is full, frame is ready in enc->frame / enc->frameLength
+ * - ESP_ERR_INVALID_ARG enc or values is NULL
+ */
+esp_err_t telemetryEncoderAdd(TelemetryEncoder *enc, const float values[TELEMETRY_CHANNELS], int64_t time_ms);
+
+/**
+ * @brief      Closes the current batch before it is full, so samples are not held too long
+ *
+ * @param      enc   Encoder
+ *
+ * @return
+ * - ESP_OK Frame is ready in enc->frame / enc->frameLength, send it and call telemetryEncoderNextBatch
+ * - ESP_ERR_INVALID_STATE Batch is empty
+ * - ESP_ERR_INVALID_ARG enc is NULL
+ */
+esp_err_t telemetryEncoderFinish(TelemetryEncoder *enc);
+
+/**
+ * @brief      Writes in the ready frame how old its newest sample is, call it right before sending
+ *
+ * @param      enc     Encoder
+ * @param[in]  now_ms  Current time in the clock of the sample times
+ */
+void telemetryEncoderStamp(TelemetryEncoder *enc, int64_t now_ms);
+
+/**
+ * @brief      Starts a new batch after the ready frame was sent
+ *
+ * @param      enc   Encoder
+ *
+ * @note Raw values of the batch stay in enc->batchValues (and their times in enc->batchTimes_ms) until
+ *       this call, so they can be stored somewhere else if the frame could not be sent
+ */
+void telemetryEncoderNextBatch(TelemetryEncoder *enc);
+
+/**
+ * @brief      Encodes the statistics of a window into a summary frame
+ *
+ * @param[out] frame         Buffer of at least TELEMETRY_SUMMARY_FRAME_MAX_LEN bytes
+ * @param[in]  windowStart   Start of the window in seconds (unix time, or uptime with TELEMETRY_SUMMARY_FLAG_UPTIME)
+ * @param[in]  flags         Summary flags
+ * @param[in]  window_s      Length of the window in seconds
+ * @param[in]  summaries     Statistics of every channel (TELEMETRY_CHANNELS)
+ *
+ * @return     Frame length including header, 0 if frame or summaries is NULL
+ */
+size_t telemetryEncodeSummary(uint8_t frame[], uint32_t windowStart, uint8_t flags, uint32_t window_s,
+                              const ChannelSummary summaries[TELEMETRY_CHANNELS]);
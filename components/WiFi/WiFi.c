@@ -12,13 +12,25 @@ static const char *WiFi_TAG = "WiFi";
 
 static EventGroupHandle_t wifiEventGroup;
 static int _retryNum = 0;
+static ServerPublisher _publisher = NULL;
+static esp_netif_t *_staNetif = NULL;
+static wifi_config_t _wifiConfig;
+static WiFiLinkCache _cache;
+static bool _cacheValid = false;
+static bool _usingCachedAP = false;
+static bool _linkUp = false;
+static esp_timer_handle_t _reconnectTimer = NULL;
+static int64_t _connectStart_us = 0;
+static uint32_t _lastConnectTime_ms = 0;
+// Held while a whole message is written so telemetry, acks and logs never interleave in the stream
+static SemaphoreHandle_t _sendMutex = NULL;
 
 static void _initPeripherialsAndDrivers(){
 
     ESP_ERROR_CHECK(esp_netif_init());
 
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    _staNetif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -26,93 +38,226 @@ static void _initPeripherialsAndDrivers(){
 }
 
 /**
- * @brief      WiFi handler: Tries to connect to an AP _retryNum - 1 times
+ * @brief      Loads the link of the last connection if it was made to the same SSID
+ */
+static void _loadLinkCache(const char ssid[]){
+	nvs_handle_t handle;
+	if(ESP_OK != nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle))
+		return;
+	size_t length = sizeof(_cache);
+	esp_err_t E = nvs_get_blob(handle, WIFI_CACHE_KEY, &_cache, &length);
+	nvs_close(handle);
+	_cacheValid = (ESP_OK == E && length == sizeof(_cache) && WIFI_CACHE_VERSION == _cache.version &&
+	               0 == strncmp(_cache.ssid, ssid, sizeof(_cache.ssid)));
+	if(_cacheValid)
+		ESP_LOGI(WiFi_TAG, "Using cached AP " MACSTR " on channel %u", MAC2STR(_cache.bssid), _cache.channel);
+}
+
+/**
+ * @brief      Stores the current link in NVS, only written when it differs from the cached one
+ */
+static void _storeLinkCache(const esp_netif_ip_info_t *ipInfo){
+	wifi_ap_record_t ap;
+	if(ESP_OK != esp_wifi_sta_get_ap_info(&ap))
+		return;
+	WiFiLinkCache link;
+	memset(&link, 0, sizeof(link));
+	link.version = WIFI_CACHE_VERSION;
+	link.channel = ap.primary;
+	memcpy(link.bssid, ap.bssid, sizeof(link.bssid));
+	memcpy(link.ssid, _wifiConfig.sta.ssid, sizeof(link.ssid) - 1);
+	link.ip = *ipInfo;
+	esp_netif_dns_info_t dns;
+	if(ESP_OK == esp_netif_get_dns_info(_staNetif, ESP_NETIF_DNS_MAIN, &dns))
+		link.dns = dns.ip.u_addr.ip4.addr;
+	if(_cacheValid && 0 == memcmp(&link, &_cache, sizeof(link)))
+		return;
+
+	nvs_handle_t handle;
+	esp_err_t E = nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle);
+	if(ESP_OK == E){
+		E = nvs_set_blob(handle, WIFI_CACHE_KEY, &link, sizeof(link));
+		if(ESP_OK == E)
+			E = nvs_commit(handle);
+		nvs_close(handle);
+	}
+	if(ESP_OK != E){
+		ESP_LOGE(WiFi_TAG, "Cannot cache link: %s", esp_err_to_name(E));
+		return;
+	}
+	_cache = link;
+	_cacheValid = true;
+}
+
+/**
+ * @brief      Uses the cached lease as static IP so no DHCP exchange is needed to get an address
+ */
+static void _applyCachedLease(){
+	if(!_cacheValid || 0 == _cache.ip.ip.addr)
+		return;
+	if(ESP_OK != esp_netif_dhcpc_stop(_staNetif) || ESP_OK != esp_netif_set_ip_info(_staNetif, &_cache.ip)){
+		ESP_LOGW(WiFi_TAG, "Cannot reuse cached lease, using DHCP");
+		esp_netif_dhcpc_start(_staNetif);
+		return;
+	}
+	if(0 != _cache.dns){
+		esp_netif_dns_info_t dns = {0};
+		dns.ip.type = ESP_IPADDR_TYPE_V4;
+		dns.ip.u_addr.ip4.addr = _cache.dns;
+		esp_netif_set_dns_info(_staNetif, ESP_NETIF_DNS_MAIN, &dns);
+	}
+	ESP_LOGI(WiFi_TAG, "Static IP from cached lease: " IPSTR, IP2STR(&_cache.ip.ip));
+}
+
+// @brief Reconnect timer callback
+static void _reconnect(void *arg){
+	esp_wifi_connect();
+}
+
+/**
+ * @brief      WiFi handler: connects on start and reconnects forever with backoff when the AP is lost.
+ *             WIFI_FAILURE is set after MAXIMUM_RETRY attempts but reconnection continues.
  *
  * @param      arg         Arguments (not used)
  * @param[in]  event_base  Event base 
  * @param[in]  event_id    Event identifier
- * @param      event_data  Event data (not used)
+ * @param      event_data  Event data (disconnection reason)
  */
 static void _WiFiHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data){
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
     	ESP_LOGI(WiFi_TAG, "Connecting to AP ...");
+        _connectStart_us = esp_timer_get_time();
         esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        ESP_LOGI(WiFi_TAG, "Associated in %" PRId64 " ms", (esp_timer_get_time() - _connectStart_us) / 1000);
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (_retryNum < MAXIMUM_RETRY) {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        xEventGroupClearBits(wifiEventGroup, WIFI_SUCCESS);
+        if (_linkUp) {
+            // Outage starts now, reconnection time is measured from here. First attempt goes
+            // straight to the AP we were connected to
+            _linkUp = false;
+            _connectStart_us = esp_timer_get_time();
+            if (_cacheValid && !_usingCachedAP) {
+                _wifiConfig.sta.channel = _cache.channel;
+                _wifiConfig.sta.bssid_set = true;
+                memcpy(_wifiConfig.sta.bssid, _cache.bssid, sizeof(_wifiConfig.sta.bssid));
+                esp_wifi_set_config(WIFI_IF_STA, &_wifiConfig);
+                _usingCachedAP = true;
+            }
+        }
+        else if (_usingCachedAP) {
+            // Cached AP may have moved to another channel or be gone: next attempts scan
+            _usingCachedAP = false;
+            _wifiConfig.sta.bssid_set = false;
+            _wifiConfig.sta.channel = 0;
+            esp_wifi_set_config(WIFI_IF_STA, &_wifiConfig);
+        }
+        uint32_t delay_ms = 0;
+        if (_retryNum > 0) {
+            int shift = (_retryNum > 8) ? 8 : _retryNum - 1;
+            delay_ms = WIFI_RECONNECT_MIN_MS << shift;
+            delay_ms = (delay_ms > WIFI_RECONNECT_MAX_MS) ? WIFI_RECONNECT_MAX_MS : delay_ms;
+        }
+        _retryNum++;
+        if (_retryNum == MAXIMUM_RETRY) {
+            xEventGroupSetBits(wifiEventGroup, WIFI_FAILURE);
+        }
+        ESP_LOGI(WiFi_TAG, "Disconnected from AP (reason %d), reconnecting in %" PRIu32 " ms", event->reason, delay_ms);
+        if (delay_ms == 0) {
             esp_wifi_connect();
-            _retryNum++;
-            ESP_LOGI(WiFi_TAG, "Reconnecting to AP ...");
         } else {
-            xEventGroupSetBits(wifiEventGroup, WIFI_FAILURE);
+            esp_timer_stop(_reconnectTimer);
+            esp_timer_start_once(_reconnectTimer, (uint64_t)delay_ms * 1000);
         }
-        ESP_LOGI(WiFi_TAG,"Failed to reconnect to AP :(");
 	}
 }
 
 /**
- * @brief      IP handler: Print acquired IP
+ * @brief      IP handler: reports time to get IP since connection (or outage) started and caches the link
  *
  * @param      arg         Arguments (not used)
  * @param[in]  event_base  Event base 
  * @param[in]  event_id    Event identifier
- * @param      event_data  Event data (not used)
+ * @param      event_data  Event data (acquired IP)
  */
 static void _IPHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data){
 	if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 	        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-	        ESP_LOGI(WiFi_TAG, "Acquired static IP:" IPSTR, IP2STR(&event->ip_info.ip));
+	        _lastConnectTime_ms = (uint32_t)((esp_timer_get_time() - _connectStart_us) / 1000);
+	        ESP_LOGI(WiFi_TAG, "Acquired IP:" IPSTR " in %" PRIu32 " ms after %d retries",
+	                 IP2STR(&event->ip_info.ip), _lastConnectTime_ms, _retryNum);
 	        _retryNum = 0;
+	        _linkUp = true;
+	        _storeLinkCache(&event->ip_info);
 	        xEventGroupSetBits(wifiEventGroup, WIFI_SUCCESS);
 	}
 }
 
 /**
- * @brief      Configure WiFi connection, password can be empty if AP is open
+ * @brief      Configure WiFi connection, password can be empty if AP is open.
+ *             If the last link was to this SSID its channel and BSSID are used to skip the scan
  *
  * @param[in]   ssid    Access point name
  * @param[in]   psswd   Password for access point
  */
 static void _configureConnection(const char ssid[], const char psswd[]) {
 
-    wifi_config_t wifi_config = { 0 };
+    memset(&_wifiConfig, 0, sizeof(_wifiConfig));
 
     // Copiar SSID
-    strncpy((char*)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid) - 1);
+    strncpy((char*)_wifiConfig.sta.ssid, ssid, sizeof(_wifiConfig.sta.ssid) - 1);
 
     // Copiar password
-    strncpy((char*)wifi_config.sta.password, psswd, sizeof(wifi_config.sta.password) - 1);
+    strncpy((char*)_wifiConfig.sta.password, psswd, sizeof(_wifiConfig.sta.password) - 1);
 
     // Si la contraseña está vacía → red abierta
-    wifi_config.sta.threshold.authmode =
+    _wifiConfig.sta.threshold.authmode =
         (psswd[0] == '\0') ? WIFI_AUTH_OPEN : WIFI_AUTH_WPA2_PSK;
 
-    wifi_config.sta.pmf_cfg.capable = true;
-    wifi_config.sta.pmf_cfg.required = false;
+    _wifiConfig.sta.pmf_cfg.capable = true;
+    _wifiConfig.sta.pmf_cfg.required = false;
+
+    // Canal y BSSID de la ultima conexion: se conecta sin escanear todos los canales
+    if (_cacheValid) {
+        _wifiConfig.sta.channel = _cache.channel;
+        _wifiConfig.sta.bssid_set = true;
+        memcpy(_wifiConfig.sta.bssid, _cache.bssid, sizeof(_wifiConfig.sta.bssid));
+        _usingCachedAP = true;
+    }
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &_wifiConfig));
 }
 
-esp_err_t WiFiInit(const char ssid[], const char psswd[]){
+esp_err_t WiFiInit(const char ssid[], const char psswd[], bool reuseLease){
 	esp_err_t errorStatus = WIFI_FAILURE;
 	_initPeripherialsAndDrivers();
 
 	wifiEventGroup = xEventGroupCreate();
+	_sendMutex = xSemaphoreCreateMutex();
 
-	esp_event_handler_instance_t instance_any_id;
+	// Handlers stay registered for the lifetime of the device so a lost AP is always recovered
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                         ESP_EVENT_ANY_ID,
                                                         &_WiFiHandler,
                                                         NULL,
-                                                        &instance_any_id));
-	esp_event_handler_instance_t instance_got_ip;
+                                                        NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
                                                     IP_EVENT_STA_GOT_IP,
                                                     &_IPHandler,
                                                     NULL,
-                                                    &instance_got_ip));
-
+                                                    NULL));
+	const esp_timer_create_args_t reconnectArgs = {
+		.callback = _reconnect,
+		.name = "wifi_reconnect",
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&reconnectArgs, &_reconnectTimer));
+
+	_loadLinkCache(ssid);
 	_configureConnection(ssid, psswd);
+	if (reuseLease)
+		_applyCachedLease();
 
     ESP_ERROR_CHECK(esp_wifi_start());
 
@@ -130,19 +275,38 @@ esp_err_t WiFiInit(const char ssid[], const char psswd[]){
         ESP_LOGI(WiFi_TAG, "Connected to AP");
         errorStatus = WIFI_SUCCESS;
     } else if (bits & WIFI_FAILURE) {
-        ESP_LOGI(WiFi_TAG, "Failed to connect to AP");
+        ESP_LOGI(WiFi_TAG, "Failed to connect to AP, retrying in background");
         errorStatus = WIFI_FAILURE;
     } else {
         ESP_LOGE(WiFi_TAG, "Something weir happend");
         errorStatus = WIFI_FAILURE;
     }
+    xEventGroupClearBits(wifiEventGroup, WIFI_FAILURE);
 
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
-	ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
+	return errorStatus;
+}
 
-	vEventGroupDelete(wifiEventGroup);
 
-	return errorStatus;
+esp_err_t WiFiWaitForIP(TickType_t timeout){
+	EventBits_t bits = xEventGroupWaitBits(wifiEventGroup, WIFI_SUCCESS, pdFALSE, pdTRUE, timeout);
+	return (bits & WIFI_SUCCESS) ? WIFI_SUCCESS : WIFI_FAILURE;
+}
+
+
+uint32_t WiFiLastConnectTime(){
+	return _lastConnectTime_ms;
+}
+
+
+void getDeviceID(char id[], size_t len){
+	uint8_t mac[6] = {0};
+	esp_read_mac(mac, ESP_MAC_WIFI_STA);
+	snprintf(id, len, "gh-%02x%02x%02x", mac[3], mac[4], mac[5]);
+}
+
+
+void setServerPublisher(ServerPublisher publisher){
+	_publisher = publisher;
 }
 
 
@@ -164,8 +328,113 @@ esp_err_t connectTCPServer(int mySocket, const char ip[], in_port_t port){
 }
 
 
+/**
+ * @brief      Writes the whole buffer. Sessions use non blocking sockets, so a full socket is waited
+ *             with select() up to SEND_TIMEOUT_MS instead of being taken as a lost session.
+ *             Must be called with the send mutex held.
+ *
+ * @return
+ * - TCP_SUCCESS If every byte was written
+ * - TCP_FAILURE On socket error or timeout, the stream may end with part of the message
+ */
+static esp_err_t _sendAll(int mySocket, const void *buffer, size_t length){
+	const uint8_t *data = buffer;
+	int64_t deadline_us = esp_timer_get_time() + (int64_t)SEND_TIMEOUT_MS * 1000;
+	while(length > 0){
+		int sent = send(mySocket, data, length, 0);
+		if(sent >= 0){
+			data += sent;
+			length -= sent;
+			continue;
+		}
+		if(EAGAIN != errno && EWOULDBLOCK != errno){
+			ESP_LOGE(WiFi_TAG, "Error occurred during sending: errno %d", errno);
+			return TCP_FAILURE;
+		}
+		int64_t remaining_us = deadline_us - esp_timer_get_time();
+		if(remaining_us <= 0){
+			ESP_LOGE(WiFi_TAG, "Socket full for %d ms, %u bytes not sent", SEND_TIMEOUT_MS, (unsigned)length);
+			return TCP_FAILURE;
+		}
+		fd_set writable;
+		FD_ZERO(&writable);
+		FD_SET(mySocket, &writable);
+		struct timeval timeout = {
+			.tv_sec = remaining_us / 1000000,
+			.tv_usec = remaining_us % 1000000,
+		};
+		if(select(mySocket + 1, NULL, &writable, NULL, &timeout) < 0){
+			ESP_LOGE(WiFi_TAG, "Error waiting for socket: errno %d", errno);
+			return TCP_FAILURE;
+		}
+	}
+	return TCP_SUCCESS;
+}
+
+// @brief Writes one complete message under the send mutex
+static esp_err_t _sendMessage(int mySocket, const void *buffer, size_t length){
+	xSemaphoreTake(_sendMutex, portMAX_DELAY);
+	esp_err_t transactionStatus = _sendAll(mySocket, buffer, length);
+	xSemaphoreGive(_sendMutex);
+	return transactionStatus;
+}
+
+
+/**
+ * @brief      Sends a JSON object as a single line terminated with '\n'
+ *
+ * @param[in]  mySocket    Socket to use
+ * @param      root        JSON object to send
+ * @param[in]  kind        Kind of message (used by publisher if set)
+ * @param      lineBuffer  Where line is rendered
+ * @param[in]  size        Size of lineBuffer
+ *
+ * @return
+ * - TCP_SUCCESS If data was delivered successfully
+ * - TCP_FAILURE If data failed to be sent
+ * - ESP_ERR_INVALID_SIZE If the JSON does not fit in lineBuffer, nothing is sent and the session is intact
+ *
+ * @note The line is rendered in lineBuffer and written under the send mutex, so lines sent from
+ *       different tasks never get interleaved
+ */
+static esp_err_t _sendJSONBuffer(int mySocket, cJSON *root, ServerMessageKind kind, char lineBuffer[], size_t size){
+	if(!cJSON_PrintPreallocated(root, lineBuffer, size - 1, false)){
+		ESP_LOGE(WiFi_TAG, "Cannot serialize JSON");
+		return ESP_ERR_INVALID_SIZE;
+	}
+	size_t len = strlen(lineBuffer);
+	if(_publisher)
+		return _publisher(kind, (const uint8_t *)lineBuffer, len);
+	lineBuffer[len++] = '\n';
+	return _sendMessage(mySocket, lineBuffer, len);
+}
+
+// @brief Sends a JSON object as a single line rendered in a JSON_LINE_MAX_LEN stack buffer
+static esp_err_t _sendJSONLine(int mySocket, cJSON *root, ServerMessageKind kind){
+	char lineBuffer[JSON_LINE_MAX_LEN];
+	return _sendJSONBuffer(mySocket, root, kind, lineBuffer, sizeof(lineBuffer));
+}
+
+
+esp_err_t sendHelloToServer(int mySocket, bool irrigation, float desiredTemperature){
+	char deviceID[DEVICE_ID_LEN];
+	getDeviceID(deviceID, sizeof(deviceID));
+
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddStringToObject(root, "hello", deviceID);
+	cJSON_AddNumberToObject(root, "uptime", esp_log_timestamp() / 1000);
+	// Keyed by the function that sets each value, like the states of the acks
+	cJSON *state = cJSON_AddObjectToObject(root, "state");
+	cJSON_AddNumberToObject(state, "setIrrigation", irrigation ? 1 : 0);
+	cJSON_AddNumberToObject(state, "setDesiredTemperature", round(desiredTemperature * 100.0) / 100.0);
+
+	esp_err_t transactionStatus = _sendJSONLine(mySocket, root, SERVER_MSG_TELEMETRY);
+	cJSON_Delete(root);
+	return transactionStatus;
+}
+
+
 esp_err_t sendSensorsDataToServer(int mySocket, float LM135Temp, float AM2302Hum, float AM2302Temp){
-	int transactionStatus = TCP_SUCCESS;
     cJSON *root = cJSON_CreateObject();
 	cJSON *sensors = cJSON_CreateArray();
 
@@ -183,18 +452,226 @@ esp_err_t sendSensorsDataToServer(int mySocket, float LM135Temp, float AM2302Hum
 
     cJSON_AddItemToObject(root, "sensors", sensors);
 
-	char *json_str = cJSON_Print(root);
-
-    int err = send(mySocket, json_str, strlen(json_str), 0);
-    if (err < 0) {
-        ESP_LOGE(WiFi_TAG, "Error occurred during sending: errno %d", errno);
-        transactionStatus = TCP_FAILURE;
-    }
-    cJSON_free(json_str);
+	esp_err_t transactionStatus = _sendJSONLine(mySocket, root, SERVER_MSG_TELEMETRY);
    	cJSON_Delete(root);
     return transactionStatus;
 }
 
+
+esp_err_t sendSummaryToServer(int mySocket, uint32_t windowStart, bool uptime, uint32_t window_s,
+                              const ChannelSummary summaries[AGGREGATION_CHANNELS]){
+	static const char *channelNames[AGGREGATION_CHANNELS] = {"LM135", "AM2302T", "AM2302H"};
+	if(NULL == summaries)
+		return TCP_FAILURE;
+
+	cJSON *root = cJSON_CreateObject();
+	cJSON *summary = cJSON_AddObjectToObject(root, "summary");
+	cJSON_AddNumberToObject(summary, "start", windowStart);
+	cJSON_AddNumberToObject(summary, "flags", uptime ? JOURNAL_FLAG_UPTIME : 0);
+	cJSON_AddNumberToObject(summary, "window", window_s);
+	cJSON *channels = cJSON_AddObjectToObject(summary, "channels");
+	for(int ch = 0; ch < AGGREGATION_CHANNELS; ++ch){
+		cJSON *channel = cJSON_AddObjectToObject(channels, channelNames[ch]);
+		cJSON_AddNumberToObject(channel, "n", summaries[ch].count);
+		// Rounded in double, a float widened by cJSON prints with 17 digits
+		cJSON_AddNumberToObject(channel, "mean", round(summaries[ch].mean * 100.0) / 100.0);
+		cJSON_AddNumberToObject(channel, "min", round(summaries[ch].min * 100.0) / 100.0);
+		cJSON_AddNumberToObject(channel, "max", round(summaries[ch].max * 100.0) / 100.0);
+		cJSON_AddNumberToObject(channel, "std", round(summaries[ch].stddev * 1000.0) / 1000.0);
+	}
+
+	char lineBuffer[SUMMARY_LINE_MAX_LEN];
+	esp_err_t transactionStatus = _sendJSONBuffer(mySocket, root, SERVER_MSG_TELEMETRY, lineBuffer, sizeof(lineBuffer));
+	cJSON_Delete(root);
+	return transactionStatus;
+}
+
+
+// @brief Builds the acknowledge JSON of a command
+static cJSON *_ackJSON(const ServerCommand *cmd, esp_err_t result, float appliedState, int64_t applyTime_us){
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "ack", cmd->id);
+	cJSON_AddNumberToObject(root, "timestamp", cmd->timestamp);
+	cJSON_AddStringToObject(root, "function", cmd->function);
+	cJSON_AddStringToObject(root, "status", (ESP_OK == result) ? "ok" : esp_err_to_name(result));
+	cJSON_AddNumberToObject(root, "state", appliedState);
+	cJSON_AddNumberToObject(root, "applyTime_us", (double)applyTime_us);
+	return root;
+}
+
+
+int openDatagramSocket(const char ip[], in_port_t port){
+	int mySocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(mySocket < 0){
+		ESP_LOGE(WiFi_TAG, "Failed to create UDP socket");
+		return -1;
+	}
+	struct sockaddr_in serverInfo = {0};
+	serverInfo.sin_family = AF_INET;
+	inet_pton(AF_INET, ip, &serverInfo.sin_addr);
+	serverInfo.sin_port = port;
+	// UDP connect only sets the default destination, nothing is sent
+	if(connect(mySocket, (struct sockaddr *)&serverInfo, sizeof(serverInfo)) != 0){
+		ESP_LOGE(WiFi_TAG, "Invalid UDP destination %s", ip);
+		close(mySocket);
+		return -1;
+	}
+	return mySocket;
+}
+
+
+esp_err_t sendSensorsDatagramToServer(int mySocket, uint32_t sequence, float LM135Temp, float AM2302Hum, float AM2302Temp){
+	static uint8_t deviceMAC[6] = {0};
+	static bool hasMAC = false;
+	static uint16_t bootID = 0;
+	if(!hasMAC){
+		hasMAC = (ESP_OK == esp_read_mac(deviceMAC, ESP_MAC_WIFI_STA));
+		bootID = (uint16_t)esp_random();
+	}
+
+	TelemetryDatagram datagram = {
+		.magic = TELEMETRY_DATAGRAM_MAGIC,
+		.bootID = bootID,
+		.sequence = sequence,
+		.LM135Temp = (int16_t)lroundf(LM135Temp * 10.0f),
+		.AM2302Temp = (int16_t)lroundf(AM2302Temp * 10.0f),
+		.AM2302Hum = (uint16_t)lroundf(AM2302Hum * 10.0f),
+	};
+	memcpy(datagram.deviceMAC, deviceMAC, sizeof(deviceMAC));
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	if(now.tv_sec >= JOURNAL_MIN_VALID_EPOCH){
+		datagram.timestamp_ms = (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+	}
+	else{
+		datagram.timestamp_ms = esp_timer_get_time() / 1000;
+		datagram.flags = TELEMETRY_DATAGRAM_FLAG_UPTIME;
+	}
+
+	if(send(mySocket, &datagram, sizeof(datagram), 0) < 0){
+		ESP_LOGD(WiFi_TAG, "Datagram %" PRIu32 " not sent: errno %d", sequence, errno);
+		return TCP_FAILURE;
+	}
+	return TCP_SUCCESS;
+}
+
+
+esp_err_t sendAckToServer(int mySocket, const ServerCommand *cmd, esp_err_t result, float appliedState, int64_t applyTime_us){
+	if(NULL == cmd)
+		return TCP_FAILURE;
+
+	cJSON *root = _ackJSON(cmd, result, appliedState, applyTime_us);
+	esp_err_t transactionStatus = _sendJSONLine(mySocket, root, SERVER_MSG_ACK);
+	cJSON_Delete(root);
+	return transactionStatus;
+}
+
+esp_err_t renderAckJSON(char buffer[], size_t size, const ServerCommand *cmd, esp_err_t result, float appliedState, int64_t applyTime_us){
+	if(NULL == cmd || NULL == buffer)
+		return ESP_ERR_INVALID_ARG;
+
+	cJSON *root = _ackJSON(cmd, result, appliedState, applyTime_us);
+	bool rendered = cJSON_PrintPreallocated(root, buffer, size, false);
+	cJSON_Delete(root);
+	return rendered ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t sendBatchAckToServer(int mySocket, const ServerCommandBatch *batch, esp_err_t result,
+                               const esp_err_t results[], const float states[], int64_t applyTime_us){
+	if(NULL == batch || (batch->count > 0 && (NULL == results || NULL == states)))
+		return TCP_FAILURE;
+
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "ack", batch->id);
+	cJSON_AddNumberToObject(root, "timestamp", batch->timestamp);
+	cJSON_AddStringToObject(root, "status", (ESP_OK == result) ? "ok" : esp_err_to_name(result));
+	cJSON_AddNumberToObject(root, "applyTime_us", (double)applyTime_us);
+	cJSON *operations = cJSON_AddArrayToObject(root, "batch");
+	for(size_t i = 0; i < batch->count; ++i){
+		cJSON *operation = cJSON_CreateObject();
+		cJSON_AddStringToObject(operation, "function", batch->operations[i].function);
+		cJSON_AddStringToObject(operation, "status", (ESP_OK == results[i]) ? "ok" : esp_err_to_name(results[i]));
+		cJSON_AddNumberToObject(operation, "state", states[i]);
+		cJSON_AddItemToArray(operations, operation);
+	}
+
+	char lineBuffer[BATCH_ACK_LINE_MAX_LEN];
+	esp_err_t transactionStatus = _sendJSONBuffer(mySocket, root, SERVER_MSG_ACK, lineBuffer, sizeof(lineBuffer));
+	cJSON_Delete(root);
+	return transactionStatus;
+}
+
+esp_err_t sendLogBatchToServer(int mySocket, const LogEntry entries[], size_t count, const LogStreamStats *stats){
+	static char deviceID[DEVICE_ID_LEN] = "";
+	if((count > 0 && NULL == entries) || NULL == stats)
+		return TCP_FAILURE;
+	if('\0' == deviceID[0])
+		getDeviceID(deviceID, sizeof(deviceID));
+
+	// Line timestamps are ms since boot, uptime lets the server place them in wall clock time
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddStringToObject(root, "device", deviceID);
+	cJSON_AddNumberToObject(root, "uptime", esp_log_timestamp());
+	cJSON_AddNumberToObject(root, "dropped", stats->dropped);
+	cJSON_AddNumberToObject(root, "suppressed", stats->suppressed);
+	cJSON *logs = cJSON_AddArrayToObject(root, "logs");
+	for(size_t i = 0; i < count; ++i){
+		const char level[2] = {entries[i].level, '\0'};
+		cJSON *line = cJSON_CreateArray();
+		cJSON_AddItemToArray(line, cJSON_CreateNumber(entries[i].timestamp_ms));
+		cJSON_AddItemToArray(line, cJSON_CreateString(level));
+		cJSON_AddItemToArray(line, cJSON_CreateString(entries[i].tag));
+		cJSON_AddItemToArray(line, cJSON_CreateString(entries[i].message));
+		cJSON_AddItemToArray(logs, line);
+	}
+
+	char lineBuffer[LOG_BATCH_LINE_MAX_LEN];
+	esp_err_t transactionStatus = _sendJSONBuffer(mySocket, root, SERVER_MSG_LOG, lineBuffer, sizeof(lineBuffer));
+	cJSON_Delete(root);
+	return transactionStatus;
+}
+
+
+esp_err_t sendCompactFrameToServer(int mySocket, const uint8_t frame[], size_t length){
+	if(_publisher)
+		return _publisher(SERVER_MSG_TELEMETRY, frame, length);
+	return _sendMessage(mySocket, frame, length);
+}
+
+
+esp_err_t sendJournalChunkToServer(int mySocket, uint32_t segment, size_t offset, const JournalRecord records[], size_t count){
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "journal", segment);
+	cJSON_AddNumberToObject(root, "offset", offset);
+	cJSON_AddNumberToObject(root, "uptime", (double)(esp_timer_get_time() / 1000000));
+	// Uptime only places records of this boot, the server compares it with the boot of each record
+	cJSON_AddNumberToObject(root, "boot", journalBootCount());
+	cJSON *JSONrecords = cJSON_AddArrayToObject(root, "records");
+	for(size_t i = 0; i < count; ++i){
+		if(!journalRecordIsValid(&records[i]))
+			continue;
+		// [timestamp, flags, LM135 (0.1 °C), AM2302 T (0.1 °C), AM2302 H (0.1 %), boot]
+		const double fields[] = {records[i].timestamp, records[i].flags, records[i].LM135Temp,
+			records[i].AM2302Temp, records[i].AM2302Hum, records[i].boot};
+		cJSON_AddItemToArray(JSONrecords, cJSON_CreateDoubleArray(fields, 6));
+	}
+
+	esp_err_t transactionStatus = _sendJSONLine(mySocket, root, SERVER_MSG_JOURNAL);
+	cJSON_Delete(root);
+	return transactionStatus;
+}
+
+
+esp_err_t sendJournalSegmentEndToServer(int mySocket, uint32_t segment, size_t count){
+	cJSON *root = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root, "journalEnd", segment);
+	cJSON_AddNumberToObject(root, "records", count);
+
+	esp_err_t transactionStatus = _sendJSONLine(mySocket, root, SERVER_MSG_JOURNAL);
+	cJSON_Delete(root);
+	return transactionStatus;
+}
+
 void printJSONParsingError(){
     const char *error_ptr = cJSON_GetErrorPtr();
     if (error_ptr != NULL) {
@@ -203,35 +680,108 @@ void printJSONParsingError(){
 }
 
 
-void decodeJSONServerMessage(const char buffer[], char funcName[], float *arg){
-    cJSON *json = cJSON_Parse(buffer);
-    if (json == NULL) {
-        printJSONParsingError();
-        *funcName = '\0';
-        cJSON_Delete(json);
-        return;
-    }
+// @brief Reads function, argument and channel of a command object (id and timestamp are left as they are)
+static esp_err_t _decodeCommand(const cJSON *json, ServerCommand *cmd){
     // Get function name from JSON
     cJSON *JSONfunc = cJSON_GetObjectItemCaseSensitive(json, "function");
     if(NULL == JSONfunc || !cJSON_IsString(JSONfunc) || JSONfunc->valuestring == NULL){
         printJSONParsingError();
-        *funcName = '\0';
-        cJSON_Delete(json);
-        return;
+        return ESP_ERR_INVALID_ARG;
     }
 
     // Get argument from JSON
     cJSON *JSONarg = cJSON_GetObjectItemCaseSensitive(json, "argument");
     if(NULL ==JSONarg){
         printJSONParsingError();
-        *funcName = '\0';
-        cJSON_Delete(json);
-        return;
+        return ESP_ERR_INVALID_ARG;
     }
-    
-    strcpy(funcName, JSONfunc->valuestring);
+
+    cJSON *JSONchannel = cJSON_GetObjectItemCaseSensitive(json, "channel");
+    if(cJSON_IsNumber(JSONchannel))
+        cmd->channel = JSONchannel->valueint;
+
+    strncpy(cmd->function, JSONfunc->valuestring, FUNCTION_NAME_MAX_LEN - 1);
     if(cJSON_IsNumber(JSONarg))
-        *arg = (float)JSONarg->valuedouble;
+        cmd->argument = (float)JSONarg->valuedouble;
+    return ESP_OK;
+}
 
+// @brief Id and timestamp are optional so old servers keep working
+static void _decodeCommandID(const cJSON *json, uint32_t *id, double *timestamp){
+    cJSON *JSONid = cJSON_GetObjectItemCaseSensitive(json, "id");
+    if(cJSON_IsNumber(JSONid))
+        *id = (uint32_t)JSONid->valuedouble;
+    cJSON *JSONtimestamp = cJSON_GetObjectItemCaseSensitive(json, "timestamp");
+    if(cJSON_IsNumber(JSONtimestamp))
+        *timestamp = JSONtimestamp->valuedouble;
+}
+
+
+esp_err_t decodeJSONServerMessage(const char buffer[], ServerCommand *cmd){
+    if(NULL == cmd)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(cmd, 0, sizeof(ServerCommand));
+    cmd->channel = -1;
+    cJSON *json = cJSON_Parse(buffer);
+    if (json == NULL) {
+        printJSONParsingError();
+        return ESP_ERR_INVALID_ARG;
+    }
+    _decodeCommandID(json, &cmd->id, &cmd->timestamp);
+    esp_err_t result = _decodeCommand(json, cmd);
     cJSON_Delete(json);
-}
\ No newline at end of file
+    return result;
+}
+
+
+esp_err_t decodeJSONServerBatch(const char buffer[], ServerCommandBatch *batch){
+    if(NULL == batch)
+        return ESP_ERR_INVALID_ARG;
+
+    // A message that does not parse is acked as a plain command with no function, so operations[0]
+    // must be initialized before parsing
+    memset(batch, 0, sizeof(ServerCommandBatch));
+    batch->single = true;
+    batch->operations[0].channel = -1;
+    cJSON *json = cJSON_Parse(buffer);
+    if (json == NULL) {
+        printJSONParsingError();
+        return ESP_ERR_INVALID_ARG;
+    }
+    _decodeCommandID(json, &batch->id, &batch->timestamp);
+    cJSON *operations = cJSON_GetObjectItemCaseSensitive(json, "batch");
+    esp_err_t result = ESP_OK;
+    if(NULL == operations){
+        // Plain command: a batch of one
+        ServerCommand *cmd = &batch->operations[0];
+        cmd->id = batch->id;
+        cmd->timestamp = batch->timestamp;
+        result = _decodeCommand(json, cmd);
+        batch->count = (ESP_OK == result) ? 1 : 0;
+        cJSON_Delete(json);
+        return result;
+    }
+
+    batch->single = false;
+    int count = cJSON_IsArray(operations) ? cJSON_GetArraySize(operations) : 0;
+    if(count <= 0 || count > COMMAND_BATCH_MAX_OPS){
+        ESP_LOGE(WiFi_TAG, "Batch with %d operations", count);
+        cJSON_Delete(json);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const cJSON *operation;
+    cJSON_ArrayForEach(operation, operations){
+        ServerCommand *cmd = &batch->operations[batch->count];
+        memset(cmd, 0, sizeof(ServerCommand));
+        cmd->id = batch->id;
+        cmd->timestamp = batch->timestamp;
+        cmd->channel = -1;
+        result = _decodeCommand(operation, cmd);
+        if(ESP_OK != result)
+            break;
+        batch->count++;
+    }
+    cJSON_Delete(json);
+    return result;
+}
@@ -10,6 +10,9 @@
 #pragma once
 #include <netdb.h>  
 #include "cJSON.h"
+#include "Journal.h"
+#include "Aggregation.h"
+#include "LogStream.h"
 #include "esp_wifi.h"
 #include "esp_err.h"
 #include "esp_log.h"
@@ -19,34 +22,161 @@
 #include "esp_event.h"
 #include "esp_event_base.h"
 #include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
 #include "esp_netif_types.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_wifi_types_generic.h"
+#include "esp_netif.h"
+#include "nvs.h"
 #include "freertos/idf_additions.h"
+#include "freertos/semphr.h"
 #include "lwip/inet.h"
 #include "lwip/sockets.h"
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 
 #define MAXIMUM_RETRY 8
+#define WIFI_RECONNECT_MIN_MS 250
+#define WIFI_RECONNECT_MAX_MS 30000
+#define WIFI_CACHE_NAMESPACE "wifi_cache"
+#define WIFI_CACHE_KEY "link"
+#define WIFI_CACHE_VERSION 1
 #define WIFI_SUCCESS 1 << 0
 #define WIFI_FAILURE 1 << 1
 #define TCP_SUCCESS 1 << 0
 #define TCP_FAILURE 1 << 1
+#define FUNCTION_NAME_MAX_LEN 64
+#define JSON_LINE_MAX_LEN 384
+#define LOG_BATCH_LINE_MAX_LEN 1280
+#define SUMMARY_LINE_MAX_LEN 512         // Summary of every channel with the widest values
+#define COMMAND_BATCH_MAX_OPS 8
+#define COMMAND_MESSAGE_MAX_LEN 768      // Longest command line, a full batch fits
+#define BATCH_ACK_LINE_MAX_LEN 1024
+#define SEND_TIMEOUT_MS 5000              // Longest wait for room in a full socket before giving up on a message
+#define DEVICE_ID_LEN 10
+#define TELEMETRY_DATAGRAM_MAGIC 0xA6
+#define TELEMETRY_DATAGRAM_FLAG_UPTIME (1 << 0)
 
+typedef enum{
+	SERVER_MSG_TELEMETRY = 0,
+	SERVER_MSG_ACK,
+	SERVER_MSG_JOURNAL,
+	SERVER_MSG_LOG,
+	SERVER_MSG_KINDS
+}ServerMessageKind;
 
 /**
- * @brief      			Initializes the WiFi interface and connects to an AP
- * @param[in] 	ssid	Access point name
- * @param[in]	psswd 	Password for access point
+ * Alternative transport for messages to server. Must return TCP_SUCCESS or TCP_FAILURE.
+ */
+typedef esp_err_t (*ServerPublisher)(ServerMessageKind kind, const uint8_t data[], size_t length);
+
+/**
+ * Last successful link, stored in NVS to skip the scan (and optionally DHCP) on the next connection
+ */
+typedef struct{
+	uint8_t version;
+	uint8_t channel;
+	uint8_t bssid[6];
+	char ssid[33];
+	esp_netif_ip_info_t ip;
+	uint32_t dns;
+}WiFiLinkCache;
+
+typedef struct{
+	uint32_t id;
+	double timestamp;
+	char function[FUNCTION_NAME_MAX_LEN];
+	float argument;
+	int channel;
+}ServerCommand;
+
+/**
+ * Operations sent in one message with one id. The device applies all of them before the next
+ * control tick, or none if one is invalid, and answers with a single ack.
+ */
+typedef struct{
+	uint32_t id;
+	double timestamp;
+	bool single;                         // Message was a plain command, operations[0] holds it
+	size_t count;
+	ServerCommand operations[COMMAND_BATCH_MAX_OPS];
+}ServerCommandBatch;
+
+/**
+ * Self-contained UDP telemetry sample. Values are fixed point x10 (like JournalRecord) and all fields
+ * are little endian. If TELEMETRY_DATAGRAM_FLAG_UPTIME is set, timestamp is ms since boot.
+ * bootID is random on every boot so the server can tell a restarted sequence from late datagrams.
+ */
+typedef struct __attribute__((packed)){
+	uint8_t magic;
+	uint8_t flags;
+	uint16_t bootID;
+	uint8_t deviceMAC[6];
+	uint32_t sequence;
+	uint64_t timestamp_ms;
+	int16_t LM135Temp;
+	int16_t AM2302Temp;
+	uint16_t AM2302Hum;
+}TelemetryDatagram;
+
+
+/**
+ * @brief      			Initializes the WiFi interface and connects to an AP, using the cached channel
+ *             			and BSSID of the last connection when there is one
+ * @param[in] 	ssid		Access point name
+ * @param[in]	psswd 		Password for access point
+ * @param[in]	reuseLease	Use the cached IP lease as static IP instead of waiting for DHCP
  *
  * @return     
  * - WIFI_SUCCESS	If WiFi was successfully initialized and connection with AP was successfull
- * - WIFI_FAILURE 	If connection with AP was not successfull 
+ * - WIFI_FAILURE 	If connection with AP was not successfull after MAXIMUM_RETRY attempts
+ * @note Reconnection never stops (with backoff up to WIFI_RECONNECT_MAX_MS), even after WIFI_FAILURE
+ * @warning NVS must be initialized
  */
-esp_err_t WiFiInit(const char ssid[], const char psswd[]);
+esp_err_t WiFiInit(const char ssid[], const char psswd[], bool reuseLease);
+
+/**
+ * @brief      Waits until the station has an IP
+ *
+ * @param[in]  timeout  Maximum time to wait (0 just checks)
+ *
+ * @return
+ * - WIFI_SUCCESS	Station has an IP
+ * - WIFI_FAILURE 	Timeout expired without IP
+ */
+esp_err_t WiFiWaitForIP(TickType_t timeout);
+
+/**
+ * @brief      Time from the start of the last connection (or of the last outage) until IP_EVENT_STA_GOT_IP
+ *
+ * @return     Time in ms, 0 if never connected
+ */
+uint32_t WiFiLastConnectTime();
+
+/**
+ * @brief      Gets an identifier for this device derived from its station MAC ("gh-xxxxxx")
+ *
+ * @param[out] id    Where identifier will be written
+ * @param[in]  len   Size of id (at least DEVICE_ID_LEN)
+ */
+void getDeviceID(char id[], size_t len);
+
+/**
+ * @brief      Routes every message to server through publisher instead of a socket
+ *
+ * @param[in]  publisher  Transport to use, NULL goes back to sockets
+ *
+ * @note While a publisher is set the socket argument of the send functions is ignored
+ */
+void setServerPublisher(ServerPublisher publisher);
 
 /**
  * @brief      Connects to a tcp server using specified socket.
@@ -62,7 +192,66 @@ esp_err_t WiFiInit(const char ssid[], const char psswd[]);
 esp_err_t connectTCPServer(int mySocket, const char ip[], in_port_t port);
 
 /**
- * @brief      Sends given sensors data to server as a JSON
+ * @brief      Announces this device (getDeviceID) to the server, first line of every TCP session.
+ *             Also carries the state restored from NVS so the server knows it before any ack
+ *
+ * @param[in]  mySocket            Connected socket
+ * @param[in]  irrigation          Current irrigation state
+ * @param[in]  desiredTemperature  Current setpoint
+ *
+ * @return
+ * - TCP_SUCCESS If data was delivered successfully
+ * - TCP_FAILURE If data failed to be sent
+ *
+ * @note The server keys state and routes commands by this id, until it arrives the session is
+ *       known only by its address
+ */
+esp_err_t sendHelloToServer(int mySocket, bool irrigation, float desiredTemperature);
+
+/**
+ * @brief      Creates a UDP socket whose default destination is ip:port
+ *
+ * @param[in]  ip    Server IP
+ * @param[in]  port  Server port (network order)
+ *
+ * @return     Socket or -1 on error
+ */
+int openDatagramSocket(const char ip[], in_port_t port);
+
+/**
+ * @brief      Sends given sensors data to server as a single sequence numbered datagram
+ *
+ * @param[in]  mySocket    Socket created with openDatagramSocket
+ * @param[in]  sequence    Sequence number, the server accounts gaps as lost samples
+ * @param[in]  LM135Temp   LM135 temperature
+ * @param[in]  AM2302Hum   AM2302 humidity
+ * @param[in]  AM2302Temp  AM2302 temperature
+ *
+ * @return
+ * - TCP_SUCCESS If datagram was handed to the stack (delivery is not guaranteed)
+ * - TCP_FAILURE If it could not be sent
+ */
+esp_err_t sendSensorsDatagramToServer(int mySocket, uint32_t sequence, float LM135Temp, float AM2302Hum, float AM2302Temp);
+
+/**
+ * @brief      Sends the statistics of an aggregation window to server as a newline terminated JSON
+ *
+ * @param[in]  mySocket     Socket to use
+ * @param[in]  windowStart  Start of the window in seconds (unix time, or uptime if uptime is true)
+ * @param[in]  uptime       windowStart is seconds since boot because clock is not synchronized
+ * @param[in]  window_s     Length of the window in seconds
+ * @param[in]  summaries    Statistics of LM135, AM2302 temperature and AM2302 humidity (in that order)
+ *
+ * @return
+ * - TCP_SUCCESS If data was delivered successfully
+ * - TCP_FAILURE If data failed to be sent
+ * - ESP_ERR_INVALID_SIZE If the line does not fit in SUMMARY_LINE_MAX_LEN, nothing is sent
+ */
+esp_err_t sendSummaryToServer(int mySocket, uint32_t windowStart, bool uptime, uint32_t window_s,
+                              const ChannelSummary summaries[AGGREGATION_CHANNELS]);
+
+/**
+ * @brief      Sends given sensors data to server as a newline terminated JSON
  *
  * @param[in]  mySocket    Socket to use
  * @param[in]  LM135Temp   LM135 temperature
@@ -75,16 +264,141 @@ esp_err_t connectTCPServer(int mySocket, const char ip[], in_port_t port);
  */
 esp_err_t sendSensorsDataToServer(int mySocket, float LM135Temp, float AM2302Hum, float AM2302Temp);
 
+/**
+ * @brief      Sends a batch of device log lines as a newline terminated JSON tagged with the device ID
+ *
+ * @param[in]  mySocket  Socket to use
+ * @param[in]  entries   Lines taken from LogStream
+ * @param[in]  count     Number of lines
+ * @param[in]  stats     Lines lost since the previous batch
+ *
+ * @return
+ * - TCP_SUCCESS If data was delivered successfully
+ * - TCP_FAILURE If data failed to be sent
+ * - ESP_ERR_INVALID_SIZE If the batch does not fit in LOG_BATCH_LINE_MAX_LEN, nothing is sent
+ */
+esp_err_t sendLogBatchToServer(int mySocket, const LogEntry entries[], size_t count, const LogStreamStats *stats);
+
+/**
+ * @brief      Sends an already encoded compact telemetry frame (see TelemetryCodec.h)
+ *
+ * @param[in]  mySocket  Socket to use
+ * @param[in]  frame     Frame including its header
+ * @param[in]  length    Frame length
+ *
+ * @return
+ * - TCP_SUCCESS If data was delivered successfully
+ * - TCP_FAILURE If data failed to be sent
+ */
+esp_err_t sendCompactFrameToServer(int mySocket, const uint8_t frame[], size_t length);
+
+/**
+ * @brief      Sends a chunk of journal records stored while the server was unreachable
+ *
+ * @param[in]  mySocket  Socket to use
+ * @param[in]  segment   Journal segment the records belong to
+ * @param[in]  offset    Index of first record inside segment
+ * @param[in]  records   Records to send (corrupted records are skipped)
+ * @param[in]  count     Number of records
+ *
+ * @return
+ * - TCP_SUCCESS If data was delivered successfully
+ * - TCP_FAILURE If data failed to be sent
+ */
+esp_err_t sendJournalChunkToServer(int mySocket, uint32_t segment, size_t offset, const JournalRecord records[], size_t count);
+
+/**
+ * @brief      Tells the server a journal segment was completely sent so it can acknowledge it
+ *
+ * @param[in]  mySocket  Socket to use
+ * @param[in]  segment   Journal segment
+ * @param[in]  count     Number of records in segment
+ *
+ * @return
+ * - TCP_SUCCESS If data was delivered successfully
+ * - TCP_FAILURE If data failed to be sent
+ */
+esp_err_t sendJournalSegmentEndToServer(int mySocket, uint32_t segment, size_t count);
+
 /**
  * @brief      When an error has ocurred after trying to parse a JSON, prints such error
  */
 void printJSONParsingError();
 
 /**
- * @brief      Decodes JSON message from server, extracting function name and argument
+ * @brief      Decodes JSON message from server, extracting command id, timestamp, function name, argument
+ *             and channel (-1 if the command does not target a channel)
+ *
+ * @param[in]  	buffer    Socket input buffer (one JSON message, without delimiter)
+ * @param[out]  cmd       Decoded command
+ *
+ * @return
+ * - ESP_OK If message was decoded successfully
+ * - ESP_ERR_INVALID_ARG If message is not a valid command (cmd->function will be empty)
+ */
+esp_err_t decodeJSONServerMessage(const char buffer[], ServerCommand *cmd);
+
+/**
+ * @brief      Decodes a message from server that can be a plain command or a batch
+ *             {"id", "timestamp", "batch": [{"function", "argument"[, "channel"]}, ...]}
+ *
+ * @param[in]   buffer  Socket input buffer (one JSON message, without delimiter)
+ * @param[out]  batch   Decoded operations, every one with the id and timestamp of the batch.
+ *                      batch->single is set when the message was a plain command or did not parse,
+ *                      operations[0] can always be acked (no function and channel -1 if it did not parse)
+ *
+ * @return
+ * - ESP_OK If message was decoded successfully
+ * - ESP_ERR_INVALID_ARG If message or one of its operations is not a valid command
+ * - ESP_ERR_INVALID_SIZE If batch has no operations or more than COMMAND_BATCH_MAX_OPS
+ */
+esp_err_t decodeJSONServerBatch(const char buffer[], ServerCommandBatch *batch);
+
+/**
+ * @brief      Acknowledges an executed command to the server
+ *
+ * @param[in]  mySocket      Socket to use
+ * @param[in]  cmd           Command that was executed
+ * @param[in]  result        Result of the execution
+ * @param[in]  appliedState  State of the actuator/setpoint after execution
+ * @param[in]  applyTime_us  Time between command reception and application in microseconds
+ *
+ * @return
+ * - TCP_SUCCESS If ack was delivered successfully
+ * - TCP_FAILURE If ack failed to be sent
+ */
+esp_err_t sendAckToServer(int mySocket, const ServerCommand *cmd, esp_err_t result, float appliedState, int64_t applyTime_us);
+
+/**
+ * @brief      Renders the same acknowledge sent by sendAckToServer into a buffer
+ *
+ * @param[out] buffer        Where JSON will be written (NUL terminated)
+ * @param[in]  size          Size of buffer
+ * @param[in]  cmd           Command that was executed
+ * @param[in]  result        Result of the execution
+ * @param[in]  appliedState  State of the actuator/setpoint after execution
+ * @param[in]  applyTime_us  Time between command reception and application in microseconds
  *
- * @param[in]  	buffer    Socket input buffer (JSON received)
- * @param[out]  funcName  Function to execute name
- * @param[out]  arg       Argument for function
+ * @return
+ * - ESP_OK Ack was rendered
+ * - ESP_ERR_INVALID_ARG NULL parameter
+ * - ESP_ERR_INVALID_SIZE Buffer is too small
+ */
+esp_err_t renderAckJSON(char buffer[], size_t size, const ServerCommand *cmd, esp_err_t result, float appliedState, int64_t applyTime_us);
+
+/**
+ * @brief      Acknowledges a batch with the result and state of each of its operations
+ *
+ * @param[in]  mySocket      Socket to use
+ * @param[in]  batch         Batch that was executed
+ * @param[in]  result        Result of the whole batch (ESP_OK only if every operation was applied)
+ * @param[in]  results       Result of each operation (batch->count entries)
+ * @param[in]  states        State after each operation (batch->count entries)
+ * @param[in]  applyTime_us  Time between batch reception and application in microseconds
+ *
+ * @return
+ * - TCP_SUCCESS If ack was delivered successfully
+ * - TCP_FAILURE If ack failed to be sent
  */
-void decodeJSONServerMessage(const char buffer[], char funcName[], float *arg);
\ No newline at end of file
+esp_err_t sendBatchAckToServer(int mySocket, const ServerCommandBatch *batch, esp_err_t result,
+                               const esp_err_t results[], const float states[], int64_t applyTime_us);
\ No newline at end of file
@@ -17,22 +17,46 @@ static gptimer_alarm_config_t internalAlarmConf = {
 };
 
 static gptimer_handle_t zxTimer = NULL;
+static portMUX_TYPE _jitterLock = portMUX_INITIALIZER_UNLOCKED;
+static ZeroCrossJitter _jitter = {.periodMin_us = UINT32_MAX};
+static int64_t _lastCross_us = 0;
 
 // @brief Interrupcion que activa un temporizador para habilitar el triac
 static void IRAM_ATTR _risingEdgeISR(){
  	//esp_rom_delay_us(800);
+	int64_t now = esp_timer_get_time();
 	gpio_set_level(ZERO_CROSS_LED, 1);
 	gptimer_set_raw_count(zxTimer, 0);
 	gptimer_start(zxTimer); 
+	if(_lastCross_us != 0){
+		uint32_t period = (uint32_t)(now - _lastCross_us);
+		portENTER_CRITICAL_ISR(&_jitterLock);
+		if(period < _jitter.periodMin_us)
+			_jitter.periodMin_us = period;
+		if(period > _jitter.periodMax_us)
+			_jitter.periodMax_us = period;
+		portEXIT_CRITICAL_ISR(&_jitterLock);
+	}
+	_lastCross_us = now;
 }
 
 // @brief Activacion del TRIAC por 20 us
 static bool _enableTRIAC(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx){
+	// Timer counts us since zero cross, so the count at this point is alarm + latency
+	uint64_t count = 0;
+	gptimer_get_raw_count(timer, &count);
+	uint32_t latency = (uint32_t)(count - edata->alarm_value);
 	gpio_set_level(DIMMER_PIN, 1);
 	esp_rom_delay_us(20);
 	gpio_set_level(DIMMER_PIN, 0);
 	gpio_set_level(ZERO_CROSS_LED, 0);
 	gptimer_stop(zxTimer);
+	portENTER_CRITICAL_ISR(&_jitterLock);
+	_jitter.samples++;
+	_jitter.fireLatencySum_us += latency;
+	if(latency > _jitter.fireLatencyMax_us)
+		_jitter.fireLatencyMax_us = latency;
+	portEXIT_CRITICAL_ISR(&_jitterLock);
 	return false;
 }
 
@@ -92,6 +116,15 @@ esp_err_t zeroCrossInit(){
 	return ESP_OK;
 }
 
+void zeroCrossGetJitter(ZeroCrossJitter *stats, bool reset){
+	portENTER_CRITICAL(&_jitterLock);
+	*stats = _jitter;
+	if(reset){
+		_jitter = (ZeroCrossJitter){.periodMin_us = UINT32_MAX};
+	}
+	portEXIT_CRITICAL(&_jitterLock);
+}
+
 // @brief Change the timer callback time (activation time for TRIAC)
 // @param activationTime New activation time
 static void _setActivationTimeMS(uint64_t activationTime){
@@ -104,48 +137,7 @@ esp_err_t setBulbPowerPerc(float powerPerc){
 	if(NULL == zxTimer)
 		return ESP_ERR_INVALID_ARG;
 
-    if (powerPerc >= 1.0f)
-        _setActivationTimeMS(0);
-    else if (powerPerc >= 0.95f)
-        _setActivationTimeMS(2060);
-    else if (powerPerc >= 0.90f)
-        _setActivationTimeMS(2696);
-    else if (powerPerc >= 0.85f)
-        _setActivationTimeMS(3157);
-    else if (powerPerc >= 0.80f)
-        _setActivationTimeMS(3538);
-    else if (powerPerc >= 0.75f)
-        _setActivationTimeMS(3874);
-    else if (powerPerc >= 0.70f)
-        _setActivationTimeMS(4179);
-    else if (powerPerc >= 0.65f)
-        _setActivationTimeMS(4464);
-    else if (powerPerc >= 0.60f)
-        _setActivationTimeMS(4734);
-    else if (powerPerc >= 0.55f)
-        _setActivationTimeMS(4993);
-    else if (powerPerc >= 0.50f)
-        _setActivationTimeMS(5245);
-    else if (powerPerc >= 0.45f)
-        _setActivationTimeMS(5493);
-    else if (powerPerc >= 0.40f)
-        _setActivationTimeMS(5738);
-    else if (powerPerc >= 0.35f)
-        _setActivationTimeMS(5984);
-    else if (powerPerc >= 0.30f)
-        _setActivationTimeMS(6232);
-    else if (powerPerc >= 0.25f)
-        _setActivationTimeMS(6487);
-    else if (powerPerc >= 0.20f)
-        _setActivationTimeMS(6750);
-    else if (powerPerc >= 0.15f)
-        _setActivationTimeMS(7030);
-    else if (powerPerc >= 0.10f)
-        _setActivationTimeMS(7334);
-    else if (powerPerc >= 0.05f)
-        _setActivationTimeMS(7688);
-    else
-        _setActivationTimeMS(8203);
+    _setActivationTimeMS(zeroCrossFiringDelay_us(powerPerc));
 
     return ESP_OK;
 }
@@ -15,6 +15,11 @@
 #include "esp_attr.h"
 #include "hal/gpio_types.h"
 #include "driver/gptimer.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "zeroCrossPower.h"
+#include <stdbool.h>
+#include <stdint.h>
 
 
 #define ZERO_CROSS_PIN 4
@@ -23,6 +28,18 @@
 #define MAX_BULB_POWER 1.0
 #define MIN_BUBL_POWER 0.0
 
+/**
+ * Timing of the dimmer measured in the ISRs. Period is the time between zero crosses
+ * (jitter = max - min), fire latency is how late the TRIAC was triggered after its alarm.
+ */
+typedef struct{
+	uint32_t samples;
+	uint32_t periodMin_us;
+	uint32_t periodMax_us;
+	uint32_t fireLatencyMax_us;
+	uint64_t fireLatencySum_us;
+}ZeroCrossJitter;
+
 /**
  * @brief      Init zero cross detection (pins and timer)
  *
@@ -33,6 +50,16 @@
  */
 esp_err_t zeroCrossInit();
 
+/**
+ * @brief      Gets timing statistics of zero cross ISR and TRIAC alarm
+ *
+ * @param[out] stats  Statistics since last reset
+ * @param[in]  reset  Start a new measurement window
+ *
+ * @note Interrupts are allocated on the core that calls zeroCrossInit
+ */
+void zeroCrossGetJitter(ZeroCrossJitter *stats, bool reset);
+
 /**
  * @brief      Modify the power of the bulb
  *
@@ -0,0 +1,31 @@
+/**
+ *************************************
+ * @file: zeroCrossPower.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "zeroCrossPower.h"
+#include <stddef.h>
+
+// Firing delays that deliver each 5% step of RMS power, from full power down
+static const struct{
+	float minPower;
+	uint32_t delay_us;
+}_firingTable[] = {
+	{1.00f, 0},    {0.95f, 2060}, {0.90f, 2696}, {0.85f, 3157}, {0.80f, 3538},
+	{0.75f, 3874}, {0.70f, 4179}, {0.65f, 4464}, {0.60f, 4734}, {0.55f, 4993},
+	{0.50f, 5245}, {0.45f, 5493}, {0.40f, 5738}, {0.35f, 5984}, {0.30f, 6232},
+	{0.25f, 6487}, {0.20f, 6750}, {0.15f, 7030}, {0.10f, 7334}, {0.05f, 7688},
+};
+#define _MIN_POWER_DELAY_US 8203
+
+uint32_t zeroCrossFiringDelay_us(float powerPerc){
+	for(size_t i = 0; i < sizeof(_firingTable) / sizeof(_firingTable[0]); ++i){
+		if(powerPerc >= _firingTable[i].minPower)
+			return _firingTable[i].delay_us;
+	}
+	return _MIN_POWER_DELAY_US;
+}
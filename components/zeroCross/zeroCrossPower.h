@@ -0,0 +1,26 @@
+/**
+ *************************************
+ * @file: zeroCrossPower.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdint.h>
+
+/*
+ * Power to firing delay mapping of the dimmer. Kept free of ESP-IDF headers so the host
+ * simulator (simulator/) links the same table the firmware uses.
+ */
+#define ZERO_CROSS_HALF_CYCLE_US 8333   // 60 Hz mains
+
+/**
+ * @brief      Delay after the zero cross at which the TRIAC must fire to deliver powerPerc of the bulb power
+ *
+ * @param[in]  powerPerc  Power requested range [0-1], steps of 5%
+ *
+ * @return     Delay in us (0 fires at the zero cross, full power)
+ */
+uint32_t zeroCrossFiringDelay_us(float powerPerc);
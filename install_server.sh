@@ -21,13 +21,21 @@ else
 	echo "=== Instalando Libopenblas ==="
 	sudo apt install -y libopenblas-dev
 
-	echo "=== Instalando matplotlib ==="
-	pip install matplotlib
+	echo "=== Instalando numpy ==="
+	pip install numpy
+
+	echo "=== Instalando paho-mqtt ==="
+	pip install paho-mqtt
 
 	echo "=== Instalando python magic ==="
 	sudo apt install python3-magic
 fi
 
+if [ "$1" == "--mqtt" ] || [ "$2" == "--mqtt" ]; then
+	echo "=== Instalando broker Mosquitto ==="
+	sudo apt install -y mosquitto mosquitto-clients
+fi
+
 chmod +x "Server/mainServer.py"
 echo "=== Listo para ejecutar servidor ==="
 
@@ -1,6 +1,7 @@
 #include "cJSON.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "esp_rom_sys.h"
 #include "hal/adc_types.h"
 #include "hal/ledc_types.h"
@@ -11,7 +12,9 @@
 #include "freertos/FreeRTOSConfig_arch.h"
 #include "freertos/projdefs.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_sntp.h"
 #include "driver/i2c_master.h"
 #include "nvs_flash.h"
 #include "soc/gpio_num.h"
@@ -22,10 +25,29 @@
 #include "PWM.h"
 #include "zeroCross.h"
 #include "PIDControl.h"
+#include "ControlState.h"
+#include "Journal.h"
+#include "TelemetryCodec.h"
+#include "ReportPolicy.h"
+#include "Aggregation.h"
+#include "AcquisitionScheduler.h"
+#ifdef CONFIG_REMOTE_LOG_STREAM
+#include "LogStream.h"
+#endif
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+#include "MQTTLink.h"
+#endif
+#ifdef CONFIG_LOCAL_HTTP_ENDPOINT
+#include "StatusServer.h"
+#include "esp_system.h"
+#endif
 #include <stdbool.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define I2C_MASTER_SCL_IO           22
@@ -38,13 +60,93 @@
 #define PRIORITY_0                  0
 #define PRIORITY_1                  1
 #define PRIORITY_2                  2
+#define PRIORITY_ACQUISITION        CONFIG_ACQUISITION_TASK_PRIORITY
+#define PRIORITY_CONTROL            CONFIG_CONTROL_TASK_PRIORITY
+
+#ifdef CONFIG_FREERTOS_UNICORE
+#define CONTROL_CORE                0
+#define NETWORK_CORE                0
+#else
+#define CONTROL_CORE                CONFIG_CONTROL_CORE
+#define NETWORK_CORE                CONFIG_NETWORK_CORE
+#endif
+#define JITTER_LOG_PERIOD_S         CONFIG_ZERO_CROSS_JITTER_LOG_PERIOD
 
 #define SSID CONFIG_SSID
 #define PSSWD CONFIG_PSSWD
 #define SERVER_IP CONFIG_SERVER_IP
 #define SERVER_PORT CONFIG_SERVER_PORT
+#ifdef CONFIG_WIFI_REUSE_LEASE
+#define WIFI_REUSE_LEASE true
+#else
+#define WIFI_REUSE_LEASE false
+#endif
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+#define MQTT_BROKER_URI CONFIG_MQTT_BROKER_URI
+#define MQTT_ZONE CONFIG_MQTT_ZONE
+#endif
 
 #define IRRIGATION_PIN 17
+#define BOOT_TIME_BUDGET_MS 200
+#define TCP_RECONNECT_MIN_MS 1000
+#define TCP_RECONNECT_MAX_MS 30000
+#define CONTROL_INPUT_WAIT_LOG_MS 10000
+#define NTP_SERVER "pool.ntp.org"
+#define JOURNAL_REPLAY_CHUNK 8
+#define JOURNAL_REPLAY_PERIOD_MS 250
+#define JOURNAL_ACK_TIMEOUT_MS 10000
+#define CHANNEL_LM135 0
+#define CHANNEL_AM2302T 1
+#define CHANNEL_AM2302H 2
+#define REPORT_CHANNELS 3
+#define REPORT_CHECK_PERIOD_MS 500
+
+// Telemetry streams, a site can receive raw samples, window summaries or both
+#define STREAM_RAW (1 << 0)
+#define STREAM_SUMMARY (1 << 1)
+#if defined(CONFIG_TELEMETRY_STREAM_SUMMARY)
+#define DEFAULT_TELEMETRY_STREAM STREAM_SUMMARY
+#elif defined(CONFIG_TELEMETRY_STREAM_BOTH)
+#define DEFAULT_TELEMETRY_STREAM (STREAM_RAW | STREAM_SUMMARY)
+#else
+#define DEFAULT_TELEMETRY_STREAM STREAM_RAW
+#endif
+#define AGGREGATION_WINDOW_MS (CONFIG_AGGREGATION_WINDOW_S * 1000)
+#define DEFAULT_LM135_DEADBAND 0.5
+#define DEFAULT_AM2302T_DEADBAND 0.2
+#define DEFAULT_AM2302H_DEADBAND 1.0
+#define DEFAULT_MAX_SILENCE_MS 60000
+#define MAX_SILENCE_MAX_S 86400         // Upper bounds of setReportMaxSilence and setAggregationWindow,
+#define AGGREGATION_WINDOW_MAX_S 86400  // also keep their conversion to uint32_t ms defined
+#define AM2302_MIN_PERIOD_MS 2000
+#define LM135_MIN_PERIOD_MS 500
+#define SAMPLING_MAX_PERIOD_MS 10000
+#define ACQUISITION_TICK_MS 500
+#define AM2302_PHASE_MS 0
+#define LM135_PHASE_MS 0
+#define DEFAULT_DESIRED_TEMPERATURE 25.0
+#define DEFAULT_KP 0.8
+#define DEFAULT_KI 0.005
+#define DEFAULT_KD 0.001
+
+// Temperature loop output is split: [0, 1] drives the bulb, [-1, 0) drives the fan. The cooling band is
+// given in °C over the setpoint and scaled by Kp: with Kp 0.8 the fan starts 0.6 °C over the setpoint
+// (0.4 + 0.08 of output), stops below 0.5 °C and reaches full power at 1.25 °C
+#define MIN_COOLING_OUTPUT -1.0f
+#define COOLING_DEADBAND_C 0.5f
+#define COOLING_HYSTERESIS_C 0.1f
+#define FAN_FADE_TIME_MS 2000
+#define FAN_FADE_MIN_STEP 0.02f
+#define RX_BUFFER_SIZE 1024            // Fits a full command batch (COMMAND_MESSAGE_MAX_LEN)
+#if defined(CONFIG_REMOTE_LOG_LEVEL_ERROR)
+#define REMOTE_LOG_LEVEL ESP_LOG_ERROR
+#elif defined(CONFIG_REMOTE_LOG_LEVEL_INFO)
+#define REMOTE_LOG_LEVEL ESP_LOG_INFO
+#else
+#define REMOTE_LOG_LEVEL ESP_LOG_WARN
+#endif
+#define LOG_FORWARD_PERIOD_MS 1000
+#define LOG_FORWARD_BATCH 6
 
 static const char *TAG = "Main app";
 
@@ -67,24 +169,121 @@ static void printStaticCharsLCD(LCD1602 *lcd);
 void updateLCDContent(void *pvParameters);
 
 /**
- * @brief      Task for reading AM2302 approximately every 2 seconds
+ * @brief      Acquisition source of the AM2302, faster while readings change (never under AM2302_MIN_PERIOD_MS)
+ *
+ * @return     Period until next reading in ms
+ */
+static uint32_t sampleAM2302(void *context, int64_t sampleTime_ms);
+
+/**
+ * @brief      Acquisition source of the LM135, faster while readings change
  *
+ * @return     Period until next reading in ms
+ */
+static uint32_t sampleLM135(void *context, int64_t sampleTime_ms);
+
+/**
+ * @brief      Publishes the readings of an acquisition tick as one time coherent sample set
  */
-void readAM2302(void *pvParameters);
+static void sampleSetReady(uint32_t sampledMask, int64_t sampleTime_ms);
 
 /**
- * @brief      Task for reading LM135 approximately every 2 seconds
+ * @brief      Logs the time elapsed since boot when a boot phase finishes
  *
- * @param      pvParameters  The pv parameters
+ * @param[in]  phase  Phase name
+ *
+ * @return     Elapsed time since boot in ms
+ */
+static int64_t logBootPhase(const char phase[]);
+
+#ifdef CONFIG_LOCAL_HTTP_ENDPOINT
+/**
+ * @brief      Renders the snapshot served by the local HTTP endpoint, called by its handler on the network core
  */
-void readLM135(void *pvParameters);
+static int renderStatusSnapshot(char snapshot[], size_t size);
+#endif
 
 /**
- * @brief      Task that sends sensors data to server
+ * @brief      Task that associates to the AP and keeps a session with the server, reconnecting with backoff
+ *
+ */
+void networkManager(void *pvParameters);
+
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+
+/**
+ * @brief      Publishes through the MQTT broker, starting a journal replay every time the broker session comes up. Never returns
+ */
+static void runMQTTSessions(void);
+
+/**
+ * @brief      Called by MQTTLink when the broker session goes up or down
+ */
+static void brokerConnectionChanged(bool connected);
+#else
+/**
+ * @brief      Keeps a TCP session with SERVER_IP:SERVER_PORT, reconnecting with backoff. Never returns
+ */
+static void runTCPSessions(void);
+#endif
+
+/**
+ * @brief      Task that reports sensors data by exception (deadband or heartbeat) to server,
+ *             or stores it in the journal while there is no session
  *
  */
 void sendDataToServer(void *pvParameters);
 
+/**
+ * @brief      Sends one sample to the server using the configured encoding
+ *
+ * @return     false if the session was lost, undelivered samples are stored in the journal
+ */
+static bool publishSample(int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp);
+
+#ifdef CONFIG_TELEMETRY_ENCODING_COMPACT
+/**
+ * @brief      Sends the ready compact frame, its samples go to the journal if it cannot be sent
+ *
+ * @return     false if the session was lost
+ */
+static bool sendSampleBatch(void);
+
+/**
+ * @brief      Sends the compact batch before it is full once its oldest sample waited the shortest
+ *             heartbeat (max silence), so batching never delays a sample more than one report period
+ *
+ * @return     false if the session was lost
+ */
+static bool flushSampleBatch(int64_t now_ms);
+#endif
+
+/**
+ * @brief      Closes the aggregation window and sends its summary, or journals its means while there is no session
+ */
+static void publishSummary(int64_t now_ms);
+
+/**
+ * @brief      Adds a sample to the aggregation window (called by acquisition tasks)
+ */
+static void aggregateSample(int channel, float value);
+
+/**
+ * @brief      Stores one sample in the journal with the time it was taken (ms since boot)
+ */
+static void journalSample(int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp);
+
+/**
+ * @brief      Change of a channel measured in deadbands, used to adapt acquisition rate
+ */
+static float normalizedChange(float delta, float deadband);
+
+/**
+ * @brief      Task that streams journal segments to server at a throttled rate, deleting the acknowledged ones
+ *
+ */
+void replayJournal(void *pvParameters);
+
 /**
  * @brief      Task for receiving functions to execute from server
  *
@@ -93,13 +292,57 @@ void receiveFunctionExecutionFromServer(void *pvParameters);
 
 
 /**
- * @brief      Executes function with funcName with argument arg
+ * @brief      Decodes, executes and acknowledges a single message received from server
  *
- * @param[in]  funcName  Function name
- * @param[in]  arg       Argument
- * @warning Only works for certain functions
+ * @param[in]  message     Message without delimiter
+ * @param[in]  rxTime_us   Time when message was received (esp_timer_get_time)
  */
-void executeFunction(const char funcName[], const float arg);
+void processServerMessage(const char message[], int64_t rxTime_us);
+
+/**
+ * @brief      Executes the function named in cmd with its argument
+ *
+ * @param[in]  cmd           Command to execute
+ * @param[out] appliedState  State of the actuator/setpoint after execution
+ *
+ * @return
+ * - ESP_OK Command was applied
+ * - ESP_ERR_NOT_SUPPORTED Unknown function
+ * - Error returned by the driver otherwise
+ * @warning Only works for certain functions, all of them set an absolute state so they can be retried safely
+ */
+esp_err_t executeFunction(const ServerCommand *cmd, float *appliedState);
+
+/**
+ * @brief      Checks that cmd names a known function and that its argument and channel are valid, without executing it
+ *
+ * @return
+ * - ESP_OK Command can be executed
+ * - ESP_ERR_INVALID_ARG Argument or channel out of range
+ * - ESP_ERR_NOT_SUPPORTED Unknown function
+ */
+esp_err_t validateFunction(const ServerCommand *cmd);
+
+/**
+ * @brief      Executes a single command holding controlLock
+ */
+esp_err_t executeControlFunction(const ServerCommand *cmd, float *appliedState);
+
+/**
+ * @brief      Applies every operation of batch as one change: all of them are validated first and
+ *             applied under controlLock, so the PID tick sees either none or all of them
+ *
+ * @param[in]  batch    Decoded batch
+ * @param[out] results  Result of each operation, ESP_ERR_INVALID_STATE for valid operations not applied
+ *                      because another one was rejected
+ * @param[out] states   State after each operation
+ *
+ * @return
+ * - ESP_OK Every operation was applied
+ * - Error of the first rejected operation (nothing was applied) or of the first operation that failed
+ *   while applying (the rest are still applied, actuators cannot be rolled back)
+ */
+esp_err_t executeBatch(const ServerCommandBatch *batch, esp_err_t results[], float states[]);
 
 /**
  * @brief      Task for execute PID control
@@ -107,20 +350,82 @@ void executeFunction(const char funcName[], const float arg);
  */
 void PIDControl(void *pvParameters);
 
+/**
+ * @brief      Task that periodically logs zero cross timing, used to check control core isolation
+ *
+ */
+void logZeroCrossJitter(void *pvParameters);
+
+#ifdef CONFIG_REMOTE_LOG_STREAM
+/**
+ * @brief      Task that forwards the lines captured by LogStream to the server in batches
+ *
+ */
+void forwardLogs(void *pvParameters);
+#endif
+
+/**
+ * @brief      Task that periodically persists controller state into NVS (rate limited by ControlState)
+ *
+ */
+void persistControlState(void *pvParameters);
+
+/**
+ * Readings of every channel, each one taken at sampleTime_ms or at an earlier tick
+ */
+typedef struct{
+    int64_t sampleTime_ms;
+    float values[REPORT_CHANNELS];
+}SampleSet;
+
 /**
  * Global variables
  */
-int TCPSocket;
+int TCPSocket = -1;
+int UDPSocket = -1;
+volatile bool serverConnected = false;
+SemaphoreHandle_t sessionTasksFinished;
+// Given by every valid AM2302 reading, the PID task takes it once before its first control action
+SemaphoreHandle_t controlInputReady;
+bool firstControlActionLogged = false;
+TaskHandle_t journalReplayTask = NULL;
+volatile bool telemetryResync = false;
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+TaskHandle_t networkManagerTask = NULL;
+volatile bool brokerConnected = false;
+#endif
+ChannelReportPolicy reportPolicies[REPORT_CHANNELS];
+#ifdef CONFIG_TELEMETRY_ENCODING_COMPACT
+TelemetryEncoder telemetryEncoder;
+#endif
+AdaptiveSampler AM2302Sampler;
+AdaptiveSampler LM135Sampler;
+AcquisitionScheduler acquisition;
+SampleSet latestSamples;
+portMUX_TYPE samplesLock = portMUX_INITIALIZER_UNLOCKED;
+WindowAggregator aggregator;
+portMUX_TYPE aggregationLock = portMUX_INITIALIZER_UNLOCKED;
+volatile uint8_t telemetryStream = DEFAULT_TELEMETRY_STREAM;
 LCD1602 informationLCD;
 AM2302Handler am2302;
 ADCHandler ADC_U1;
 LM135Handler lm135;
 FanHandler coolerFan;
+SemaphoreHandle_t fanLock;
+// Held by the PID tick and while server commands are applied, so a tick never sees half a batch
+SemaphoreHandle_t controlLock;
+volatile bool fanManual = false;
+SplitRange coolingSplit;
+volatile float bulbPower = 0.0f;
 PIDController BulbPowerPIDController;
 bool irrigationLevel = false;
 
 
 void app_main(void){      
+#ifdef CONFIG_REMOTE_LOG_STREAM
+    // First thing so boot errors are also forwarded once there is a session
+    logStreamInit(REMOTE_LOG_LEVEL);
+#endif
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
       ESP_ERROR_CHECK(nvs_flash_erase());
@@ -128,58 +433,86 @@ void app_main(void){
     }
     ESP_ERROR_CHECK(ret);
 
-    esp_err_t WiFiStatus = WiFiInit(SSID, PSSWD);
-    if(WIFI_SUCCESS != WiFiStatus){
-        ESP_LOGE(TAG, "Failed to associate to AP, dying ...");
-        return;
+    ControlState restoredState;
+    bool stateRestored = (ESP_OK == controlStateInit() && ESP_OK == controlStateLoad(&restoredState));
+    if(stateRestored){
+        irrigationLevel = restoredState.irrigation;
+        ESP_LOGI(TAG, "Estado restaurado de NVS, temperatura deseada: %.1f", restoredState.desiredTemperature);
     }
-    TCPSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if(TCPSocket < 0){
-        ESP_LOGE(TAG, "Failed to create socket");
-        return;
-    } 
-    if(TCP_FAILURE == connectTCPServer(TCPSocket, SERVER_IP, htons(SERVER_PORT))){
-        close(TCPSocket);
-        return;
+
+    logBootPhase("NVS");
+
+    if(ESP_OK != journalInit()){
+        ESP_LOGE(TAG, "Journal no disponible, las muestras sin conexion se perderan");
     }
-    int flags = fcntl(TCPSocket, F_GETFL, 0);
-    fcntl(TCPSocket, F_SETFL, flags | O_NONBLOCK);
-    xTaskCreate(sendDataToServer, "TCP Connection", 6144, NULL, PRIORITY_2, NULL);
-    xTaskCreate(receiveFunctionExecutionFromServer, "Instructions", 6144, NULL, PRIORITY_2, NULL);
-    
+
+    esp_err_t irrigationStatus = gpio_reset_pin(IRRIGATION_PIN);
+    if(irrigationStatus){
+        ESP_LOGE(TAG, "Invalid GPIO pin for irrigation");
+    }
+    else{
+        gpio_set_direction(IRRIGATION_PIN, GPIO_MODE_OUTPUT);
+        gpio_set_level(IRRIGATION_PIN, irrigationLevel);
+    }
+
+    fanLock = xSemaphoreCreateMutex();
+    controlLock = xSemaphoreCreateMutex();
+    if(FanInit(&coolerFan, GPIO_NUM_19, LEDC_CHANNEL_0) != ESP_OK){
+        ESP_LOGE(TAG, "Cannot initialize cooler fan PWM");
+    }
+    else if(stateRestored && restoredState.fanManual){
+        fanManual = true;
+        setFanDutyCyclePerc(&coolerFan, restoredState.fanDuty);
+    }
+    logBootPhase("Actuadores");
+
+    reportPolicyConfig(&reportPolicies[CHANNEL_LM135], DEFAULT_LM135_DEADBAND, DEFAULT_MAX_SILENCE_MS);
+    reportPolicyConfig(&reportPolicies[CHANNEL_AM2302T], DEFAULT_AM2302T_DEADBAND, DEFAULT_MAX_SILENCE_MS);
+    reportPolicyConfig(&reportPolicies[CHANNEL_AM2302H], DEFAULT_AM2302H_DEADBAND, DEFAULT_MAX_SILENCE_MS);
+    adaptiveSamplerConfig(&AM2302Sampler, AM2302_MIN_PERIOD_MS, SAMPLING_MAX_PERIOD_MS);
+    adaptiveSamplerConfig(&LM135Sampler, LM135_MIN_PERIOD_MS, SAMPLING_MAX_PERIOD_MS);
+    aggregatorConfig(&aggregator, AGGREGATION_WINDOW_MS, esp_timer_get_time() / 1000);
+
+    // Sensors go before PID, which waits for the first AM2302 reading so its first action uses a real measurement
+    controlInputReady = xSemaphoreCreateBinary();
+    acquisitionSchedulerInit(&acquisition, ACQUISITION_TICK_MS, sampleSetReady);
     esp_err_t AM2302status = AM2302init(&am2302, GPIO_NUM_23);
     if(ESP_OK == AM2302status){
         ESP_LOGI(TAG, "AM2302 initialized successfully");
-        xTaskCreate(readAM2302, "A2302", 4096, NULL, PRIORITY_1, NULL);
+        acquisitionSchedulerAdd(&acquisition, sampleAM2302, NULL, AM2302_MIN_PERIOD_MS, AM2302_PHASE_MS);
     }
 
     esp_err_t ADC1Status = ADCconfigUnitBasic(&ADC_U1, ADC_UNIT_1);
     ADC1Status += ADCconfigChannel(&ADC_U1, ADC_ATTEN_DB_12, ADC_BITWIDTH_12, ADC_CHANNEL_4);
     if(ESP_OK == ADC1Status && ESP_OK == LM135init(&lm135, &ADC_U1)){
         ESP_LOGI(TAG, "LM135 initialized successfully");
-        xTaskCreate(readLM135, "LM135", 3072, NULL, PRIORITY_1, NULL);
+        acquisitionSchedulerAdd(&acquisition, sampleLM135, NULL, LM135_MIN_PERIOD_MS, LM135_PHASE_MS);
     }
-    
-    if(FanInit(&coolerFan, GPIO_NUM_19, LEDC_CHANNEL_0) != ESP_OK){
-        ESP_LOGE(TAG, "Cannot initialize cooler fan PWM");
+    if(ESP_OK != acquisitionSchedulerStart(&acquisition, 4096, PRIORITY_ACQUISITION, CONTROL_CORE)){
+        ESP_LOGE(TAG, "Adquisicion no iniciada, no hay sensores disponibles");
     }
-    
-    setPIDDesiredValue(&BulbPowerPIDController, 0.0);
-    setPIDGains(&BulbPowerPIDController, 0.8, 0.005, 0.001);
-    setPIDMaxAndMinVals(&BulbPowerPIDController, MIN_BUBL_POWER, MAX_BULB_POWER);
-    esp_err_t ZXStatus = zeroCrossInit();
-    if(ESP_OK ==  ZXStatus)
-        xTaskCreate(PIDControl, "PID control", 3072, NULL, PRIORITY_1, NULL);
+    logBootPhase("Sensores");
 
-    esp_err_t irrigationStatus = gpio_reset_pin(IRRIGATION_PIN);
-    if(irrigationStatus){
-        ESP_LOGE(TAG, "Invalid GPIO pin for irrigation");
+    if(stateRestored){
+        setPIDDesiredValue(&BulbPowerPIDController, restoredState.desiredTemperature);
+        setPIDGains(&BulbPowerPIDController, restoredState.Kp, restoredState.Ki, restoredState.Kd);
+        setPIDIntegralVal(&BulbPowerPIDController, restoredState.integral);
     }
     else{
-        gpio_set_direction(IRRIGATION_PIN, GPIO_MODE_OUTPUT);
-        gpio_set_level(IRRIGATION_PIN, irrigationLevel);
+        setPIDDesiredValue(&BulbPowerPIDController, DEFAULT_DESIRED_TEMPERATURE);
+        setPIDGains(&BulbPowerPIDController, DEFAULT_KP, DEFAULT_KI, DEFAULT_KD);
     }
+    setPIDMaxAndMinVals(&BulbPowerPIDController, MIN_COOLING_OUTPUT, MAX_BULB_POWER);
+    setSplitRangeBand(&coolingSplit, BulbPowerPIDController.Kp, COOLING_DEADBAND_C, COOLING_HYSTERESIS_C);
+    // Zero cross is initialized inside the PID task so its interrupts are allocated on the control core
+    xTaskCreatePinnedToCore(PIDControl, "PID control", 3072, NULL, PRIORITY_CONTROL, NULL, CONTROL_CORE);
+    logBootPhase("PID");
 
+    xTaskCreatePinnedToCore(persistControlState, "State", 3072, NULL, PRIORITY_0, NULL, NETWORK_CORE);
+    if(JITTER_LOG_PERIOD_S > 0)
+        xTaskCreatePinnedToCore(logZeroCrossJitter, "Jitter", 2560, NULL, PRIORITY_0, NULL, NETWORK_CORE);
+
+    // LCD may block up to I2C_MASTER_TIMEOUT_MS if it is not connected, so it goes after control
     i2c_master_bus_handle_t bus_handle;
     i2c_master_init(&bus_handle);
     esp_err_t LCDStatus = LCDinit(&informationLCD, LCD_I2C_ADDR, I2C_MASTER_FREQ_HZ, &bus_handle);
@@ -187,97 +520,693 @@ void app_main(void){
         ESP_LOGI(TAG, "LCD initialized successfully");
         LCDsetBackgroundLight(&informationLCD, BackgroundLightON);
         printStaticCharsLCD(&informationLCD);
-        xTaskCreate(updateLCDContent, "LCD", 4096, NULL, PRIORITY_0, NULL);   
+        xTaskCreatePinnedToCore(updateLCDContent, "LCD", 4096, NULL, PRIORITY_0, NULL, NETWORK_CORE);   
+    }
+
+    if(logBootPhase("LCD") > BOOT_TIME_BUDGET_MS){
+        ESP_LOGW(TAG, "Arranque local excedio el presupuesto de %d ms", BOOT_TIME_BUDGET_MS);
     }
+
+    sessionTasksFinished = xSemaphoreCreateCounting(2, 0);
+    xTaskCreatePinnedToCore(networkManager, "Network", 4096, NULL, PRIORITY_1, NULL, NETWORK_CORE);
+    xTaskCreatePinnedToCore(sendDataToServer, "Telemetry", 6144, NULL, PRIORITY_2, NULL, NETWORK_CORE);
+#ifdef CONFIG_REMOTE_LOG_STREAM
+    xTaskCreatePinnedToCore(forwardLogs, "Log stream", 5120, NULL, PRIORITY_0, NULL, NETWORK_CORE);
+#endif
 }
 
 
-void readAM2302(void *pvParameters){
-    while (true) {
-        AM2302read(&am2302);
-        vTaskDelay(pdMS_TO_TICKS(2000));
+static int64_t logBootPhase(const char phase[]){
+    int64_t elapsed = esp_timer_get_time() / 1000;
+    ESP_LOGI(TAG, "Arranque: %s listo a los %" PRId64 " ms", phase, elapsed);
+    return elapsed;
+}
+
+
+void networkManager(void *pvParameters){
+    esp_err_t WiFiStatus = WiFiInit(SSID, PSSWD, WIFI_REUSE_LEASE);
+    if(WIFI_SUCCESS != WiFiStatus){
+        // WiFi keeps reconnecting in background with backoff, control runs meanwhile without network
+        ESP_LOGW(TAG, "Failed to associate to AP, waiting for WiFi");
+        WiFiWaitForIP(portMAX_DELAY);
     }
+    logBootPhase("WiFi");
+#ifdef CONFIG_LOCAL_HTTP_ENDPOINT
+    statusServerStart(CONFIG_LOCAL_HTTP_PORT, NETWORK_CORE, executeControlFunction, renderStatusSnapshot);
+#endif
+
+    // Journal records need wall clock time
+    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, NTP_SERVER);
+    esp_sntp_init();
+
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+    runMQTTSessions();
+#else
+    runTCPSessions();
+#endif
 }
 
-void readLM135(void *pvParameters){
-    while (true) {
-        LM135read(&lm135);
-        vTaskDelay(pdMS_TO_TICKS(2000));
+
+#ifndef CONFIG_SERVER_TRANSPORT_MQTT
+static void runTCPSessions(void){
+    uint32_t backoff = TCP_RECONNECT_MIN_MS;
+    while(true){
+        if(WIFI_SUCCESS != WiFiWaitForIP(0)){
+            // No point in burning the backoff while the AP is gone
+            WiFiWaitForIP(portMAX_DELAY);
+            backoff = TCP_RECONNECT_MIN_MS;
+        }
+#ifdef CONFIG_TELEMETRY_ENCODING_UDP
+        // A socket that could not be opened is retried with every session, an open one is kept
+        if(UDPSocket < 0){
+            UDPSocket = openDatagramSocket(SERVER_IP, htons(CONFIG_TELEMETRY_UDP_PORT));
+            if(UDPSocket < 0)
+                ESP_LOGW(TAG, "Sin socket UDP, la telemetria de esta sesion no se envia");
+        }
+#endif
+        int newSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if(newSocket < 0){
+            ESP_LOGE(TAG, "Failed to create socket");
+        }
+        else if(TCP_FAILURE == connectTCPServer(newSocket, SERVER_IP, htons(SERVER_PORT))
+                || TCP_SUCCESS != sendHelloToServer(newSocket, irrigationLevel, BulbPowerPIDController.desiredVal)){
+            close(newSocket);
+        }
+        else{
+            backoff = TCP_RECONNECT_MIN_MS;
+            int flags = fcntl(newSocket, F_GETFL, 0);
+            fcntl(newSocket, F_SETFL, flags | O_NONBLOCK);
+            TCPSocket = newSocket;
+            telemetryResync = true;
+            serverConnected = true;
+            logBootPhase("Servidor");
+            xTaskCreatePinnedToCore(receiveFunctionExecutionFromServer, "Instructions", 6144, NULL, PRIORITY_2, NULL, NETWORK_CORE);
+            xTaskCreatePinnedToCore(replayJournal, "Journal replay", 6144, NULL, PRIORITY_0, &journalReplayTask, NETWORK_CORE);
+
+            // Both session tasks give the semaphore when they finish
+            xSemaphoreTake(sessionTasksFinished, portMAX_DELAY);
+            xSemaphoreTake(sessionTasksFinished, portMAX_DELAY);
+            TCPSocket = -1;
+            close(newSocket);
+            ESP_LOGI(TAG, "Sesion con servidor terminada, reconectando ...");
+        }
+        vTaskDelay(pdMS_TO_TICKS(backoff));
+        backoff = (backoff * 2 > TCP_RECONNECT_MAX_MS) ? TCP_RECONNECT_MAX_MS : backoff * 2;
+    }
+}
+#else
+static void runMQTTSessions(void){
+    char deviceID[DEVICE_ID_LEN];
+    getDeviceID(deviceID, sizeof(deviceID));
+    networkManagerTask = xTaskGetCurrentTaskHandle();
+    setServerPublisher(MQTTLinkPublish);
+    uint32_t backoff = TCP_RECONNECT_MIN_MS;
+    while(ESP_OK != MQTTLinkInit(MQTT_BROKER_URI, MQTT_ZONE, deviceID, processServerMessage, brokerConnectionChanged)){
+        ESP_LOGW(TAG, "No se pudo iniciar MQTT, control continua sin red, reintento en %" PRIu32 " ms", backoff);
+        vTaskDelay(pdMS_TO_TICKS(backoff));
+        backoff = (backoff * 2 > TCP_RECONNECT_MAX_MS) ? TCP_RECONNECT_MAX_MS : backoff * 2;
     }
+    // The MQTT client reconnects by itself, commands are received in its task
+    while(true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if(!brokerConnected)
+            continue;
+        telemetryResync = true;
+        serverConnected = true;
+        // The session already has the id of the topic, hello only reports the restored state
+        sendHelloToServer(-1, irrigationLevel, BulbPowerPIDController.desiredVal);
+        logBootPhase("Servidor");
+        xTaskCreatePinnedToCore(replayJournal, "Journal replay", 6144, NULL, PRIORITY_0, &journalReplayTask, NETWORK_CORE);
+        // Replay ends when the journal is empty or the broker session is lost
+        xSemaphoreTake(sessionTasksFinished, portMAX_DELAY);
+    }
+}
+
+
+static void brokerConnectionChanged(bool connected){
+    brokerConnected = connected;
+    if(!connected)
+        serverConnected = false;
+    if(NULL != networkManagerTask)
+        xTaskNotifyGive(networkManagerTask);
+}
+#endif
+
+
+// Sources run in the acquisition task, latestSamples still holds the previous tick while they read
+static uint32_t sampleAM2302(void *context, int64_t sampleTime_ms){
+    if(ESP_OK == AM2302read(&am2302))
+        xSemaphoreGive(controlInputReady);
+    aggregateSample(CHANNEL_AM2302T, am2302.temperature);
+    aggregateSample(CHANNEL_AM2302H, am2302.humidity);
+    float change = fmaxf(normalizedChange(am2302.temperature - latestSamples.values[CHANNEL_AM2302T], reportPolicies[CHANNEL_AM2302T].deadband),
+                         normalizedChange(am2302.humidity - latestSamples.values[CHANNEL_AM2302H], reportPolicies[CHANNEL_AM2302H].deadband));
+    return adaptiveSamplerUpdate(&AM2302Sampler, change);
+}
+
+static uint32_t sampleLM135(void *context, int64_t sampleTime_ms){
+    LM135read(&lm135);
+    aggregateSample(CHANNEL_LM135, lm135.temperature);
+    float change = normalizedChange(lm135.temperature - latestSamples.values[CHANNEL_LM135], reportPolicies[CHANNEL_LM135].deadband);
+    return adaptiveSamplerUpdate(&LM135Sampler, change);
+}
+
+static void sampleSetReady(uint32_t sampledMask, int64_t sampleTime_ms){
+    portENTER_CRITICAL(&samplesLock);
+    latestSamples.sampleTime_ms = sampleTime_ms;
+    latestSamples.values[CHANNEL_LM135] = lm135.temperature;
+    latestSamples.values[CHANNEL_AM2302T] = am2302.temperature;
+    latestSamples.values[CHANNEL_AM2302H] = am2302.humidity;
+    portEXIT_CRITICAL(&samplesLock);
+}
+
+#ifdef CONFIG_LOCAL_HTTP_ENDPOINT
+static int renderStatusSnapshot(char snapshot[], size_t size){
+    // Sensors as published by sampleSetReady, the set of one tick is copied at once
+    SampleSet samples;
+    portENTER_CRITICAL(&samplesLock);
+    samples = latestSamples;
+    portEXIT_CRITICAL(&samplesLock);
+    float fanDuty = getFanDutyCyclePerc(&coolerFan);
+    return snprintf(snapshot, size,
+        "{\"uptime_ms\":%" PRId64 ",\"time\":%" PRId64 ","
+        "\"sensors\":{\"LM135\":%.2f,\"AM2302T\":%.2f,\"AM2302H\":%.2f},"
+        "\"setpoint\":%.2f,\"gains\":[%g,%g,%g],"
+        "\"bulb\":%.3f,\"fan\":%.3f,\"fanManual\":%s,\"irrigation\":%s,"
+        "\"diag\":{\"server\":%s,\"freeHeap\":%" PRIu32 ",\"minFreeHeap\":%" PRIu32 ",\"stateWrites\":%" PRIu32 ",\"wifiConnect_ms\":%" PRIu32 "}}",
+        esp_timer_get_time() / 1000, (int64_t)time(NULL),
+        samples.values[CHANNEL_LM135], samples.values[CHANNEL_AM2302T], samples.values[CHANNEL_AM2302H],
+        BulbPowerPIDController.desiredVal, BulbPowerPIDController.Kp, BulbPowerPIDController.Ki, BulbPowerPIDController.Kd,
+        bulbPower, (fanDuty < 0.0f) ? 0.0f : fanDuty, fanManual ? "true" : "false", irrigationLevel ? "true" : "false",
+        serverConnected ? "true" : "false", (uint32_t)esp_get_free_heap_size(),
+        (uint32_t)esp_get_minimum_free_heap_size(), controlStateWriteCount(), WiFiLastConnectTime());
+}
+#endif
+
+static float normalizedChange(float delta, float deadband){
+    return (deadband > 0.0f) ? fabsf(delta) / deadband : ADAPTIVE_FAST_CHANGE;
 }
 
 
 void sendDataToServer(void *pvParameters){
-    esp_err_t Tst;
     while(true){
-        Tst = sendSensorsDataToServer(TCPSocket, lm135.temperature, am2302.humidity, am2302.temperature);
-        if(Tst == TCP_FAILURE){
+        float values[REPORT_CHANNELS];
+        portENTER_CRITICAL(&samplesLock);
+        memcpy(values, latestSamples.values, sizeof(values));
+        int64_t sampleTime_ms = latestSamples.sampleTime_ms;
+        portEXIT_CRITICAL(&samplesLock);
+        int64_t now = esp_timer_get_time() / 1000;
+        if((telemetryStream & STREAM_SUMMARY) && aggregatorWindowElapsed(&aggregator, now))
+            publishSummary(now);
+#ifdef CONFIG_TELEMETRY_ENCODING_COMPACT
+        if(serverConnected && !flushSampleBatch(now)){
             ESP_LOGE(TAG, "Connection with server lost");
-            close(TCPSocket);
+            serverConnected = false;
+        }
+#endif
+        if(!(telemetryStream & STREAM_RAW)){
+            vTaskDelay(pdMS_TO_TICKS(REPORT_CHECK_PERIOD_MS));
+            continue;
+        }
+
+        bool mustReport = false;
+        for(int ch = 0; ch < REPORT_CHANNELS; ++ch)
+            mustReport |= reportPolicyShouldReport(&reportPolicies[ch], values[ch], now);
+
+        if(mustReport){
+            // A report carries every channel, so all of them restart their deadband and heartbeat
+            for(int ch = 0; ch < REPORT_CHANNELS; ++ch)
+                reportPolicyMarkReported(&reportPolicies[ch], values[ch], now);
+            if(!serverConnected){
+                journalSample(sampleTime_ms, values[CHANNEL_LM135], values[CHANNEL_AM2302H], values[CHANNEL_AM2302T]);
+            }
+            else if(!publishSample(sampleTime_ms, values[CHANNEL_LM135], values[CHANNEL_AM2302H], values[CHANNEL_AM2302T])){
+                ESP_LOGE(TAG, "Connection with server lost");
+                serverConnected = false;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(REPORT_CHECK_PERIOD_MS));
+    }
+}
+
+static void aggregateSample(int channel, float value){
+    // Without the summary stream nothing closes the window, setTelemetryStream restarts it when enabled
+    if(!(telemetryStream & STREAM_SUMMARY))
+        return;
+    portENTER_CRITICAL(&aggregationLock);
+    aggregatorAdd(&aggregator, channel, value);
+    portEXIT_CRITICAL(&aggregationLock);
+}
+
+static void publishSummary(int64_t now_ms){
+    ChannelSummary summaries[AGGREGATION_CHANNELS];
+    portENTER_CRITICAL(&aggregationLock);
+    uint32_t duration = aggregatorClose(&aggregator, summaries, now_ms);
+    portEXIT_CRITICAL(&aggregationLock);
+
+    // Window start in the same time base as journal records
+    time_t wallClock = time(NULL);
+    bool uptime = wallClock < JOURNAL_MIN_VALID_EPOCH;
+    uint32_t end = uptime ? (uint32_t)(now_ms / 1000) : (uint32_t)wallClock;
+    uint32_t windowStart = end - duration / 1000;
+
+    bool delivered = false;
+    if(serverConnected){
+#ifdef CONFIG_TELEMETRY_ENCODING_COMPACT
+        uint8_t frame[TELEMETRY_SUMMARY_FRAME_MAX_LEN];
+        size_t length = telemetryEncodeSummary(frame, windowStart, uptime ? TELEMETRY_SUMMARY_FLAG_UPTIME : 0,
+                                               duration / 1000, summaries);
+        esp_err_t sent = sendCompactFrameToServer(TCPSocket, frame, length);
+#else
+        esp_err_t sent = sendSummaryToServer(TCPSocket, windowStart, uptime, duration / 1000, summaries);
+#endif
+        delivered = (TCP_SUCCESS == sent);
+        // A summary that cannot be serialized is a local error, the session is still usable
+        if(ESP_ERR_INVALID_SIZE == sent){
+            ESP_LOGE(TAG, "Resumen demasiado largo, se guarda en el journal");
+        }
+        else if(!delivered){
+            ESP_LOGE(TAG, "Connection with server lost");
+            serverConnected = false;
+        }
+    }
+    // Offline windows are kept at window resolution, raw samples (if enabled) are journaled apart
+    if(!delivered && !(telemetryStream & STREAM_RAW) && summaries[CHANNEL_LM135].count > 0)
+        journalSample(now_ms, summaries[CHANNEL_LM135].mean, summaries[CHANNEL_AM2302H].mean, summaries[CHANNEL_AM2302T].mean);
+}
+
+static void journalSample(int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp){
+    JournalRecord record;
+    journalBuildRecord(&record, sampleTime_ms, LM135Temp, AM2302Hum, AM2302Temp);
+    journalAppend(&record);
+}
+
+#ifdef CONFIG_TELEMETRY_ENCODING_COMPACT
+static bool publishSample(int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp){
+    TelemetryEncoder *encoder = &telemetryEncoder;
+    if(telemetryResync){
+        // Server decoder starts from scratch on every session, samples of an unfinished batch go to journal
+        telemetryResync = false;
+        for(uint8_t i = 0; i < encoder->batchSamples; ++i)
+            journalSample(encoder->batchTimes_ms[i], encoder->batchValues[i][0], encoder->batchValues[i][2], encoder->batchValues[i][1]);
+        telemetryEncoderReset(encoder);
+    }
+    const float values[TELEMETRY_CHANNELS] = {LM135Temp, AM2302Temp, AM2302Hum};
+    if(ESP_ERR_NOT_FINISHED != telemetryEncoderAdd(encoder, values, sampleTime_ms))
+        return true;
+    return sendSampleBatch();
+}
+
+static bool sendSampleBatch(void){
+    TelemetryEncoder *encoder = &telemetryEncoder;
+    // The server dates the newest sample at reception minus its age, a flushed batch can be maxSilence old
+    telemetryEncoderStamp(encoder, esp_timer_get_time() / 1000);
+    bool delivered = (TCP_SUCCESS == sendCompactFrameToServer(TCPSocket, encoder->frame, encoder->frameLength));
+    if(!delivered){
+        for(uint8_t i = 0; i < encoder->batchSamples; ++i)
+            journalSample(encoder->batchTimes_ms[i], encoder->batchValues[i][0], encoder->batchValues[i][2], encoder->batchValues[i][1]);
+    }
+    telemetryEncoderNextBatch(encoder);
+    return delivered;
+}
+
+static bool flushSampleBatch(int64_t now_ms){
+    // A batch of the previous session is journaled by the next publishSample
+    if(telemetryResync || 0 == telemetryEncoder.batchSamples)
+        return true;
+    uint32_t maxAge_ms = UINT32_MAX;
+    for(int ch = 0; ch < REPORT_CHANNELS; ++ch){
+        if(reportPolicies[ch].maxSilence_ms < maxAge_ms)
+            maxAge_ms = reportPolicies[ch].maxSilence_ms;
+    }
+    if(now_ms - telemetryEncoder.batchTimes_ms[0] < maxAge_ms || ESP_OK != telemetryEncoderFinish(&telemetryEncoder))
+        return true;
+    return sendSampleBatch();
+}
+#elif defined(CONFIG_TELEMETRY_ENCODING_UDP)
+static bool publishSample(int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp){
+    static uint32_t sequence = 0;
+    // A datagram that cannot be sent is just a lost sample for the server, it never ends the session
+    if(TCP_FAILURE == sendSensorsDatagramToServer(UDPSocket, sequence, LM135Temp, AM2302Hum, AM2302Temp))
+        ESP_LOGD(TAG, "Muestra %" PRIu32 " perdida", sequence);
+    sequence++;
+    return true;
+}
+#else
+static bool publishSample(int64_t sampleTime_ms, float LM135Temp, float AM2302Hum, float AM2302Temp){
+    if(TCP_SUCCESS == sendSensorsDataToServer(TCPSocket, LM135Temp, AM2302Hum, AM2302Temp))
+        return true;
+    journalSample(sampleTime_ms, LM135Temp, AM2302Hum, AM2302Temp);
+    return false;
+}
+#endif
+
+void replayJournal(void *pvParameters){
+    JournalRecord records[JOURNAL_REPLAY_CHUNK];
+    uint32_t segment;
+    journalSeal();
+    while(serverConnected && JOURNAL_NO_SEGMENT != (segment = journalOldestSegment())){
+        size_t offset = 0;
+        size_t count = 0;
+        bool sent = true;
+        do{
+            if(ESP_OK != journalReadSegment(segment, offset, records, JOURNAL_REPLAY_CHUNK, &count))
+                break;
+            if(count > 0 && TCP_SUCCESS != sendJournalChunkToServer(TCPSocket, segment, offset, records, count)){
+                sent = false;
+                break;
+            }
+            offset += count;
+            vTaskDelay(pdMS_TO_TICKS(JOURNAL_REPLAY_PERIOD_MS));
+        }while(serverConnected && JOURNAL_REPLAY_CHUNK == count);
+
+        if(!sent || !serverConnected || TCP_SUCCESS != sendJournalSegmentEndToServer(TCPSocket, segment, offset))
             break;
+        // Server answers with ackJournalSegment, which deletes the segment and notifies this task
+        if(0 == ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(JOURNAL_ACK_TIMEOUT_MS))){
+            ESP_LOGW(TAG, "Segmento %" PRIu32 " sin confirmacion, se reenviara", segment);
         }
-        vTaskDelay(pdMS_TO_TICKS(2000));
     }
+    journalReplayTask = NULL;
+    xSemaphoreGive(sessionTasksFinished);
     vTaskDelete(NULL);
 }
 
+#ifdef CONFIG_REMOTE_LOG_STREAM
+void forwardLogs(void *pvParameters){
+    LogEntry batch[LOG_FORWARD_BATCH];
+    LogStreamStats pending = {0};
+    while(true){
+        vTaskDelay(pdMS_TO_TICKS(LOG_FORWARD_PERIOD_MS));
+        // Without session lines wait in the ring and newer ones are dropped, so the last lines
+        // before a disconnection are the ones that reach the server
+        if(!serverConnected)
+            continue;
+        size_t count;
+        do{
+            LogStreamStats taken;
+            count = logStreamRead(batch, LOG_FORWARD_BATCH, esp_timer_get_time() / 1000);
+            logStreamTakeStats(&taken);
+            pending.dropped += taken.dropped;
+            pending.suppressed += taken.suppressed;
+            if(0 == count && 0 == pending.dropped && 0 == pending.suppressed)
+                break;
+            // A batch that cannot be sent is only accounted, telemetry is the one that detects a lost session
+            if(TCP_SUCCESS != sendLogBatchToServer(TCPSocket, batch, count, &pending)){
+                pending.dropped += count;
+                break;
+            }
+            pending.dropped = 0;
+            pending.suppressed = 0;
+        }while(serverConnected && LOG_FORWARD_BATCH == count);
+    }
+}
+#endif
+
 void receiveFunctionExecutionFromServer(void *pvParameters){
-    char rxBuffer[128];
+    char rxBuffer[RX_BUFFER_SIZE];
+    size_t rxLen = 0;
     ssize_t len;
-    char funcName[64];
-    float arg;
-    while (true){
-        len = recv(TCPSocket, rxBuffer, sizeof(rxBuffer) - 1, MSG_DONTWAIT);
+    while (serverConnected){
+        len = recv(TCPSocket, rxBuffer + rxLen, sizeof(rxBuffer) - 1 - rxLen, MSG_DONTWAIT);
         if( len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
             // No data received from server
             vTaskDelay(pdMS_TO_TICKS(500)); 
         }
         else if (len > 0) {
-            // Data received
-            rxBuffer[len] = '\0';
-            decodeJSONServerMessage(rxBuffer, funcName, &arg);
-            executeFunction(funcName, arg);
+            // Data received, messages are delimited by '\n'
+            int64_t rxTime = esp_timer_get_time();
+            rxLen += len;
+            rxBuffer[rxLen] = '\0';
+            char *message = rxBuffer;
+            char *delimiter;
+            while(NULL != (delimiter = strchr(message, '\n'))){
+                *delimiter = '\0';
+                if(delimiter != message)
+                    processServerMessage(message, rxTime);
+                message = delimiter + 1;
+            }
+            rxLen = strlen(message);
+            if(rxLen >= sizeof(rxBuffer) - 1){
+                ESP_LOGE(TAG, "Mensaje demasiado largo, descartado");
+                rxLen = 0;
+            }
+            memmove(rxBuffer, message, rxLen);
         }
         else if (len == 0) {
             ESP_LOGE(TAG, "Connection closed by peer");
             break;
         }
+        else {
+            ESP_LOGE(TAG, "Error receiving from server: errno %d", errno);
+            break;
+        }
     }
+    serverConnected = false;
+    xSemaphoreGive(sessionTasksFinished);
     vTaskDelete(NULL);
 }
 
-void executeFunction(const char funcName[], const float arg){
-    if(NULL == funcName){
-        ESP_LOGE(TAG, "No se obtuvo nombre de funcion");
+void processServerMessage(const char message[], int64_t rxTime_us){
+    ServerCommandBatch batch;
+    esp_err_t results[COMMAND_BATCH_MAX_OPS];
+    float states[COMMAND_BATCH_MAX_OPS] = {0};
+    esp_err_t result = decodeJSONServerBatch(message, &batch);
+    if(batch.single){
+        if(ESP_OK == result)
+            result = executeControlFunction(&batch.operations[0], &states[0]);
+        int64_t applyTime = esp_timer_get_time() - rxTime_us;
+        if(TCP_SUCCESS != sendAckToServer(TCPSocket, &batch.operations[0], result, states[0], applyTime)){
+            ESP_LOGE(TAG, "No se pudo confirmar comando %" PRIu32, batch.id);
+        }
         return;
     }
-    if(0 == strcmp(funcName, "toggleIrrigation")){
-        irrigationLevel = !irrigationLevel;
-        gpio_set_level(IRRIGATION_PIN, irrigationLevel);
-        ESP_LOGI(TAG, "Toggle de sistema de irrigacion");
+
+    if(ESP_OK == result){
+        result = executeBatch(&batch, results, states);
     }
-    else if(0 == strcmp(funcName, "setDesiredTemperature")){
-        setPIDDesiredValue(&BulbPowerPIDController, arg);
-        ESP_LOGI(TAG, "Temperatura ajustada: %.3f", arg);
+    else{
+        // Operations decoded before the invalid one are reported as not applied
+        for(size_t i = 0; i < batch.count; ++i)
+            results[i] = ESP_ERR_INVALID_STATE;
     }
-    else if(0 == strcmp(funcName, "setFanPower")){
-        setFanDutyCyclePerc(&coolerFan, arg);
-        ESP_LOGI(TAG, "Modificacion de potencia de ventilador: %f", arg);
+    int64_t applyTime = esp_timer_get_time() - rxTime_us;
+    if(TCP_SUCCESS != sendBatchAckToServer(TCPSocket, &batch, result, results, states, applyTime)){
+        ESP_LOGE(TAG, "No se pudo confirmar lote %" PRIu32, batch.id);
     }
-    else{
-        ESP_LOGE(TAG, "Funcion no reconocida: %s", funcName);
+}
+
+esp_err_t executeControlFunction(const ServerCommand *cmd, float *appliedState){
+    xSemaphoreTake(controlLock, portMAX_DELAY);
+    esp_err_t result = executeFunction(cmd, appliedState);
+    xSemaphoreGive(controlLock);
+    return result;
+}
+
+esp_err_t executeBatch(const ServerCommandBatch *batch, esp_err_t results[], float states[]){
+    esp_err_t result = ESP_OK;
+    for(size_t i = 0; i < batch->count; ++i){
+        results[i] = validateFunction(&batch->operations[i]);
+        if(ESP_OK == result && ESP_OK != results[i])
+            result = results[i];
+    }
+    if(ESP_OK != result){
+        for(size_t i = 0; i < batch->count; ++i){
+            if(ESP_OK == results[i])
+                results[i] = ESP_ERR_INVALID_STATE;
+        }
+        ESP_LOGE(TAG, "Lote %" PRIu32 " rechazado: %s", batch->id, esp_err_to_name(result));
+        return result;
     }
+
+    xSemaphoreTake(controlLock, portMAX_DELAY);
+    for(size_t i = 0; i < batch->count; ++i){
+        results[i] = executeFunction(&batch->operations[i], &states[i]);
+        if(ESP_OK == result && ESP_OK != results[i])
+            result = results[i];
+    }
+    xSemaphoreGive(controlLock);
+    ESP_LOGI(TAG, "Lote %" PRIu32 " aplicado: %u operaciones", batch->id, (unsigned)batch->count);
+    return result;
+}
+
+esp_err_t validateFunction(const ServerCommand *cmd){
+    if(NULL == cmd || '\0' == cmd->function[0]){
+        ESP_LOGE(TAG, "No se obtuvo nombre de funcion");
+        return ESP_ERR_INVALID_ARG;
+    }
+    // cJSON parses 1e999 as inf, and converting a non finite or out of range float to an integer is undefined
+    if(!isfinite(cmd->argument)){
+        ESP_LOGE(TAG, "Argumento no finito para %s", cmd->function);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(0 == strcmp(cmd->function, "setIrrigation") || 0 == strcmp(cmd->function, "setDesiredTemperature") ||
+       0 == strcmp(cmd->function, "setFanAuto")){
+        return ESP_OK;
+    }
+    if(0 == strcmp(cmd->function, "ackJournalSegment")){
+        return (cmd->argument < 0.0f || cmd->argument >= (float)JOURNAL_NO_SEGMENT) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+    if(0 == strcmp(cmd->function, "setFanPower")){
+        return (cmd->argument < 0.0f || cmd->argument > 1.0f) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+    if(0 == strcmp(cmd->function, "setReportDeadband")){
+        return (cmd->channel < 0 || cmd->channel >= REPORT_CHANNELS || cmd->argument < 0.0f) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+    if(0 == strcmp(cmd->function, "setReportMaxSilence")){
+        return (cmd->channel < 0 || cmd->channel >= REPORT_CHANNELS || cmd->argument <= 0.0f ||
+                cmd->argument > MAX_SILENCE_MAX_S) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+    if(0 == strcmp(cmd->function, "setTelemetryStream")){
+        // Range is checked on the float, only then it can be converted
+        return (cmd->argument < STREAM_RAW || cmd->argument > (STREAM_RAW | STREAM_SUMMARY)) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+    if(0 == strcmp(cmd->function, "setAggregationWindow")){
+        return (cmd->argument < 1.0f || cmd->argument > AGGREGATION_WINDOW_MAX_S) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+    ESP_LOGE(TAG, "Funcion no reconocida: %s", cmd->function);
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t executeFunction(const ServerCommand *cmd, float *appliedState){
+    esp_err_t result = validateFunction(cmd);
+    if(ESP_OK != result)
+        return result;
+    if(0 == strcmp(cmd->function, "setIrrigation")){
+        irrigationLevel = (cmd->argument != 0.0f);
+        result = gpio_set_level(IRRIGATION_PIN, irrigationLevel);
+        *appliedState = irrigationLevel;
+        ESP_LOGI(TAG, "Sistema de irrigacion: %s", irrigationLevel ? "encendido" : "apagado");
+    }
+    else if(0 == strcmp(cmd->function, "setDesiredTemperature")){
+        setPIDDesiredValue(&BulbPowerPIDController, cmd->argument);
+        *appliedState = BulbPowerPIDController.desiredVal;
+        ESP_LOGI(TAG, "Temperatura ajustada: %.3f", cmd->argument);
+    }
+    else if(0 == strcmp(cmd->function, "setFanPower")){
+        // Manual power overrides the cooling loop until setFanAuto
+        xSemaphoreTake(fanLock, portMAX_DELAY);
+        fanManual = true;
+        result = setFanDutyCyclePerc(&coolerFan, cmd->argument);
+        xSemaphoreGive(fanLock);
+        *appliedState = getFanDutyCyclePerc(&coolerFan);
+        ESP_LOGI(TAG, "Modificacion de potencia de ventilador: %f", cmd->argument);
+    }
+    else if(0 == strcmp(cmd->function, "setFanAuto")){
+        fanManual = false;
+        *appliedState = 1.0f;
+        ESP_LOGI(TAG, "Ventilador en modo automatico");
+    }
+    else if(0 == strcmp(cmd->function, "ackJournalSegment")){
+        result = journalDeleteSegment((uint32_t)cmd->argument);
+        *appliedState = cmd->argument;
+        if(journalReplayTask)
+            xTaskNotifyGive(journalReplayTask);
+    }
+    else if(0 == strcmp(cmd->function, "setReportDeadband")){
+        ChannelReportPolicy *policy = &reportPolicies[cmd->channel];
+        reportPolicyConfig(policy, cmd->argument, policy->maxSilence_ms);
+        *appliedState = policy->deadband;
+        ESP_LOGI(TAG, "Banda muerta del canal %d: %.2f", cmd->channel, policy->deadband);
+    }
+    else if(0 == strcmp(cmd->function, "setReportMaxSilence")){
+        ChannelReportPolicy *policy = &reportPolicies[cmd->channel];
+        reportPolicyConfig(policy, policy->deadband, (uint32_t)(cmd->argument * 1000));
+        *appliedState = policy->maxSilence_ms / 1000.0f;
+        ESP_LOGI(TAG, "Silencio maximo del canal %d: %.1f s", cmd->channel, *appliedState);
+    }
+    else if(0 == strcmp(cmd->function, "setTelemetryStream")){
+        uint8_t stream = (uint8_t)cmd->argument;
+        if((stream & STREAM_SUMMARY) && !(telemetryStream & STREAM_SUMMARY)){
+            // First summary covers only samples taken from now on
+            portENTER_CRITICAL(&aggregationLock);
+            aggregatorConfig(&aggregator, aggregator.window_ms, esp_timer_get_time() / 1000);
+            portEXIT_CRITICAL(&aggregationLock);
+        }
+        telemetryStream = stream;
+        *appliedState = stream;
+        ESP_LOGI(TAG, "Flujo de telemetria: %s%s", (stream & STREAM_RAW) ? "muestras " : "", (stream & STREAM_SUMMARY) ? "resumenes" : "");
+    }
+    else if(0 == strcmp(cmd->function, "setAggregationWindow")){
+        portENTER_CRITICAL(&aggregationLock);
+        aggregatorConfig(&aggregator, (uint32_t)(cmd->argument * 1000), esp_timer_get_time() / 1000);
+        portEXIT_CRITICAL(&aggregationLock);
+        *appliedState = aggregator.window_ms / 1000.0f;
+        ESP_LOGI(TAG, "Ventana de agregacion: %.0f s", *appliedState);
+    }
+    return result;
 }
 
 void PIDControl(void *pvParameters){
-    float power;
+    float output, heat, cool;
+    float fanTarget = -1.0f;
+    if(ESP_OK != zeroCrossInit()){
+        ESP_LOGE(TAG, "Zero cross no disponible, control de foco deshabilitado");
+        vTaskDelete(NULL);
+        return;
+    }
+    // Bulb and fan stay off until there is a temperature to control
+    while(pdTRUE != xSemaphoreTake(controlInputReady, pdMS_TO_TICKS(CONTROL_INPUT_WAIT_LOG_MS))){
+        ESP_LOGW(TAG, "Control en espera de la primera lectura del AM2302");
+    }
     while (true) {
-        power = computePIDOutput(&BulbPowerPIDController, am2302.temperature);
-        setBulbPowerPerc(power);
+        xSemaphoreTake(controlLock, portMAX_DELAY);
+        output = computePIDOutput(&BulbPowerPIDController, am2302.temperature);
+        computeSplitRangeOutputs(&coolingSplit, output, &heat, &cool);
+        setBulbPowerPerc(heat);
+        bulbPower = heat;
+
+        // Fan follows the cooling output with hardware fades, small changes are not worth a new fade
+        xSemaphoreTake(fanLock, portMAX_DELAY);
+        if(fanManual){
+            fanTarget = -1.0f;
+        }
+        else if(fabsf(cool - fanTarget) >= FAN_FADE_MIN_STEP || (0.0f == cool && 0.0f != fanTarget)){
+            if(ESP_OK == fadeFanDutyCyclePerc(&coolerFan, cool, FAN_FADE_TIME_MS))
+                fanTarget = cool;
+        }
+        xSemaphoreGive(fanLock);
+        xSemaphoreGive(controlLock);
+        if(!firstControlActionLogged){
+            firstControlActionLogged = true;
+            logBootPhase("Primera accion de control");
+        }
         vTaskDelay(pdMS_TO_TICKS(250));
     }
 }
 
+void logZeroCrossJitter(void *pvParameters){
+    ZeroCrossJitter stats;
+    while(true){
+        vTaskDelay(pdMS_TO_TICKS(JITTER_LOG_PERIOD_S * 1000));
+        zeroCrossGetJitter(&stats, true);
+        if(0 == stats.samples)
+            continue;
+        ESP_LOGI(TAG, "Cruce por cero: periodo %" PRIu32 "-%" PRIu32 " us (jitter %" PRIu32 " us), disparo TRIAC +%" PRIu64 " us prom, +%" PRIu32 " us max, %" PRIu32 " muestras",
+                 stats.periodMin_us, stats.periodMax_us, stats.periodMax_us - stats.periodMin_us,
+                 stats.fireLatencySum_us / stats.samples, stats.fireLatencyMax_us, stats.samples);
+    }
+}
+
+void persistControlState(void *pvParameters){
+    ControlState state;
+    while (true) {
+        float fanDuty = getFanDutyCyclePerc(&coolerFan);
+        state.desiredTemperature = BulbPowerPIDController.desiredVal;
+        state.Kp = BulbPowerPIDController.Kp;
+        state.Ki = BulbPowerPIDController.Ki;
+        state.Kd = BulbPowerPIDController.Kd;
+        state.integral = BulbPowerPIDController.IntegralVal;
+        // In automatic mode duty follows the loop, persisting it would only wear the flash
+        state.fanManual = fanManual;
+        state.fanDuty = (!fanManual || fanDuty < 0.0) ? 0.0 : fanDuty;
+        state.irrigation = irrigationLevel;
+        controlStateSave(&state);
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+}
+
 
 void updateLCDContent(void *pvParameters){
     while (true) {
@@ -0,0 +1,70 @@
+/**
+ *************************************
+ * @file: plant.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "plant.h"
+#include "zeroCrossPower.h"
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+PlantParameters plantDefaultParameters(void){
+	return (PlantParameters){
+		.heatCapacity_JK = 8000.0f,
+		.bulbPower_W = 100.0f,
+		.lossCoeff_WK = 2.5f,
+		.fanCoeff_WK = 25.0f,
+		.fanPower_W = 3.0f,
+		.sensorTau_s = 10.0f,
+		.sensorNoise_C = 0.1f,
+	};
+}
+
+void plantInit(GreenhousePlant *plant, const PlantParameters *params, float initial_C, uint64_t seed){
+	*plant = (GreenhousePlant){
+		.params = *params,
+		.air_C = initial_C,
+		.sensor_C = initial_C,
+		.rng = seed ? seed : 0x9E3779B97F4A7C15ull,
+	};
+}
+
+float plantBulbPower(const PlantParameters *params, uint32_t firingDelay_us){
+	if(firingDelay_us >= ZERO_CROSS_HALF_CYCLE_US)
+		return 0.0f;
+	double angle = M_PI * firingDelay_us / ZERO_CROSS_HALF_CYCLE_US;
+	return (float)(params->bulbPower_W * (1.0 - angle / M_PI + sin(2.0 * angle) / (2.0 * M_PI)));
+}
+
+void plantStep(GreenhousePlant *plant, float dt_s, float bulb_W, float fan, const PlantDisturbance *disturbance){
+	const PlantParameters *p = &plant->params;
+	float exchange = p->lossCoeff_WK + disturbance->doorLoss_WK + p->fanCoeff_WK * fan;
+	float netPower = bulb_W + disturbance->solar_W - exchange * (plant->air_C - disturbance->ambient_C);
+	plant->air_C += netPower * dt_s / p->heatCapacity_JK;
+	plant->sensor_C += (plant->air_C - plant->sensor_C) * dt_s / (p->sensorTau_s + dt_s);
+	plant->bulbEnergy_Wh += bulb_W * dt_s / 3600.0;
+	plant->fanEnergy_Wh += p->fanPower_W * fan * dt_s / 3600.0;
+}
+
+// @brief xorshift64*, reproducible on every host
+static double _uniform(GreenhousePlant *plant){
+	plant->rng ^= plant->rng >> 12;
+	plant->rng ^= plant->rng << 25;
+	plant->rng ^= plant->rng >> 27;
+	return ((plant->rng * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+float plantReadSensor(GreenhousePlant *plant){
+	// Box-Muller
+	double u1 = _uniform(plant);
+	double u2 = _uniform(plant);
+	double noise = sqrt(-2.0 * log(u1 + 1e-300)) * cos(2.0 * M_PI * u2) * plant->params.sensorNoise_C;
+	return roundf((plant->sensor_C + (float)noise) * 10.0f) / 10.0f;
+}
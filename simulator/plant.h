@@ -0,0 +1,78 @@
+/**
+ *************************************
+ * @file: plant.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdint.h>
+
+/*
+ * Lumped thermal model of the greenhouse: one node for air and structure exchanging heat with
+ * the outside through walls (and an open door), the bulb and the fan, plus a first order
+ * AM2302 with noise and 0.1 °C resolution.
+ *
+ *   C dT/dt = P_bulb + P_sun - (UA + UA_door + G_fan * fan) (T - T_amb)
+ */
+typedef struct{
+	float heatCapacity_JK;      // Air, structure and soil seen by the sensor
+	float bulbPower_W;          // Bulb fired at the zero cross
+	float lossCoeff_WK;         // Walls and leaks
+	float fanCoeff_WK;          // Exchange with outside air at 100% fan
+	float fanPower_W;           // Electrical power of the fan at 100%
+	float sensorTau_s;          // AM2302 response time
+	float sensorNoise_C;        // Standard deviation of sensor noise
+}PlantParameters;
+
+typedef struct{
+	PlantParameters params;
+	float air_C;
+	float sensor_C;
+	double bulbEnergy_Wh;
+	double fanEnergy_Wh;
+	uint64_t rng;
+}GreenhousePlant;
+
+/**
+ * Conditions imposed by a scenario at a given time
+ */
+typedef struct{
+	float ambient_C;
+	float solar_W;
+	float doorLoss_WK;
+}PlantDisturbance;
+
+/**
+ * @brief      Parameters of the reference greenhouse (100 W bulb, small fan)
+ */
+PlantParameters plantDefaultParameters(void);
+
+/**
+ * @brief      Starts the plant in equilibrium at initial_C
+ *
+ * @param[in]  seed  Seed of the sensor noise, same seed gives the same run
+ */
+void plantInit(GreenhousePlant *plant, const PlantParameters *params, float initial_C, uint64_t seed);
+
+/**
+ * @brief      Average power delivered by the bulb when the TRIAC fires firingDelay_us after the zero cross
+ *
+ * Phase control of a resistive load: P / Pmax = 1 - a / pi + sin(2a) / (2 pi), a = pi * delay / half cycle
+ */
+float plantBulbPower(const PlantParameters *params, uint32_t firingDelay_us);
+
+/**
+ * @brief      Integrates the plant dt_s seconds
+ *
+ * @param[in]  bulb_W  Power delivered by the bulb
+ * @param[in]  fan     Fan duty cycle [0-1]
+ */
+void plantStep(GreenhousePlant *plant, float dt_s, float bulb_W, float fan, const PlantDisturbance *disturbance);
+
+/**
+ * @brief      Reading of the AM2302 (lagged, noisy and quantized)
+ */
+float plantReadSensor(GreenhousePlant *plant);
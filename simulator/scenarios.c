@@ -0,0 +1,103 @@
+/**
+ *************************************
+ * @file: scenarios.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#include "scenarios.h"
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// @brief Daily temperature cycle with its maximum at 15 h
+static float _dailyAmbient(float t_h, float mean_C, float amplitude_C){
+	return mean_C + amplitude_C * cosf(2.0f * (float)M_PI * (fmodf(t_h, 24.0f) - 15.0f) / 24.0f);
+}
+
+// @brief Solar gain between 6 h and 18 h
+static float _solarGain(float t_h, float peak_W){
+	float hour = fmodf(t_h, 24.0f);
+	return (hour > 6.0f && hour < 18.0f) ? peak_W * sinf((float)M_PI * (hour - 6.0f) / 12.0f) : 0.0f;
+}
+
+
+static float _stepSetpoint(float t_h){
+	return 28.0f;
+}
+
+static void _stepDisturbance(float t_h, PlantDisturbance *d){
+	*d = (PlantDisturbance){.ambient_C = 20.0f};
+}
+
+
+static float _changesSetpoint(float t_h){
+	if(t_h < 4.0f)
+		return 24.0f;
+	return (t_h < 8.0f) ? 30.0f : 22.0f;
+}
+
+static void _changesDisturbance(float t_h, PlantDisturbance *d){
+	*d = (PlantDisturbance){.ambient_C = 18.0f};
+}
+
+
+static float _coldNightSetpoint(float t_h){
+	return 26.0f;
+}
+
+static void _coldNightDisturbance(float t_h, PlantDisturbance *d){
+	// 6 °C before dawn, 24 °C in the afternoon
+	*d = (PlantDisturbance){.ambient_C = _dailyAmbient(t_h, 15.0f, 9.0f)};
+}
+
+
+static float _doorSetpoint(float t_h){
+	return 25.0f;
+}
+
+static void _doorDisturbance(float t_h, PlantDisturbance *d){
+	// Door open 10 min at 3 h and 15 min at 6 h
+	bool open = (t_h >= 3.0f && t_h < 3.0f + 10.0f / 60.0f) || (t_h >= 6.0f && t_h < 6.25f);
+	*d = (PlantDisturbance){.ambient_C = 12.0f, .doorLoss_WK = open ? 20.0f : 0.0f};
+}
+
+
+static float _sunnySetpoint(float t_h){
+	return 30.0f;
+}
+
+static void _sunnyDisturbance(float t_h, PlantDisturbance *d){
+	*d = (PlantDisturbance){.ambient_C = _dailyAmbient(t_h, 20.0f, 5.0f), .solar_W = _solarGain(t_h, 120.0f)};
+}
+
+
+// Limits are the current response with some margin: --check fails when a change makes control worse
+const Scenario scenarios[] = {
+	{"step", "Arranque a 20 °C con consigna de 28 °C", 6.0f, 20.0f, _stepSetpoint, _stepDisturbance,
+	 {.settling_min = 60.0f, .overshoot_C = 8.0f, .steadyError_C = 0.1f, .energy_Wh = 200.0f}},
+	{"setpoint_changes", "Consigna 24 -> 30 -> 22 °C cada 4 h con 18 °C afuera", 12.0f, 18.0f, _changesSetpoint, _changesDisturbance,
+	 {.settling_min = 50.0f, .overshoot_C = 6.5f, .steadyError_C = 0.1f, .energy_Wh = 360.0f}},
+	{"cold_night", "Dos dias con 6 °C en la madrugada y consigna de 26 °C", 48.0f, 20.0f, _coldNightSetpoint, _coldNightDisturbance,
+	 {.settling_min = 50.0f, .overshoot_C = 6.0f, .steadyError_C = 0.1f, .energy_Wh = 1600.0f}},
+	{"door_open", "Puerta abierta 10 y 15 min con 12 °C afuera", 9.0f, 25.0f, _doorSetpoint, _doorDisturbance,
+	 {.settling_min = 480.0f, .overshoot_C = 11.5f, .steadyError_C = 0.1f, .energy_Wh = 520.0f}},
+	{"sunny_day", "Dia soleado (120 W de radiacion) que obliga a ventilar, consigna de 30 °C", 24.0f, 22.0f, _sunnySetpoint, _sunnyDisturbance,
+	 {.settling_min = 60.0f, .overshoot_C = 8.0f, .steadyError_C = 0.1f, .energy_Wh = 530.0f}},
+};
+
+const size_t scenarioCount = sizeof(scenarios) / sizeof(scenarios[0]);
+
+const Scenario *findScenario(const char name[]){
+	for(size_t i = 0; i < scenarioCount; ++i){
+		if(0 == strcmp(scenarios[i].name, name))
+			return &scenarios[i];
+	}
+	return NULL;
+}
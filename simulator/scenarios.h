@@ -0,0 +1,42 @@
+/**
+ *************************************
+ * @file: scenarios.h
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stddef.h>
+#include "plant.h"
+
+/**
+ * Worst acceptable results of a scenario, used by --check to catch control regressions
+ */
+typedef struct{
+	float settling_min;
+	float overshoot_C;
+	float steadyError_C;
+	float energy_Wh;
+}ScenarioLimits;
+
+typedef struct{
+	const char *name;
+	const char *description;
+	float duration_h;
+	float initial_C;
+	float (*setpoint)(float t_h);
+	void (*disturbance)(float t_h, PlantDisturbance *disturbance);
+	ScenarioLimits limits;
+}Scenario;
+
+extern const Scenario scenarios[];
+extern const size_t scenarioCount;
+
+/**
+ * @brief      Looks for a scenario by name
+ *
+ * @return     Scenario or NULL if there is none with that name
+ */
+const Scenario *findScenario(const char name[]);
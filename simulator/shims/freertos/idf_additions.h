@@ -0,0 +1,27 @@
+/**
+ *************************************
+ * @file: idf_additions.h (simulator shim)
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Minimal FreeRTOS surface used by the control components. The tick count is driven by the
+ * simulated clock so PIDControl.c sees the same time base it sees on the device.
+ */
+#define configTICK_RATE_HZ 100          // ESP-IDF default (CONFIG_FREERTOS_HZ)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+
+typedef uint32_t TickType_t;
+
+/**
+ * @brief      Ticks since the start of the simulation
+ */
+TickType_t xTaskGetTickCount(void);
@@ -0,0 +1,356 @@
+/**
+ *************************************
+ * @file: simulator.c
+ * @author: Solis Hernandez Ian Alexis
+ * @year: 2025
+ * @licence: MIT
+ * ***********************************
+ */
+
+/*
+ * Runs the control loop of main.c (PIDControl task, split range, zero cross table, fan fades
+ * and adaptive AM2302 sampling) against the plant model with a simulated clock, and measures
+ * settling time, overshoot, steady state error and energy of every scenario.
+ *
+ *   greenhouse_sim [scenario|all] [--kp x] [--ki x] [--kd x] [--seed n] [--runs n] [--csv file] [--check]
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "PIDControl.h"
+#include "ReportPolicy.h"
+#include "zeroCrossPower.h"
+#include "plant.h"
+#include "scenarios.h"
+
+// Same values as main.c and zeroCross.h
+#define MAX_BULB_POWER 1.0f
+#define DEFAULT_KP 0.8f
+#define DEFAULT_KI 0.005f
+#define DEFAULT_KD 0.001f
+#define MIN_COOLING_OUTPUT -1.0f
+#define COOLING_DEADBAND_C 0.5f
+#define COOLING_HYSTERESIS_C 0.1f
+#define FAN_FADE_TIME_MS 2000
+#define FAN_FADE_MIN_STEP 0.02f
+#define CONTROL_PERIOD_MS 250
+#define ACQUISITION_TICK_MS 500
+#define AM2302_MIN_PERIOD_MS 2000
+#define SAMPLING_MAX_PERIOD_MS 10000
+#define DEFAULT_AM2302T_DEADBAND 0.2f
+
+#define PLANT_STEP_MS 50
+#define SETTLING_BAND_C 0.5f
+#define CSV_PERIOD_MS 10000
+
+typedef struct{
+	float Kp;
+	float Ki;
+	float Kd;
+	uint64_t seed;
+	int runs;
+	FILE *csv;
+	bool check;
+}SimOptions;
+
+/**
+ * Response to one constant setpoint
+ */
+typedef struct{
+	double start_s;
+	float setpoint;
+	float direction;             // +1 heating up to the setpoint, -1 cooling down, 0 started inside the band
+	float peak_C;                // Largest excursion past the setpoint
+	double lastEntry_s;          // Last time temperature came back into the band
+	bool inBand;
+	double settledErrorSum;
+	uint64_t settledSamples;
+}Segment;
+
+typedef struct{
+	float settling_min;          // Worst segment, whole segment if it never settled
+	float overshoot_C;
+	float steadyError_C;
+	float energy_Wh;
+	float iae_Ch;                // Integral of |error|
+	int unsettled;
+}ScenarioResult;
+
+static uint64_t simTime_ms = 0;
+
+TickType_t xTaskGetTickCount(void){
+	return (TickType_t)(simTime_ms / portTICK_PERIOD_MS);
+}
+
+
+// @brief Starts measuring the response to setpoint
+static void _segmentStart(Segment *segment, float setpoint, float air_C, double now_s){
+	float error = setpoint - air_C;
+	*segment = (Segment){
+		.start_s = now_s,
+		.setpoint = setpoint,
+		.direction = (fabsf(error) <= SETTLING_BAND_C) ? 0.0f : (error > 0.0f ? 1.0f : -1.0f),
+		.lastEntry_s = now_s,
+		.inBand = fabsf(error) <= SETTLING_BAND_C,
+	};
+}
+
+static void _segmentSample(Segment *segment, float air_C, double now_s){
+	float error = air_C - segment->setpoint;
+	// Past the setpoint for steps, either side when the segment started settled (disturbance rejection)
+	float excursion = (segment->direction != 0.0f) ? error * segment->direction : fabsf(error);
+	if(excursion > segment->peak_C)
+		segment->peak_C = excursion;
+
+	bool inBand = fabsf(error) <= SETTLING_BAND_C;
+	if(inBand && !segment->inBand){
+		segment->lastEntry_s = now_s;
+		segment->settledErrorSum = 0.0;
+		segment->settledSamples = 0;
+	}
+	segment->inBand = inBand;
+	if(inBand){
+		segment->settledErrorSum += fabsf(error);
+		segment->settledSamples++;
+	}
+}
+
+static void _segmentClose(const Segment *segment, double now_s, ScenarioResult *result){
+	float settling_min = (float)((segment->inBand ? segment->lastEntry_s : now_s) - segment->start_s) / 60.0f;
+	if(!segment->inBand)
+		result->unsettled++;
+	if(settling_min > result->settling_min)
+		result->settling_min = settling_min;
+	if(segment->peak_C > result->overshoot_C)
+		result->overshoot_C = segment->peak_C;
+	float steadyError = segment->settledSamples ? (float)(segment->settledErrorSum / segment->settledSamples) : SETTLING_BAND_C;
+	if(steadyError > result->steadyError_C)
+		result->steadyError_C = steadyError;
+}
+
+
+/**
+ * @brief      Simulates scenario once with the control loop of the firmware
+ *
+ * @param      csv   Trace output, NULL to skip it
+ */
+static void _runScenario(const Scenario *scenario, const SimOptions *options, uint64_t seed, FILE *csv, ScenarioResult *result){
+	PlantParameters params = plantDefaultParameters();
+	GreenhousePlant plant;
+	plantInit(&plant, &params, scenario->initial_C, seed);
+
+	PIDController pid = {0};
+	SplitRange split = {0};
+	AdaptiveSampler sampler;
+	setPIDGains(&pid, options->Kp, options->Ki, options->Kd);
+	setPIDMaxAndMinVals(&pid, MIN_COOLING_OUTPUT, MAX_BULB_POWER);
+	setSplitRangeBand(&split, options->Kp, COOLING_DEADBAND_C, COOLING_HYSTERESIS_C);
+	adaptiveSamplerConfig(&sampler, AM2302_MIN_PERIOD_MS, SAMPLING_MAX_PERIOD_MS);
+
+	simTime_ms = 0;
+	uint64_t end_ms = (uint64_t)(scenario->duration_h * 3600.0f * 1000.0f);
+	uint64_t nextSample_ms = 0, nextControl_ms = 0, nextCsv_ms = 0;
+	float temperature = plantReadSensor(&plant);
+	float bulb_W = 0.0f, heat = 0.0f, cool = 0.0f;
+	// Fan fade: duty moves linearly from fadeFrom to fanTarget in FAN_FADE_TIME_MS
+	float fanTarget = -1.0f, fanFrom = 0.0f, fanDuty = 0.0f;
+	uint64_t fadeStart_ms = 0;
+	double iae = 0.0;
+
+	*result = (ScenarioResult){0};
+	Segment segment;
+	_segmentStart(&segment, scenario->setpoint(0.0f), plant.air_C, 0.0);
+
+	PlantDisturbance disturbance;
+	for(; simTime_ms < end_ms; simTime_ms += PLANT_STEP_MS){
+		float t_h = simTime_ms / 3600000.0f;
+		double now_s = simTime_ms / 1000.0;
+		scenario->disturbance(t_h, &disturbance);
+
+		if(simTime_ms >= nextSample_ms){
+			float reading = plantReadSensor(&plant);
+			uint32_t period = adaptiveSamplerUpdate(&sampler, fabsf(reading - temperature) / DEFAULT_AM2302T_DEADBAND);
+			// Acquisition scheduler rounds periods to whole ticks
+			uint32_t ticks = (period + ACQUISITION_TICK_MS / 2) / ACQUISITION_TICK_MS;
+			nextSample_ms += (uint64_t)(ticks ? ticks : 1) * ACQUISITION_TICK_MS;
+			temperature = reading;
+		}
+
+		if(simTime_ms >= nextControl_ms){
+			float setpoint = scenario->setpoint(t_h);
+			if(setpoint != segment.setpoint){
+				_segmentClose(&segment, now_s, result);
+				_segmentStart(&segment, setpoint, plant.air_C, now_s);
+			}
+			setPIDDesiredValue(&pid, setpoint);
+			float output = computePIDOutput(&pid, temperature);
+			computeSplitRangeOutputs(&split, output, &heat, &cool);
+			bulb_W = plantBulbPower(&params, zeroCrossFiringDelay_us(heat));
+			if(fabsf(cool - fanTarget) >= FAN_FADE_MIN_STEP || (0.0f == cool && 0.0f != fanTarget)){
+				fanFrom = fanDuty;
+				fanTarget = cool;
+				fadeStart_ms = simTime_ms;
+			}
+			_segmentSample(&segment, plant.air_C, now_s);
+			iae += fabsf(plant.air_C - setpoint) * CONTROL_PERIOD_MS / 3600000.0;
+			nextControl_ms += CONTROL_PERIOD_MS;
+		}
+
+		uint64_t fading_ms = simTime_ms - fadeStart_ms;
+		fanDuty = (fading_ms >= FAN_FADE_TIME_MS) ? fanTarget : fanFrom + (fanTarget - fanFrom) * fading_ms / FAN_FADE_TIME_MS;
+		if(fanDuty < 0.0f)
+			fanDuty = 0.0f;
+
+		if(csv && simTime_ms >= nextCsv_ms){
+			fprintf(csv, "%s,%.4f,%.2f,%.2f,%.3f,%.1f,%.3f,%.3f\n", scenario->name, t_h, segment.setpoint,
+			        disturbance.ambient_C, plant.air_C, temperature, heat, fanDuty);
+			nextCsv_ms += CSV_PERIOD_MS;
+		}
+
+		plantStep(&plant, PLANT_STEP_MS / 1000.0f, bulb_W, fanDuty, &disturbance);
+	}
+	_segmentClose(&segment, simTime_ms / 1000.0, result);
+	result->energy_Wh = (float)(plant.bulbEnergy_Wh + plant.fanEnergy_Wh);
+	result->iae_Ch = (float)iae;
+}
+
+// @brief Keeps the worst value of every metric, energy and IAE are averaged
+static void _mergeResult(ScenarioResult *worst, const ScenarioResult *run, int runs){
+	worst->settling_min = fmaxf(worst->settling_min, run->settling_min);
+	worst->overshoot_C = fmaxf(worst->overshoot_C, run->overshoot_C);
+	worst->steadyError_C = fmaxf(worst->steadyError_C, run->steadyError_C);
+	worst->energy_Wh += run->energy_Wh / runs;
+	worst->iae_Ch += run->iae_Ch / runs;
+	worst->unsettled += run->unsettled;
+}
+
+/**
+ * @brief      Compares result with the limits of the scenario
+ *
+ * @return     true if every metric is within its limit
+ */
+static bool _checkLimits(const Scenario *scenario, const ScenarioResult *result){
+	const ScenarioLimits *limits = &scenario->limits;
+	bool passed = true;
+	if(result->unsettled){
+		printf("  FALLA %s: %d segmentos no se estabilizaron\n", scenario->name, result->unsettled);
+		passed = false;
+	}
+	if(result->settling_min > limits->settling_min){
+		printf("  FALLA %s: estabilizacion %.1f min > %.1f min\n", scenario->name, result->settling_min, limits->settling_min);
+		passed = false;
+	}
+	if(result->overshoot_C > limits->overshoot_C){
+		printf("  FALLA %s: sobreimpulso %.2f °C > %.2f °C\n", scenario->name, result->overshoot_C, limits->overshoot_C);
+		passed = false;
+	}
+	if(result->steadyError_C > limits->steadyError_C){
+		printf("  FALLA %s: error estacionario %.3f °C > %.3f °C\n", scenario->name, result->steadyError_C, limits->steadyError_C);
+		passed = false;
+	}
+	if(result->energy_Wh > limits->energy_Wh){
+		printf("  FALLA %s: energia %.0f Wh > %.0f Wh\n", scenario->name, result->energy_Wh, limits->energy_Wh);
+		passed = false;
+	}
+	return passed;
+}
+
+static void _usage(const char *program){
+	fprintf(stderr, "Uso: %s [escenario|all] [--kp x] [--ki x] [--kd x] [--seed n] [--runs n] [--csv archivo] [--check]\n", program);
+	fprintf(stderr, "Escenarios:\n");
+	for(size_t i = 0; i < scenarioCount; ++i)
+		fprintf(stderr, "  %-18s %s (%.0f h)\n", scenarios[i].name, scenarios[i].description, scenarios[i].duration_h);
+}
+
+
+int main(int argc, char *argv[]){
+	SimOptions options = {
+		.Kp = DEFAULT_KP,
+		.Ki = DEFAULT_KI,
+		.Kd = DEFAULT_KD,
+		.seed = 1,
+		.runs = 1,
+	};
+	const char *selected = "all";
+	const char *csvPath = NULL;
+
+	for(int i = 1; i < argc; ++i){
+		bool hasValue = i + 1 < argc;
+		if(0 == strcmp(argv[i], "--kp") && hasValue)
+			options.Kp = strtof(argv[++i], NULL);
+		else if(0 == strcmp(argv[i], "--ki") && hasValue)
+			options.Ki = strtof(argv[++i], NULL);
+		else if(0 == strcmp(argv[i], "--kd") && hasValue)
+			options.Kd = strtof(argv[++i], NULL);
+		else if(0 == strcmp(argv[i], "--seed") && hasValue)
+			options.seed = strtoull(argv[++i], NULL, 10);
+		else if(0 == strcmp(argv[i], "--runs") && hasValue)
+			options.runs = atoi(argv[++i]);
+		else if(0 == strcmp(argv[i], "--csv") && hasValue)
+			csvPath = argv[++i];
+		else if(0 == strcmp(argv[i], "--check"))
+			options.check = true;
+		else if(argv[i][0] != '-')
+			selected = argv[i];
+		else{
+			_usage(argv[0]);
+			return 2;
+		}
+	}
+	if(options.runs < 1){
+		_usage(argv[0]);
+		return 2;
+	}
+
+	const Scenario *only = NULL;
+	if(0 != strcmp(selected, "all") && NULL == (only = findScenario(selected))){
+		fprintf(stderr, "Escenario desconocido: %s\n", selected);
+		_usage(argv[0]);
+		return 2;
+	}
+	if(csvPath){
+		if(NULL == (options.csv = fopen(csvPath, "w"))){
+			perror(csvPath);
+			return 2;
+		}
+		fprintf(options.csv, "scenario,t_h,setpoint,ambient,air,sensor,heat,fan\n");
+	}
+
+	printf("Kp %.4g Ki %.4g Kd %.4g, semilla %llu, %d corridas por escenario\n",
+	       options.Kp, options.Ki, options.Kd, (unsigned long long)options.seed, options.runs);
+	printf("%-18s %10s %12s %10s %10s %10s\n", "escenario", "estab[min]", "sobreimp[°C]", "error[°C]", "IAE[°C h]", "energia[Wh]");
+
+	struct timespec wallStart, wallEnd;
+	clock_gettime(CLOCK_MONOTONIC, &wallStart);
+	double simulated_h = 0.0;
+	bool passed = true;
+	for(size_t i = 0; i < scenarioCount; ++i){
+		const Scenario *scenario = &scenarios[i];
+		if(only && only != scenario)
+			continue;
+		ScenarioResult worst = {0}, run;
+		for(int r = 0; r < options.runs; ++r){
+			// Trace only the first run, the rest only change the sensor noise
+			_runScenario(scenario, &options, options.seed + r, (0 == r) ? options.csv : NULL, &run);
+			_mergeResult(&worst, &run, options.runs);
+			simulated_h += scenario->duration_h;
+		}
+		printf("%-18s %10.1f %12.2f %10.3f %10.2f %10.0f%s\n", scenario->name, worst.settling_min, worst.overshoot_C,
+		       worst.steadyError_C, worst.iae_Ch, worst.energy_Wh, worst.unsettled ? "  (sin estabilizar)" : "");
+		if(options.check && !_checkLimits(scenario, &worst))
+			passed = false;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+	double wall_s = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+	printf("%.0f h simuladas en %.2f s (%.0f h simuladas por minuto)\n", simulated_h, wall_s, simulated_h / wall_s * 60.0);
+
+	if(options.csv)
+		fclose(options.csv);
+	if(options.check)
+		printf(passed ? "Todos los escenarios dentro de sus limites\n" : "Hay escenarios fuera de sus limites\n");
+	return passed ? 0 : 1;
+}